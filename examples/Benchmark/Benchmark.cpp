@@ -0,0 +1,316 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Host benchmark of the analyzer ISRs, driven by the simulated backend.
+ *
+ * Run with: PLATFORMIO_SRC_DIR=examples/Benchmark pio run -e native && .pio/build/native/program
+ *
+ * For each pulse type, a signal is generated and fed to the analyzer through the simulated pin.
+ * The cost of each edge interrupt (_edgeISR) and of each timer alarm (_zcTimerISR, _onlineTimerISR) is measured,
+ * as well as the jitter of the ZC events, with and without the PLL mode, and for each capture backend.
+ * The scenarios with spikes in the signal are also run with the adaptive filter, which must reject them.
+ * After each run, the signal is lost then back, and must be detected again quickly from the learned profile.
+ * The scenarios at a nominal grid frequency are also run with the PulseAnalyzerT variant specialized for them.
+ *
+ * The interrupts are serviced after a random latency (BENCH_LATENCY_MIN to BENCH_LATENCY_MAX),
+ * which the ETM backend compensates and the GPIO backend does not.
+ *
+ * Build with -D MYCILA_PULSE_TIMER_RESOLUTION_HZ=40000000 to compare the ZC jitter and the measured grid frequency
+ * with the timers at 40 MHz.
+ */
+#include <MycilaPulseAnalyzer.h>
+
+#include <chrono>
+#include <initializer_list>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <type_traits>
+
+#define PIN_ZC 35
+
+// number of signal periods to simulate per scenario
+#define BENCH_PERIODS 50000
+
+// number of signal periods fed after the outage, to detect the pulse again
+#define BENCH_RELOCK_PERIODS 10
+
+// simulated interrupt latency range in ns
+#define BENCH_LATENCY_MIN 2000
+#define BENCH_LATENCY_MAX 5000
+
+static const char* captures[] = {"GPIO", "ETM", "MCPWM"};
+
+typedef struct {
+    const char* name;
+    Mycila::PulseAnalyzer::Type type;
+    // signal period in ns
+    uint64_t period;
+    // high level duration in ns
+    uint64_t width;
+    // random jitter applied to each edge, in ns (+/-)
+    uint32_t jitter;
+    // width of the spikes injected in the low level once the pulse type is detected, in ns (0: none)
+    uint32_t spike;
+    // grid frequency of the PulseAnalyzerT variant also run for this scenario (0: none)
+    uint8_t frequency;
+} Scenario;
+
+static const Scenario scenarios[] = {
+  {"TYPE_SHORT (Robodyn 50 Hz)", Mycila::PulseAnalyzer::Type::TYPE_SHORT, 10000000, 450000, 0, 0, 50},
+  {"TYPE_SHORT (ZCD 60 Hz)", Mycila::PulseAnalyzer::Type::TYPE_SHORT, 8333333, 1100000, 0, 0, 60},
+  {"TYPE_SHORT (Robodyn 49.93 Hz, 40 us jitter)", Mycila::PulseAnalyzer::Type::TYPE_SHORT, 10014020, 450000, 40000, 0, 50},
+  {"TYPE_SEMI_PERIOD (BM1Z102FJ 50 Hz)", Mycila::PulseAnalyzer::Type::TYPE_SEMI_PERIOD, 20000000, 10000000, 0, 0, 50},
+  {"TYPE_SEMI_PERIOD (BM1Z102FJ 49.93 Hz, 40 us jitter)", Mycila::PulseAnalyzer::Type::TYPE_SEMI_PERIOD, 20028040, 10014020, 40000, 0, 50},
+  {"TYPE_FULL_PERIOD (JSY-MK-194G 50 Hz)", Mycila::PulseAnalyzer::Type::TYPE_FULL_PERIOD, 40000000, 20000000, 0, 0, 50},
+  {"TYPE_SHORT (Robodyn 50 Hz, 150 us spikes)", Mycila::PulseAnalyzer::Type::TYPE_SHORT, 10000000, 450000, 0, 150000, 0},
+  {"TYPE_SEMI_PERIOD (BM1Z102FJ 50 Hz, 150 us spikes)", Mycila::PulseAnalyzer::Type::TYPE_SEMI_PERIOD, 20000000, 10000000, 0, 150000, 0},
+};
+
+typedef struct {
+    uint64_t count = 0;
+    uint64_t total = 0;
+    uint64_t max = 0;
+
+    void add(uint64_t ns) {
+      count++;
+      total += ns;
+      if (ns > max)
+        max = ns;
+    }
+} Stat;
+
+// ZC events
+static uint32_t zeroCrossCount = 0;
+static uint64_t lastZeroCross = 0;
+static double zcIntervalSum = 0;
+static double zcIntervalSquares = 0;
+static uint32_t zcIntervalCount = 0;
+static bool zcMeasure = false;
+
+static void onZeroCross(int16_t delay, void* arg) {
+  const uint64_t now = Mycila::PulseSimulator::now();
+  if (zcMeasure && lastZeroCross) {
+    const double interval = now - lastZeroCross;
+    zcIntervalSum += interval;
+    zcIntervalSquares += interval * interval;
+    zcIntervalCount++;
+  }
+  lastZeroCross = now;
+  zeroCrossCount++;
+}
+
+// deterministic pseudo-random jitter
+static uint32_t seed = 1;
+static int64_t jitter(uint32_t amplitude) {
+  if (!amplitude)
+    return 0;
+  seed = seed * 1664525 + 1013904223;
+  return static_cast<int64_t>(seed % (2 * amplitude + 1)) - amplitude;
+}
+
+static inline uint64_t elapsed(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// move the simulated clock and measure the cost of the alarms fired on the way
+static void advanceTo(uint64_t ns, Stat* alarms) {
+  const uint32_t before = zeroCrossCount;
+  const auto start = std::chrono::steady_clock::now();
+  Mycila::PulseSimulator::advanceTo(ns);
+  const uint64_t cost = elapsed(start);
+  if (zeroCrossCount != before)
+    alarms->add(cost / (zeroCrossCount - before));
+}
+
+template <typename Analyzer>
+static bool run(const Scenario& scenario, bool pll, bool filter, Mycila::PulseAnalyzer::Capture capture) {
+  Analyzer pulseAnalyzer;
+  const bool fixed = !std::is_same<Analyzer, Mycila::PulseAnalyzer>::value;
+  Stat edges, edgesLocked, zc, watchdog;
+  uint64_t lockTime = 0;
+  uint32_t spikes = 0;
+
+  Mycila::PulseSimulator::reset();
+  zeroCrossCount = 0;
+  lastZeroCross = 0;
+  zcIntervalSum = 0;
+  zcIntervalSquares = 0;
+  zcIntervalCount = 0;
+  zcMeasure = false;
+  seed = 1;
+
+  pulseAnalyzer.setPLLEnabled(pll);
+  pulseAnalyzer.setAdaptiveFilterEnabled(filter);
+  pulseAnalyzer.onZeroCross(onZeroCross);
+  pulseAnalyzer.begin(PIN_ZC, capture);
+
+  uint64_t t = 1000000;
+  for (uint32_t i = 0; i < BENCH_PERIODS; i++) {
+    // let the analyzer settle before measuring the ZC jitter
+    zcMeasure = i > BENCH_PERIODS / 10;
+
+    for (bool level : {true, false}) {
+      advanceTo(t + jitter(scenario.jitter), &zc);
+
+      Mycila::PulseSimulator::setInterruptLatency((BENCH_LATENCY_MIN + BENCH_LATENCY_MAX) / 2 + jitter((BENCH_LATENCY_MAX - BENCH_LATENCY_MIN) / 2));
+
+      const bool locked = pulseAnalyzer.getType() != Mycila::PulseAnalyzer::Type::TYPE_UNKNOWN;
+      const auto start = std::chrono::steady_clock::now();
+      Mycila::PulseSimulator::setLevel(PIN_ZC, level);
+      const uint64_t ns = elapsed(start);
+      edges.add(ns);
+      if (locked)
+        edgesLocked.add(ns);
+      else if (pulseAnalyzer.getType() != Mycila::PulseAnalyzer::Type::TYPE_UNKNOWN)
+        lockTime = Mycila::PulseSimulator::now() / 1000;
+
+      // spike in the middle of the low level, once the analyzer knows what to expect
+      if (!level && scenario.spike && pulseAnalyzer.getType() != Mycila::PulseAnalyzer::Type::TYPE_UNKNOWN) {
+        const uint64_t spike = t + (scenario.period - scenario.width) / 2;
+        advanceTo(spike, &zc);
+        Mycila::PulseSimulator::setLevel(PIN_ZC, true);
+        advanceTo(spike + scenario.spike, &zc);
+        Mycila::PulseSimulator::setLevel(PIN_ZC, false);
+        spikes++;
+      }
+
+      t += level ? scenario.width : scenario.period - scenario.width;
+    }
+  }
+
+  const Mycila::PulseAnalyzer::Type type = pulseAnalyzer.getType();
+  const uint16_t period = pulseAnalyzer.getPeriod();
+  const uint16_t width = pulseAnalyzer.getWidth();
+  const uint32_t periodNs = pulseAnalyzer.getPeriodNs();
+  const uint32_t gridFrequency = pulseAnalyzer.getGridFrequencyMilliHz();
+  const uint32_t pllFrequency = pulseAnalyzer.getPLLFrequency();
+  const int16_t pllPhaseError = pulseAnalyzer.getPLLPhaseError();
+  const bool pllLocked = pulseAnalyzer.isPLLLocked();
+
+  // signal lost: the watchdog must put the analyzer offline
+  const auto start = std::chrono::steady_clock::now();
+  Mycila::PulseSimulator::advanceTo(t + 1000000000);
+  watchdog.add(elapsed(start));
+  const bool offline = !pulseAnalyzer.isOnline();
+
+  // signal back after the outage: the pulse is detected again from the learned profile
+  zcMeasure = false;
+  t += 1000000000;
+  const uint64_t resume = t;
+  uint64_t relockTime = 0;
+  for (uint32_t i = 0; i < BENCH_RELOCK_PERIODS; i++) {
+    for (bool level : {true, false}) {
+      Mycila::PulseSimulator::advanceTo(t + jitter(scenario.jitter));
+      Mycila::PulseSimulator::setLevel(PIN_ZC, level);
+      if (!relockTime && pulseAnalyzer.getType() != Mycila::PulseAnalyzer::Type::TYPE_UNKNOWN)
+        relockTime = (Mycila::PulseSimulator::now() - resume) / 1000;
+      t += level ? scenario.width : scenario.period - scenario.width;
+    }
+  }
+  const bool relocked = pulseAnalyzer.getType() == scenario.type;
+
+  pulseAnalyzer.end();
+
+  // the diagnostics counters must match what the benchmark has seen
+  const bool diagnostics = pulseAnalyzer.getZeroCrossCount() == zeroCrossCount && pulseAnalyzer.getOfflineCount() == 1;
+
+  // both edges of each spike must be rejected by the filter
+  const bool filtered = !filter || pulseAnalyzer.getGlitchCount() >= spikes << 1;
+
+  const bool ok = type == scenario.type && offline && relocked && zeroCrossCount > 0 && (!pll || pllLocked) && diagnostics && filtered;
+
+  // without the filter, the spikes are expected to disturb the analysis: reported, not checked
+  const bool disturbed = scenario.spike && !filter;
+
+  // grid frequency of the signal: a short pulse per semi-period, a signal cycle of 1 period, or of 2 periods for the full period pulses
+  const double signalGridFrequency = (scenario.type == Mycila::PulseAnalyzer::Type::TYPE_SHORT ? 5e11 : scenario.type == Mycila::PulseAnalyzer::Type::TYPE_FULL_PERIOD ? 2e12 : 1e12) / scenario.period;
+
+  const double zcMean = zcIntervalCount ? zcIntervalSum / zcIntervalCount : 0;
+  const double zcStdDev = zcIntervalCount ? sqrt(zcIntervalSquares / zcIntervalCount - zcMean * zcMean) : 0;
+
+  printf("%s [%s]%s%s%s\n", scenario.name, captures[static_cast<int>(capture)], pll ? " [PLL]" : "", filter ? " [FILTER]" : "", fixed ? " [FIXED]" : "");
+  printf("  result:          %s (type=%d, period=%" PRIu16 " us, width=%" PRIu16 " us, lock after %" PRIu64 " us, %" PRIu32 " ZC events)\n",
+         disturbed ? "DISTURBED" : (ok ? "OK" : "FAILED"),
+         type,
+         period,
+         width,
+         lockTime,
+         zeroCrossCount);
+  printf("  re-lock:         %s after %" PRIu64 " us\n", relocked ? "OK" : "FAILED", relockTime);
+  printf("  ZC events:       %8.3f Hz, interval stddev %7.2f us\n",
+         zcMean ? 1e9 / zcMean / 2 : 0,
+         zcStdDev / 1000);
+  printf("  measured:        %" PRIu32 " ns period, %" PRIu32 " mHz grid (error %+.0f mHz)\n", periodNs, gridFrequency, gridFrequency - signalGridFrequency);
+  if (pll)
+    printf("  PLL:             %s, %" PRIu32 " mHz, phase error %" PRId16 " us\n", pllLocked ? "locked" : "unlocked", pllFrequency, pllPhaseError);
+  if (scenario.spike)
+    printf("  spikes:          %" PRIu32 " injected\n", spikes);
+  printf("  _edgeISR:        %8.1f ns/edge, %10.0f edges/s, worst %6" PRIu64 " ns (%" PRIu64 " edges)\n",
+         static_cast<double>(edges.total) / edges.count,
+         edges.total ? 1e9 * edges.count / edges.total : 0,
+         edges.max,
+         edges.count);
+  printf("  _edgeISR locked: %8.1f ns/edge, %10.0f edges/s, worst %6" PRIu64 " ns (%" PRIu64 " edges)\n",
+         edgesLocked.count ? static_cast<double>(edgesLocked.total) / edgesLocked.count : 0,
+         edgesLocked.total ? 1e9 * edgesLocked.count / edgesLocked.total : 0,
+         edgesLocked.max,
+         edgesLocked.count);
+  printf("  _zcTimerISR:     %8.1f ns/event,                   worst %6" PRIu64 " ns (%" PRIu64 " events)\n",
+         zc.count ? static_cast<double>(zc.total) / zc.count : 0,
+         zc.max,
+         zc.count);
+  printf("  _onlineTimerISR:                                    worst %6" PRIu64 " ns\n", watchdog.max);
+  printf("  diagnostics:     %" PRIu32 " glitches, %" PRIu32 " gaps, %" PRIu32 " noise, %" PRIu32 " classification failures, %" PRIu32 " offline, %" PRIu32 " ZC events%s\n",
+         pulseAnalyzer.getGlitchCount(),
+         pulseAnalyzer.getGapCount(),
+         pulseAnalyzer.getNoiseCount(),
+         pulseAnalyzer.getClassificationFailureCount(),
+         pulseAnalyzer.getOfflineCount(),
+         pulseAnalyzer.getZeroCrossCount(),
+         diagnostics ? "" : " FAILED");
+#ifdef MYCILA_PULSE_ISR_CYCLES
+  printf("  ISR cycles (ns): edge %" PRIu32 "/%" PRIu32 "/%" PRIu32 ", ZC %" PRIu32 "/%" PRIu32 "/%" PRIu32 " (min/avg/max)\n",
+         pulseAnalyzer.getEdgeISRCycles().min,
+         pulseAnalyzer.getEdgeISRCycles().avg(),
+         pulseAnalyzer.getEdgeISRCycles().max,
+         pulseAnalyzer.getZeroCrossISRCycles().min,
+         pulseAnalyzer.getZeroCrossISRCycles().avg(),
+         pulseAnalyzer.getZeroCrossISRCycles().max);
+#endif
+
+  return ok || disturbed;
+}
+
+// same scenario with the analyzer specialized for its pulse type and grid frequency
+static bool runFixed(const Scenario& scenario, bool pll, bool filter, Mycila::PulseAnalyzer::Capture capture) {
+  switch (scenario.type) {
+    case Mycila::PulseAnalyzer::Type::TYPE_SHORT:
+      return scenario.frequency == 50 ? run<Mycila::PulseAnalyzerT<Mycila::PulseAnalyzer::Type::TYPE_SHORT, 50>>(scenario, pll, filter, capture)
+                                      : run<Mycila::PulseAnalyzerT<Mycila::PulseAnalyzer::Type::TYPE_SHORT, 60>>(scenario, pll, filter, capture);
+    case Mycila::PulseAnalyzer::Type::TYPE_SEMI_PERIOD:
+      return scenario.frequency == 50 ? run<Mycila::PulseAnalyzerT<Mycila::PulseAnalyzer::Type::TYPE_SEMI_PERIOD, 50>>(scenario, pll, filter, capture)
+                                      : run<Mycila::PulseAnalyzerT<Mycila::PulseAnalyzer::Type::TYPE_SEMI_PERIOD, 60>>(scenario, pll, filter, capture);
+    case Mycila::PulseAnalyzer::Type::TYPE_FULL_PERIOD:
+      return scenario.frequency == 50 ? run<Mycila::PulseAnalyzerT<Mycila::PulseAnalyzer::Type::TYPE_FULL_PERIOD, 50>>(scenario, pll, filter, capture)
+                                      : run<Mycila::PulseAnalyzerT<Mycila::PulseAnalyzer::Type::TYPE_FULL_PERIOD, 60>>(scenario, pll, filter, capture);
+    default:
+      return false;
+  }
+}
+
+int main() {
+  bool ok = true;
+  for (const Scenario& scenario : scenarios)
+    for (auto capture : {Mycila::PulseAnalyzer::Capture::CAPTURE_GPIO, Mycila::PulseAnalyzer::Capture::CAPTURE_ETM, Mycila::PulseAnalyzer::Capture::CAPTURE_MCPWM})
+      for (bool pll : {false, true})
+        for (bool filter : {false, true})
+          if (!filter || scenario.spike) {
+            ok &= run<Mycila::PulseAnalyzer>(scenario, pll, filter, capture);
+            if (scenario.frequency)
+              ok &= runFixed(scenario, pll, filter, capture);
+          }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,212 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Host benchmark of the grid analytics, fed with generated edges.
+ *
+ * Run with: PLATFORMIO_SRC_DIR=examples/BenchmarkAnalytics pio run -e native && .pio/build/native/program
+ *
+ * For each pulse type, the edges of a grid are generated like the analyzer records them (timestamps and intervals in us, with jitter):
+ * a steady frequency, then a linear frequency ramp, then a steady frequency again, with a gap in the middle of the first part
+ * and one lost signal cycle later in it (the edges still alternate, with no gap).
+ * The positive half-cycles are longer than the negative ones (DC offset).
+ * The frequencies, the RoCoF, the histogram and the asymmetry are checked against the generated signal, and the cost per edge is measured.
+ */
+#include <MycilaPulseGridAnalytics.h>
+
+#include <chrono>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// grid frequency profile, in mHz and ms
+#define BENCH_FREQUENCY_START 50010
+#define BENCH_ROCOF           -50 // mHz/s
+#define BENCH_STEADY_MS       5000
+#define BENCH_RAMP_MS         3000
+
+// positive half-cycle longer than the negative one, in ns
+#define BENCH_ASYMMETRY 20000
+
+// random jitter applied to each edge, in ns (+/-)
+#define BENCH_JITTER 5000
+
+// short pulse width, in ns
+#define BENCH_SHORT_WIDTH 450000
+
+// accepted errors
+#define BENCH_FREQUENCY_TOLERANCE 5    // mHz
+#define BENCH_ROCOF_TOLERANCE     15   // mHz/s
+#define BENCH_ASYMMETRY_TOLERANCE 1000 // ns
+
+typedef struct {
+    const char* name;
+    Mycila::PulseAnalyzer::Type type;
+} Scenario;
+
+static const Scenario scenarios[] = {
+  {"TYPE_SHORT (Robodyn)", Mycila::PulseAnalyzer::Type::TYPE_SHORT},
+  {"TYPE_SEMI_PERIOD (BM1Z102FJ)", Mycila::PulseAnalyzer::Type::TYPE_SEMI_PERIOD},
+  {"TYPE_FULL_PERIOD (JSY-MK-194G)", Mycila::PulseAnalyzer::Type::TYPE_FULL_PERIOD},
+};
+
+// deterministic pseudo-random jitter
+static uint32_t seed = 1;
+static int64_t jitter(uint32_t amplitude) {
+  seed = seed * 1664525 + 1013904223;
+  return static_cast<int64_t>(seed % (2 * amplitude + 1)) - amplitude;
+}
+
+static inline uint64_t elapsed(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// grid frequency in mHz at t ns
+static double frequencyAt(double t) {
+  const double ms = t / 1e6;
+  if (ms < BENCH_STEADY_MS)
+    return BENCH_FREQUENCY_START;
+  if (ms < BENCH_STEADY_MS + BENCH_RAMP_MS)
+    return BENCH_FREQUENCY_START + BENCH_ROCOF * (ms - BENCH_STEADY_MS) / 1000;
+  return BENCH_FREQUENCY_START + BENCH_ROCOF * BENCH_RAMP_MS / 1000.0;
+}
+
+typedef struct {
+    Mycila::PulseGridAnalytics* analytics;
+    Mycila::PulseAnalyzer::Type type;
+    uint32_t lastTimestamp;
+    uint64_t edges;
+    uint64_t time;
+    // edges not recorded (lost signal cycle)
+    uint32_t skip;
+} Feed;
+
+// edge at t ns, recorded like the analyzer does
+static void edge(Feed* feed, double t, Mycila::PulseAnalyzer::Event event, bool gap = false) {
+  const uint32_t timestamp = static_cast<uint64_t>(t + jitter(BENCH_JITTER)) / 1000;
+  if (feed->skip) {
+    feed->skip--;
+    return;
+  }
+  Mycila::PulseAnalyzer::Edge e;
+  e.timestamp = timestamp;
+  e.diff = gap || timestamp - feed->lastTimestamp > UINT16_MAX ? UINT16_MAX : timestamp - feed->lastTimestamp;
+  e.event = event;
+  feed->lastTimestamp = timestamp;
+
+  const auto start = std::chrono::steady_clock::now();
+  feed->analytics->add(e, feed->type);
+  feed->time += elapsed(start);
+  feed->edges++;
+}
+
+static bool run(const Scenario& scenario) {
+  Mycila::PulseGridAnalytics analytics;
+  Feed feed = {&analytics, scenario.type, 0, 0, 0, 0};
+
+  const double end = (2 * BENCH_STEADY_MS + BENCH_RAMP_MS) * 1e6;
+  const double gapAt = BENCH_STEADY_MS / 2 * 1e6;
+  const double lossAt = BENCH_STEADY_MS * 3 / 4 * 1e6;
+  bool gapped = false;
+  bool lost = false;
+  bool positive = true;
+  double t = 1e9;
+
+  // edges of each half-cycle from a zero-crossing at t
+  while (t < end + 1e9) {
+    const double semiPeriod = 5e11 / frequencyAt(t - 1e9);
+    const double half = semiPeriod + (positive ? BENCH_ASYMMETRY / 2 : -BENCH_ASYMMETRY / 2);
+
+    // signal lost for 100 ms
+    if (!gapped && t - 1e9 > gapAt) {
+      gapped = true;
+      t += 100e6;
+      edge(&feed, t, Mycila::PulseAnalyzer::Event::SIGNAL_RISING, true);
+      positive = false;
+      t += semiPeriod;
+      continue;
+    }
+
+    // one signal cycle lost: its 2 edges (a semi-period for short pulses, 1 period, or 2 periods for full period pulses)
+    if (!lost && t - 1e9 > lossAt) {
+      lost = true;
+      feed.skip = 2;
+    }
+
+    switch (scenario.type) {
+      case Mycila::PulseAnalyzer::Type::TYPE_SHORT:
+        // pulse centered on the zero-crossing
+        edge(&feed, t - BENCH_SHORT_WIDTH / 2, Mycila::PulseAnalyzer::Event::SIGNAL_RISING);
+        edge(&feed, t + BENCH_SHORT_WIDTH / 2, Mycila::PulseAnalyzer::Event::SIGNAL_FALLING);
+        break;
+      case Mycila::PulseAnalyzer::Type::TYPE_SEMI_PERIOD:
+        // high during the positive half-cycle
+        edge(&feed, t, positive ? Mycila::PulseAnalyzer::Event::SIGNAL_RISING : Mycila::PulseAnalyzer::Event::SIGNAL_FALLING);
+        break;
+      case Mycila::PulseAnalyzer::Type::TYPE_FULL_PERIOD:
+        // high for one period, low for the next one
+        if (positive)
+          edge(&feed, t, (static_cast<uint64_t>(feed.edges) & 1) ? Mycila::PulseAnalyzer::Event::SIGNAL_FALLING : Mycila::PulseAnalyzer::Event::SIGNAL_RISING);
+        break;
+      default:
+        break;
+    }
+
+    t += half;
+    positive = !positive;
+  }
+
+  const double expectedFrequency = frequencyAt(end);
+  const uint32_t frequency = analytics.getFrequency();
+  const int32_t asymmetry = analytics.getAsymmetry();
+  const int32_t expectedAsymmetry = scenario.type == Mycila::PulseAnalyzer::Type::TYPE_FULL_PERIOD ? 0 : BENCH_ASYMMETRY;
+
+  bool ok = fabs(frequency - expectedFrequency) <= BENCH_FREQUENCY_TOLERANCE;
+  ok &= abs(asymmetry - expectedAsymmetry) <= BENCH_ASYMMETRY_TOLERANCE;
+  ok &= analytics.getRestartCount() == 2;
+
+  printf("%s\n", scenario.name);
+  printf("  frequency:  %" PRIu32 " mHz (expected %.0f mHz)\n", frequency, expectedFrequency);
+  for (size_t i = 0; i < MYCILA_PULSE_ANALYTICS_WINDOWS; i++) {
+    const Mycila::PulseGridAnalytics::Window& window = analytics.getWindow(i);
+    // the largest RoCoF is the one of the ramp, seen when 2 consecutive windows are in it
+    const bool inRamp = 2 * window.length <= BENCH_RAMP_MS;
+    const bool good = window.rocofMax <= abs(BENCH_ROCOF) + BENCH_ROCOF_TOLERANCE && (!inRamp || window.rocofMax + BENCH_ROCOF_TOLERANCE >= abs(BENCH_ROCOF));
+    ok &= good;
+    printf("  window %4" PRIu16 " ms: %" PRIu32 " mHz, RoCoF %+" PRId32 " mHz/s, max %" PRIu32 " mHz/s (ramp %+d mHz/s)%s\n",
+           window.length,
+           window.frequency,
+           window.rocof,
+           window.rocofMax,
+           BENCH_ROCOF,
+           good ? "" : " FAILED");
+  }
+
+  // the steady parts are in their buckets
+  const uint32_t* histogram = analytics.getHistogram();
+  const int32_t half = (MYCILA_PULSE_ANALYTICS_HISTOGRAM_BUCKETS / 2) * MYCILA_PULSE_ANALYTICS_HISTOGRAM_STEP_MHZ;
+  const size_t startBucket = (BENCH_FREQUENCY_START - 50000 + half) / MYCILA_PULSE_ANALYTICS_HISTOGRAM_STEP_MHZ;
+  const size_t endBucket = (static_cast<int32_t>(expectedFrequency) - 50000 + half) / MYCILA_PULSE_ANALYTICS_HISTOGRAM_STEP_MHZ;
+  const uint32_t steadyWindows = BENCH_STEADY_MS / analytics.getWindow(0).length;
+  const bool histogramOk = histogram[startBucket] + 3 >= steadyWindows && histogram[endBucket] + 2 >= steadyWindows;
+  ok &= histogramOk;
+  printf("  histogram:  ");
+  for (size_t i = 0; i < MYCILA_PULSE_ANALYTICS_HISTOGRAM_BUCKETS; i++)
+    printf("%" PRIu32 " ", histogram[i]);
+  printf("(%+d mHz steps from %+d mHz)%s\n", MYCILA_PULSE_ANALYTICS_HISTOGRAM_STEP_MHZ, -half, histogramOk ? "" : " FAILED");
+
+  printf("  asymmetry:  %" PRId32 " ns (expected %" PRId32 " ns), DC offset %" PRId32 " ppm of the peak voltage\n", asymmetry, expectedAsymmetry, analytics.getDCOffset());
+  printf("  restarts:   %" PRIu32 "\n", analytics.getRestartCount());
+  printf("  add():      %.1f ns/edge (%" PRIu64 " edges)\n", static_cast<double>(feed.time) / feed.edges, feed.edges);
+  printf("  result:     %s\n", ok ? "OK" : "FAILED");
+
+  return ok;
+}
+
+int main() {
+  bool ok = true;
+  for (const Scenario& scenario : scenarios)
+    ok &= run(scenario);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
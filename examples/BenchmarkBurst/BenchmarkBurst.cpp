@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Host benchmark of the burst fire scheduler, driven by the simulated backend.
+ *
+ * Run with: PLATFORMIO_SRC_DIR=examples/BenchmarkBurst pio run -e native && .pio/build/native/program
+ *
+ * An analyzer and a burst fire scheduler with 4 outputs share a single timer, on a BM1Z102FJ signal (high during the
+ * positive half-cycles). The powers are changed from the "task" (main loop) while the grid runs, and the outputs are
+ * sampled at each real zero-crossing to check, for each power step and output:
+ * - the conducted half-cycles against the power,
+ * - the DC component: positive minus negative half-cycles conducted, which must stay within -1 and 1,
+ * - the flicker: longest run of skipped half-cycles, against the evenly spread one,
+ * and that the outputs are turned off when the ZC events stop.
+ */
+#include <MycilaPulseAnalyzer.h>
+#include <MycilaPulseBurstFire.h>
+
+#include <chrono>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PIN_ZC 35
+
+#define CHANNELS 4
+
+// number of grid periods of each power step
+#define BENCH_STEP_PERIODS 500
+
+// number of grid periods before the first step, while the analyzer locks
+#define BENCH_WARMUP_PERIODS 50
+
+// GPIO interrupt latency, in ns
+#define BENCH_LATENCY 3000
+
+// BM1Z102FJ 50 Hz: edges at the real zero-crossings
+#define SIGNAL_PERIOD 20000000
+#define SIGNAL_WIDTH  10000000
+
+static const int8_t outputs[CHANNELS] = {16, 17, 18, 19};
+
+// powers of the outputs at each step, with ties between outputs
+static const uint16_t powers[][CHANNELS] = {
+  {0, 65535, 32768, 32768},
+  {21845, 43690, 6554, 6554},
+  {655, 64880, 13107, 13107},
+  {49152, 16384, 58982, 58982},
+  {32767, 32769, 1, 65534},
+};
+
+static constexpr size_t STEPS = sizeof(powers) / sizeof(powers[0]);
+
+static Mycila::PulseBurstFire burst;
+
+static uint32_t zeroCrossCount = 0;
+static uint64_t zeroCrossTime = 0;
+
+static inline uint64_t elapsed(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void onZeroCross(int16_t delay, void* arg) {
+  zeroCrossCount++;
+  const auto start = std::chrono::steady_clock::now();
+  Mycila::PulseBurstFire::onZeroCross(delay, arg);
+  zeroCrossTime += elapsed(start);
+}
+
+typedef struct {
+    uint32_t halfCycles;
+    uint32_t conducted;
+    // extremes of the DC component during the step
+    int32_t dcMin;
+    int32_t dcMax;
+    // current and longest run of skipped half-cycles
+    uint32_t skipped;
+    uint32_t maxSkipped;
+} Output;
+
+int main() {
+  Mycila::PulseTimebase timebase;
+  Mycila::PulseAnalyzer analyzer;
+
+  Mycila::PulseSimulator::reset();
+  Mycila::PulseSimulator::setInterruptLatency(BENCH_LATENCY);
+
+  for (size_t i = 0; i < CHANNELS; i++)
+    burst.attach(outputs[i]);
+
+  analyzer.setTimebase(&timebase);
+  analyzer.onZeroCross(onZeroCross, &burst);
+  analyzer.begin(PIN_ZC);
+  burst.begin(&timebase);
+
+  const size_t timers = Mycila::PulseSimulator::getTimerCount();
+
+  uint64_t next = 1000000;
+  bool level = false;
+  for (uint32_t h = 0; h < 2 * BENCH_WARMUP_PERIODS; h++) {
+    Mycila::PulseSimulator::advanceTo(next);
+    level = !level;
+    Mycila::PulseSimulator::setLevel(PIN_ZC, level);
+    next += level ? SIGNAL_WIDTH : SIGNAL_PERIOD - SIGNAL_WIDTH;
+  }
+
+  // positive minus negative half-cycles conducted by each output, over the whole run
+  int32_t dc[CHANNELS] = {};
+  uint32_t errors = 0;
+  uint32_t together = 0;
+  uint32_t tied = 0;
+
+  for (size_t step = 0; step < STEPS; step++) {
+    for (size_t i = 0; i < CHANNELS; i++)
+      burst.setPower(i, powers[step][i]);
+
+    Output stats[CHANNELS] = {};
+    for (size_t i = 0; i < CHANNELS; i++)
+      stats[i].dcMin = stats[i].dcMax = dc[i];
+
+    for (uint32_t h = 0; h < 2 * BENCH_STEP_PERIODS; h++) {
+      Mycila::PulseSimulator::advanceTo(next);
+      level = !level;
+
+      // half-cycle starting now: the SSRs conduct if their input is on at the zero-crossing
+      for (size_t i = 0; i < CHANNELS; i++) {
+        Output* o = &stats[i];
+        const bool on = Mycila::PulseSimulator::getLevel(outputs[i]);
+        if (on)
+          dc[i] += level ? 1 : -1;
+        if (dc[i] < o->dcMin)
+          o->dcMin = dc[i];
+        if (dc[i] > o->dcMax)
+          o->dcMax = dc[i];
+
+        // the first half-cycle of the step was decided with the previous powers
+        if (!h)
+          continue;
+        o->halfCycles++;
+        if (on) {
+          o->conducted++;
+          o->skipped = 0;
+        } else if (++o->skipped > o->maxSkipped) {
+          o->maxSkipped = o->skipped;
+        }
+      }
+
+      // outputs 3 and 4 with the same power, at most half of the half-cycles: they should not switch on together
+      if (h && powers[step][2] == powers[step][3] && powers[step][2] <= Mycila::PulseBurstFire::POWER_MAX / 2) {
+        const bool on3 = Mycila::PulseSimulator::getLevel(outputs[2]);
+        const bool on4 = Mycila::PulseSimulator::getLevel(outputs[3]);
+        if (on3 || on4)
+          tied++;
+        if (on3 && on4)
+          together++;
+      }
+
+      Mycila::PulseSimulator::setLevel(PIN_ZC, level);
+      next += level ? SIGNAL_WIDTH : SIGNAL_PERIOD - SIGNAL_WIDTH;
+    }
+
+    printf("Step %zu\n", step + 1);
+    for (size_t i = 0; i < CHANNELS; i++) {
+      const Output& o = stats[i];
+      const uint16_t power = powers[step][i];
+      const double expected = static_cast<double>(power) * o.halfCycles / Mycila::PulseBurstFire::POWER_MAX;
+      // evenly spread: the skipped half-cycles between 2 conducted ones, plus one postponed for the polarity balance
+      const uint32_t spread = power ? (Mycila::PulseBurstFire::POWER_MAX + power - 1) / power : o.halfCycles;
+      const bool good = o.conducted >= expected - 2 && o.conducted <= expected + 2 &&
+                        o.dcMin >= -1 && o.dcMax <= 1 &&
+                        o.maxSkipped <= spread + 1;
+      if (!good)
+        errors++;
+      printf("  L%zu: power %5" PRIu16 ", %4" PRIu32 "/%4" PRIu32 " half-cycles (expected %7.1f), DC %+" PRId32 "..%+" PRId32 ", longest skip %3" PRIu32 " (spread %3" PRIu32 ")%s\n",
+             i + 1,
+             power,
+             o.conducted,
+             o.halfCycles,
+             expected,
+             o.dcMin,
+             o.dcMax,
+             o.maxSkipped,
+             spread,
+             good ? "" : " FAILED");
+    }
+  }
+
+  // grid lost: the outputs must be turned off once the analyzer is offline (400 ms) and its ZC events stop
+  Mycila::PulseSimulator::advanceTo(next + 1000000000);
+  for (size_t i = 0; i < CHANNELS; i++) {
+    if (Mycila::PulseSimulator::getLevel(outputs[i])) {
+      printf("  L%zu: still on after the grid loss\n", i + 1);
+      errors++;
+    }
+  }
+
+  printf("%zu outputs on %zu timer(s): %" PRIu32 " ZC events, %7.1f ns/ZC event (burst fire), L3 and L4 on together in %" PRIu32 " of %" PRIu32 " half-cycles, %" PRIu32 " error(s)\n",
+         burst.getChannelCount(),
+         timers,
+         zeroCrossCount,
+         zeroCrossCount ? static_cast<double>(zeroCrossTime) / zeroCrossCount : 0,
+         together,
+         tied,
+         errors);
+
+  burst.end();
+  analyzer.end();
+  timebase.end();
+
+  const bool ok = errors == 0 && zeroCrossCount > 0;
+  if (!ok)
+    printf("FAILED\n");
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
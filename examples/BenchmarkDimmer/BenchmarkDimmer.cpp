@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Host benchmark of the dimmer scheduler, driven by the simulated backend.
+ *
+ * Run with: PLATFORMIO_SRC_DIR=examples/BenchmarkDimmer pio run -e native && .pio/build/native/program
+ *
+ * An analyzer and a dimmer with 4 outputs share a single timer.
+ * The firing delays are changed from the "task" (main loop) while the grid runs, and each output is checked
+ * against the simulated clock: fired at the right time after the real zero-crossing, off or in full conduction when asked,
+ * and turned off when the ZC events stop.
+ *
+ * The power tables are also checked against a float inversion of the power curve, and both are timed.
+ */
+#include <MycilaPulseAnalyzer.h>
+#include <MycilaPulseDimmer.h>
+#include <MycilaPulsePower.h>
+
+#include <chrono>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PIN_ZC 35
+
+#define CHANNELS 4
+
+// number of grid periods to simulate
+#define BENCH_PERIODS 10000
+
+// number of grid periods between the changes of the firing delays
+#define BENCH_UPDATE_PERIODS 25
+
+// GPIO interrupt latency, in ns
+#define BENCH_LATENCY 3000
+
+// accepted error on the firing time, in ns
+#define BENCH_FIRING_TOLERANCE 2000
+
+// accepted error of the power delivered with the power table, in % of the full power
+#define BENCH_POWER_TOLERANCE 0.1
+
+// BM1Z102FJ 50 Hz: edges at the real zero-crossings
+#define SIGNAL_PERIOD 20000000
+#define SIGNAL_WIDTH  10000000
+
+static const int8_t outputs[CHANNELS] = {16, 17, 18, 19};
+
+static Mycila::PulseDimmer dimmer;
+
+// real zero-crossing of the ongoing semi-period, as seen by the dimmer (ns)
+static uint64_t zeroCross = 0;
+
+static uint32_t zeroCrossCount = 0;
+static uint32_t firings = 0;
+static uint32_t errors = 0;
+static uint64_t zeroCrossTime = 0;
+
+static inline uint64_t elapsed(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// check the outputs of the ending semi-period, then forward the ZC event to the dimmer
+static void onZeroCross(int16_t delay, void* arg) {
+  if (zeroCross) {
+    for (size_t i = 0; i < CHANNELS; i++) {
+      const uint16_t firing = dimmer.getFiringDelay(i);
+      const bool level = Mycila::PulseSimulator::getLevel(outputs[i]);
+      if (firing == Mycila::PulseDimmer::DELAY_OFF) {
+        if (level) {
+          printf("  L%zu: fired while off\n", i + 1);
+          errors++;
+        }
+      } else if (!level) {
+        printf("  L%zu: not fired (delay %" PRIu16 " us)\n", i + 1, firing);
+        errors++;
+      } else if (firing) {
+        const int64_t error = static_cast<int64_t>(Mycila::PulseSimulator::getLastChange(outputs[i]) - (zeroCross + firing * 1000ULL));
+        if (error > BENCH_FIRING_TOLERANCE || error < -BENCH_FIRING_TOLERANCE) {
+          printf("  L%zu: fired %+" PRId64 " ns late (delay %" PRIu16 " us)\n", i + 1, error, firing);
+          errors++;
+        }
+        firings++;
+      }
+    }
+  }
+
+  zeroCross = Mycila::PulseSimulator::now() + delay * 1000LL;
+  zeroCrossCount++;
+
+  const auto start = std::chrono::steady_clock::now();
+  Mycila::PulseDimmer::onZeroCross(delay, arg);
+  zeroCrossTime += elapsed(start);
+}
+
+// new firing delays from the task context: every kind of command, with ties between outputs
+static void update(uint32_t step) {
+  static const uint16_t delays[] = {0, 50, 2500, 5000, 7500, 9950, Mycila::PulseDimmer::DELAY_OFF};
+  static const uint16_t duties[] = {0, 16384, 32768, 49152, Mycila::PulseDimmer::DUTY_MAX};
+  dimmer.setFiringDelay(0, delays[step % 7]);
+  dimmer.setDutyCycle(1, duties[step % 5]);
+  dimmer.setFiringDelay(2, delays[(step + 3) % 7]);
+  dimmer.setFiringDelay(3, delays[(step + 3) % 7]);
+}
+
+// fraction of the full power delivered with a firing delay
+static double deliveredPower(uint16_t semiPeriod, uint16_t delay) {
+  const double a = M_PI * delay / semiPeriod;
+  return 1 - a / M_PI + sin(2 * a) / (2 * M_PI);
+}
+
+// firing delay of a power fraction, in float: what the power table replaces
+static uint16_t firingDelay(uint16_t semiPeriod, double p) {
+  double lo = 0, hi = M_PI;
+  for (int i = 0; i < 40; i++) {
+    const double mid = (lo + hi) / 2;
+    if (1 - mid / M_PI + sin(2 * mid) / (2 * M_PI) > p)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return lround((lo + hi) / 2 / M_PI * semiPeriod);
+}
+
+static bool checkPowerTables() {
+  static const uint16_t semiPeriods[] = {10000, 8333};
+  bool ok = true;
+  for (uint16_t semiPeriod : semiPeriods) {
+    double maxError = 0;
+    uint64_t lutTime = 0, floatTime = 0;
+    uint32_t lookups = 0;
+    volatile uint32_t sink = 0;
+
+    for (uint32_t power = 1; power < Mycila::PulsePower::POWER_MAX; power += 7) {
+      auto start = std::chrono::steady_clock::now();
+      const uint16_t delay = Mycila::PulsePower::getFiringDelay(semiPeriod, power);
+      lutTime += elapsed(start);
+
+      start = std::chrono::steady_clock::now();
+      const uint16_t expected = firingDelay(semiPeriod, power / 65535.0);
+      floatTime += elapsed(start);
+
+      sink = sink + delay + expected;
+      lookups++;
+
+      // the table is checked on the delivered power: near the zero-crossings, the delay changes a lot for a small power change
+      const double error = fabs(deliveredPower(semiPeriod, delay) - power / 65535.0) * 100;
+      if (error > maxError)
+        maxError = error;
+    }
+
+    // the compensated delays stay in the range where the thyristor can be fired
+    const uint16_t first = Mycila::PulsePower::getFiringDelay(semiPeriod, 1, true);
+    const uint16_t last = Mycila::PulsePower::getFiringDelay(semiPeriod, Mycila::PulsePower::POWER_MAX - 1, true);
+    const bool good = maxError <= BENCH_POWER_TOLERANCE &&
+                      first <= semiPeriod - MYCILA_PULSE_DIMMER_MIN_DELAY_US &&
+                      last >= MYCILA_PULSE_DIMMER_MIN_DELAY_US &&
+                      Mycila::PulsePower::getFiringDelay(semiPeriod, 0) == semiPeriod &&
+                      Mycila::PulsePower::getFiringDelay(semiPeriod, Mycila::PulsePower::POWER_MAX) == 0;
+    ok &= good;
+
+    printf("Power table %" PRIu16 " us: max error %.3f%%, compensated range %" PRIu16 "-%" PRIu16 " us, %5.1f ns/lookup (float: %7.1f ns)%s\n",
+           semiPeriod,
+           maxError,
+           last,
+           first,
+           static_cast<double>(lutTime) / lookups,
+           static_cast<double>(floatTime) / lookups,
+           good ? "" : " FAILED");
+  }
+  return ok;
+}
+
+int main() {
+  Mycila::PulseTimebase timebase;
+  Mycila::PulseAnalyzer analyzer;
+
+  Mycila::PulseSimulator::reset();
+  // GPIO interrupt latency, compensated by the analyzer
+  Mycila::PulseSimulator::setInterruptLatency(BENCH_LATENCY);
+
+  for (size_t i = 0; i < CHANNELS; i++)
+    dimmer.attach(outputs[i]);
+
+  analyzer.setTimebase(&timebase);
+  analyzer.onZeroCross(onZeroCross, &dimmer);
+  analyzer.begin(PIN_ZC);
+  dimmer.begin(&timebase);
+
+  const size_t timers = Mycila::PulseSimulator::getTimerCount();
+
+  uint64_t next = 1000000;
+  bool level = false;
+  uint64_t alarmsTime = 0;
+  uint32_t step = 0;
+  const uint64_t end = next + static_cast<uint64_t>(SIGNAL_PERIOD) * BENCH_PERIODS;
+
+  while (next <= end) {
+    if (next % (static_cast<uint64_t>(SIGNAL_PERIOD) * BENCH_UPDATE_PERIODS) < SIGNAL_PERIOD && !level)
+      update(step++);
+
+    const auto start = std::chrono::steady_clock::now();
+    Mycila::PulseSimulator::advanceTo(next);
+    alarmsTime += elapsed(start);
+
+    level = !level;
+    Mycila::PulseSimulator::setLevel(PIN_ZC, level);
+    next += level ? SIGNAL_WIDTH : SIGNAL_PERIOD - SIGNAL_WIDTH;
+  }
+
+  // grid lost: the outputs must be turned off
+  Mycila::PulseSimulator::advanceTo(next + 50000000);
+  for (size_t i = 0; i < CHANNELS; i++) {
+    if (Mycila::PulseSimulator::getLevel(outputs[i])) {
+      printf("  L%zu: still on after the grid loss\n", i + 1);
+      errors++;
+    }
+  }
+
+  printf("%zu outputs on %zu timer(s): %" PRIu32 " ZC events, %" PRIu32 " firings checked, %7.1f ns/ZC event (dimmer), ISR load %6.1f us/s, %" PRIu32 " error(s)\n",
+         dimmer.getChannelCount(),
+         timers,
+         zeroCrossCount,
+         firings,
+         zeroCrossCount ? static_cast<double>(zeroCrossTime) / zeroCrossCount : 0,
+         alarmsTime / 1000.0 / (end / 1e9),
+         errors);
+
+  dimmer.end();
+  analyzer.end();
+  timebase.end();
+
+  const bool ok = errors == 0 && firings > 0 && checkPowerTables();
+  if (!ok)
+    printf("FAILED\n");
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
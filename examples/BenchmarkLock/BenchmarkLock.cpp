@@ -0,0 +1,379 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Host benchmark of the lock time and of the ZC event accuracy over randomized signals, driven by the simulated backend.
+ *
+ * Run with: PLATFORMIO_SRC_DIR=examples/BenchmarkLock pio run -e native && .pio/build/native/program [seed]
+ *
+ * A generator produces the signal of each ZC module type (Robodyn, BM1Z102FJ, JSY-MK-194G) from a simulated grid:
+ * - grid frequency drifting linearly from a random start around 50 or 60 Hz,
+ * - random jitter on each edge, random interrupt latency of the edges and of the ZC timer,
+ * - slow slope bounces: short toggles just before or after some edges, like a comparator on a noisy slow slope,
+ * - dropouts: the signal disappears for a while, then comes back.
+ * BENCH_SCENARIOS random scenarios per pulse type are run with each analyzer mode (default, PLL, adaptive filter, both),
+ * with and without the latency compensation,
+ * and the following numbers are reported:
+ * - lock time percentiles: from the first edge to the detection of the right pulse type,
+ * - ZC event phase error distribution: ZC event time plus its delay, compared to the nearest real zero-crossing of the grid,
+ * - false resets: losses of the detection which were not caused by a dropout, per hour of locked signal.
+ * Changes to the edge ISR, to the filters or to the default shifts can be judged on these numbers.
+ *
+ * The scenarios depend only on the seed (1 by default). The exit code is not 0 if less than BENCH_MIN_LOCK_RATE of the
+ * scenarios lock on the right type, or if the median ZC error is larger than BENCH_MAX_MEDIAN_ERROR_US.
+ */
+#include <MycilaPulseAnalyzer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#define PIN_ZC 35
+
+// random scenarios per pulse type and analyzer mode
+#define BENCH_SCENARIOS 1000
+
+// signal duration of a scenario, in ns
+#define BENCH_DURATION 3000000000ULL
+
+// randomized signal parameters: maximums
+#define BENCH_FREQUENCY_OFFSET 500          // mHz around the nominal frequency
+#define BENCH_DRIFT            200          // mHz/s
+#define BENCH_JITTER           50000        // ns (+/-)
+#define BENCH_BOUNCE_RATE      30           // % of the edges
+#define BENCH_BOUNCE_WIDTH     40000        // ns
+#define BENCH_DROPOUT_RATE     30           // % of the scenarios
+#define BENCH_DROPOUT_MAX      800000000ULL // ns
+#define BENCH_LATENCY_MIN      2000         // ns
+#define BENCH_LATENCY_MAX      5000         // ns
+#define BENCH_TIMER_LATENCY    8000         // ns, ZC timer: from 1/2 to 1 of a random maximum per scenario
+
+// JSY-MK-194G: delay of the signal after the zero-crossing, in ns (see MYCILA_JSY_194_SIGNAL_SHIFT_US)
+#define BENCH_JSY_DELAY (-MYCILA_JSY_194_SIGNAL_SHIFT_US * 1000)
+
+// the detection is expected to be back within this time after a dropout, in ns
+#define BENCH_DROPOUT_MARGIN 500000000ULL
+
+// ZC error histogram: buckets of BENCH_HISTOGRAM_STEP_US from -BENCH_HISTOGRAM_HALF to +BENCH_HISTOGRAM_HALF buckets
+#define BENCH_HISTOGRAM_STEP_US 20
+#define BENCH_HISTOGRAM_HALF    5
+
+// pass criteria
+#define BENCH_MIN_LOCK_RATE       0.99
+#define BENCH_MAX_MEDIAN_ERROR_US 100
+
+typedef struct {
+    const char* name;
+    Mycila::PulseAnalyzer::Type type;
+} Module;
+
+static const Module modules[] = {
+  {"TYPE_SHORT (Robodyn, ZCD)", Mycila::PulseAnalyzer::Type::TYPE_SHORT},
+  {"TYPE_SEMI_PERIOD (BM1Z102FJ)", Mycila::PulseAnalyzer::Type::TYPE_SEMI_PERIOD},
+  {"TYPE_FULL_PERIOD (JSY-MK-194G)", Mycila::PulseAnalyzer::Type::TYPE_FULL_PERIOD},
+};
+
+// deterministic pseudo-random numbers (xorshift64*), the same on all the platforms
+static uint64_t state = 1;
+static uint64_t random(uint64_t max) {
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return (state * 2685821657736338717ULL >> 11) % (max + 1);
+}
+static int64_t random(int64_t min, int64_t max) { return min + static_cast<int64_t>(random(static_cast<uint64_t>(max - min))); }
+
+///////////////////////////////////////////////////////////////////////////
+// Signal generator
+///////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+    uint64_t time;
+    bool level;
+} Edge;
+
+typedef struct {
+    // grid frequency at the start in mHz, and its drift in mHz/s
+    int64_t frequency;
+    int64_t drift;
+    // pulse width of TYPE_SHORT in ns
+    int64_t width;
+    int64_t jitter;
+    // % of the edges with a bounce
+    int64_t bounceRate;
+    // dropout start and duration in ns (0: none)
+    uint64_t dropout;
+    uint64_t dropoutLength;
+    // maximum latency of the ZC timer ISR in ns
+    int64_t timerLatency;
+} Signal;
+
+// Edges of the ZC module and real zero-crossings of the grid, in time order.
+// The grid starts with a positive half-cycle at 1 ms.
+static void generate(Mycila::PulseAnalyzer::Type type, const Signal& signal, std::vector<Edge>* edges, std::vector<uint64_t>* crossings) {
+  edges->clear();
+  crossings->clear();
+
+  auto add = [&](int64_t t, bool level) {
+    t += random(-signal.jitter, signal.jitter);
+    if (signal.dropoutLength && static_cast<uint64_t>(t) >= signal.dropout && static_cast<uint64_t>(t) < signal.dropout + signal.dropoutLength)
+      return;
+    // bounce: the level toggles back and forth just before or just after the edge
+    if (static_cast<int64_t>(random(99)) < signal.bounceRate) {
+      const int64_t a = random(5000, BENCH_BOUNCE_WIDTH);
+      const int64_t b = random(5000, BENCH_BOUNCE_WIDTH);
+      if (random(1)) {
+        edges->push_back({static_cast<uint64_t>(t), level});
+        edges->push_back({static_cast<uint64_t>(t + a), !level});
+        edges->push_back({static_cast<uint64_t>(t + a + b), level});
+      } else {
+        edges->push_back({static_cast<uint64_t>(t - a - b), level});
+        edges->push_back({static_cast<uint64_t>(t - b), !level});
+        edges->push_back({static_cast<uint64_t>(t), level});
+      }
+      return;
+    }
+    edges->push_back({static_cast<uint64_t>(t), level});
+  };
+
+  double t = 1000000;
+  bool positive = true;
+  bool high = false;
+  while (t < BENCH_DURATION) {
+    const uint64_t zc = static_cast<uint64_t>(t);
+    crossings->push_back(zc);
+
+    switch (type) {
+      case Mycila::PulseAnalyzer::Type::TYPE_SHORT:
+        // pulse centered on each zero-crossing
+        add(zc - signal.width / 2, true);
+        add(zc + signal.width / 2, false);
+        break;
+      case Mycila::PulseAnalyzer::Type::TYPE_SEMI_PERIOD:
+        // high during the positive half-cycles
+        add(zc, positive);
+        break;
+      case Mycila::PulseAnalyzer::Type::TYPE_FULL_PERIOD:
+        // level toggled after each positive zero-crossing
+        if (positive) {
+          high = !high;
+          add(zc + BENCH_JSY_DELAY, high);
+        }
+        break;
+      default:
+        break;
+    }
+
+    const double frequency = signal.frequency + signal.drift * (t / 1e9);
+    t += 5e11 / frequency;
+    positive = !positive;
+  }
+
+  std::stable_sort(edges->begin(), edges->end(), [](const Edge& a, const Edge& b) { return a.time < b.time; });
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Benchmark
+///////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+    uint32_t scenarios = 0;
+    uint32_t locked = 0;
+    uint32_t wrongType = 0;
+    uint32_t dropouts = 0;
+    uint32_t falseResets = 0;
+    // locked signal duration, in ns
+    uint64_t lockedTime = 0;
+    // lock times in us
+    std::vector<uint32_t> lockTimes;
+    // ZC phase errors in ns
+    std::vector<int32_t> errors;
+    uint64_t edges = 0;
+    uint64_t time = 0;
+} Stats;
+
+// ZC events of the current scenario
+static const std::vector<uint64_t>* crossings;
+static size_t crossing = 0;
+static bool measure = false;
+static std::vector<int32_t>* errors;
+
+static void onZeroCross(int16_t delay, void* arg) {
+  if (!measure)
+    return;
+  // real zero-crossing estimated by the analyzer, compared to the nearest one of the grid
+  const int64_t estimated = static_cast<int64_t>(Mycila::PulseSimulator::now()) + delay * 1000;
+  while (crossing + 1 < crossings->size() && static_cast<int64_t>((*crossings)[crossing + 1]) <= estimated)
+    crossing++;
+  int64_t error = estimated - static_cast<int64_t>((*crossings)[crossing]);
+  if (crossing + 1 < crossings->size()) {
+    const int64_t next = estimated - static_cast<int64_t>((*crossings)[crossing + 1]);
+    if (-next < error)
+      error = next;
+  }
+  errors->push_back(error);
+}
+
+static void run(Mycila::PulseAnalyzer::Type type, const Signal& signal, bool pll, bool filter, bool compensation, Stats* stats) {
+  static std::vector<Edge> edges;
+  static std::vector<uint64_t> grid;
+  generate(type, signal, &edges, &grid);
+
+  Mycila::PulseAnalyzer analyzer;
+  Mycila::PulseSimulator::reset();
+  crossings = &grid;
+  crossing = 0;
+  measure = false;
+  errors = &stats->errors;
+
+  analyzer.setPLLEnabled(pll);
+  analyzer.setAdaptiveFilterEnabled(filter);
+  analyzer.setLatencyCompensationEnabled(compensation);
+  analyzer.onZeroCross(onZeroCross);
+  analyzer.begin(PIN_ZC);
+
+  const uint64_t first = edges.empty() ? 0 : edges.front().time;
+  bool locked = false;
+  bool wrong = false;
+  uint64_t lockedSince = 0;
+
+  // detection state after the simulated clock has moved
+  auto check = [&](uint64_t now) {
+    const Mycila::PulseAnalyzer::Type detected = analyzer.getType();
+    if (detected != Mycila::PulseAnalyzer::Type::TYPE_UNKNOWN && detected != type)
+      wrong = true;
+    const bool good = detected == type;
+    if (good && !measure) {
+      if (!locked) {
+        locked = true;
+        stats->lockTimes.push_back((now - first) / 1000);
+      }
+      measure = true;
+      lockedSince = now;
+    } else if (!good && measure) {
+      measure = false;
+      stats->lockedTime += now - lockedSince;
+      // lost without a dropout to explain it
+      const bool dropout = signal.dropoutLength && now >= signal.dropout && now < signal.dropout + signal.dropoutLength + BENCH_DROPOUT_MARGIN;
+      if (!dropout)
+        stats->falseResets++;
+    }
+  };
+
+  const auto start = std::chrono::steady_clock::now();
+  for (const Edge& edge : edges) {
+    Mycila::PulseSimulator::advanceTo(edge.time);
+    check(edge.time);
+    Mycila::PulseSimulator::setInterruptLatency(random(BENCH_LATENCY_MIN, BENCH_LATENCY_MAX));
+    Mycila::PulseSimulator::setTimerLatency(random(signal.timerLatency / 2, signal.timerLatency));
+    Mycila::PulseSimulator::setLevel(PIN_ZC, edge.level);
+    check(Mycila::PulseSimulator::now());
+  }
+  Mycila::PulseSimulator::advanceTo(BENCH_DURATION);
+  stats->time += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  if (measure)
+    stats->lockedTime += BENCH_DURATION - lockedSince;
+  analyzer.end();
+
+  stats->scenarios++;
+  stats->edges += edges.size();
+  stats->locked += locked;
+  stats->wrongType += wrong;
+  stats->dropouts += signal.dropoutLength > 0;
+}
+
+template <typename T>
+static T percentile(const std::vector<T>& sorted, double p) {
+  return sorted.empty() ? 0 : sorted[static_cast<size_t>(p * (sorted.size() - 1) + 0.5)];
+}
+
+static bool report(const char* name, bool pll, bool filter, bool compensation, Stats* stats) {
+  std::sort(stats->lockTimes.begin(), stats->lockTimes.end());
+  std::vector<uint32_t> magnitudes;
+  magnitudes.reserve(stats->errors.size());
+  int64_t sum = 0;
+  uint32_t histogram[2 * BENCH_HISTOGRAM_HALF + 2] = {};
+  for (int32_t error : stats->errors) {
+    sum += error;
+    magnitudes.push_back(error < 0 ? -error : error);
+    int32_t bucket = (error / 1000 + BENCH_HISTOGRAM_STEP_US * BENCH_HISTOGRAM_HALF + BENCH_HISTOGRAM_STEP_US * 100) / BENCH_HISTOGRAM_STEP_US - 100;
+    if (bucket < 0)
+      bucket = 0;
+    if (bucket > 2 * BENCH_HISTOGRAM_HALF + 1)
+      bucket = 2 * BENCH_HISTOGRAM_HALF + 1;
+    histogram[bucket]++;
+  }
+  std::sort(magnitudes.begin(), magnitudes.end());
+
+  const double lockRate = static_cast<double>(stats->locked - stats->wrongType) / stats->scenarios;
+  const double medianError = percentile(magnitudes, 0.5) / 1000.0;
+  const bool ok = lockRate >= BENCH_MIN_LOCK_RATE && medianError <= BENCH_MAX_MEDIAN_ERROR_US;
+
+  printf("%s%s%s%s\n", name, pll ? " [PLL]" : "", filter ? " [FILTER]" : "", compensation ? " [COMPENSATION]" : "");
+  printf("  scenarios:    %" PRIu32 ", %" PRIu32 " locked, %" PRIu32 " wrong type, %" PRIu32 " with a dropout (%.1f%% locked)\n",
+         stats->scenarios,
+         stats->locked,
+         stats->wrongType,
+         stats->dropouts,
+         100 * lockRate);
+  printf("  lock time:    p50 %7.1f ms, p90 %7.1f ms, p99 %7.1f ms, max %7.1f ms\n",
+         percentile(stats->lockTimes, 0.5) / 1000.0,
+         percentile(stats->lockTimes, 0.9) / 1000.0,
+         percentile(stats->lockTimes, 0.99) / 1000.0,
+         percentile(stats->lockTimes, 1.0) / 1000.0);
+  printf("  ZC error:     mean %+6.1f us, |error| p50 %6.1f us, p90 %6.1f us, p99 %6.1f us, max %8.1f us (%zu events)\n",
+         stats->errors.empty() ? 0 : sum / 1000.0 / stats->errors.size(),
+         medianError,
+         percentile(magnitudes, 0.9) / 1000.0,
+         percentile(magnitudes, 0.99) / 1000.0,
+         percentile(magnitudes, 1.0) / 1000.0,
+         stats->errors.size());
+  printf("  ZC histogram: ");
+  for (size_t i = 0; i < sizeof(histogram) / sizeof(histogram[0]); i++)
+    printf("%.1f%% ", stats->errors.empty() ? 0 : 100.0 * histogram[i] / stats->errors.size());
+  printf("(%d us buckets from %d us, outside ones open)\n", BENCH_HISTOGRAM_STEP_US, -BENCH_HISTOGRAM_STEP_US * BENCH_HISTOGRAM_HALF);
+  printf("  false resets: %" PRIu32 " (%.2f per hour of locked signal)\n", stats->falseResets, stats->lockedTime ? stats->falseResets * 3.6e12 / stats->lockedTime : 0);
+  printf("  simulation:   %" PRIu64 " edges in %.3f s\n", stats->edges, stats->time / 1e9);
+  printf("  result:       %s\n", ok ? "OK" : "FAILED");
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  const uint64_t seed = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1;
+  bool ok = true;
+
+  // an analyzer is started and stopped for each scenario
+  Mycila::PulseSimulator::setLogLevel(2);
+
+  for (const Module& module : modules) {
+    for (bool pll : {false, true}) {
+      for (bool filter : {false, true}) {
+        for (bool compensation : {false, true}) {
+          // the same scenarios for each mode
+          state = seed ? seed : 1;
+          Stats stats;
+          for (uint32_t i = 0; i < BENCH_SCENARIOS; i++) {
+            Signal signal;
+            const int64_t nominal = random(1) ? 60000 : 50000;
+            signal.frequency = nominal + random(-BENCH_FREQUENCY_OFFSET, BENCH_FREQUENCY_OFFSET);
+            signal.drift = random(-BENCH_DRIFT, BENCH_DRIFT);
+            signal.width = random(300000, 1200000);
+            signal.jitter = random(0, BENCH_JITTER);
+            signal.bounceRate = random(0, BENCH_BOUNCE_RATE);
+            const bool dropout = static_cast<int64_t>(random(99)) < BENCH_DROPOUT_RATE;
+            signal.dropout = dropout ? random(1000000000, BENCH_DURATION / 2) : 0;
+            signal.dropoutLength = dropout ? random(50000000, BENCH_DROPOUT_MAX) : 0;
+            signal.timerLatency = random(0, BENCH_TIMER_LATENCY);
+            run(module.type, signal, pll, filter, compensation, &stats);
+          }
+          ok &= report(module.name, pll, filter, compensation, &stats);
+        }
+      }
+    }
+  }
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Host benchmark of several analyzers (one per phase), driven by the simulated backend.
+ *
+ * Run with: PLATFORMIO_SRC_DIR=examples/BenchmarkPhases pio run -e native && .pio/build/native/program
+ *
+ * For 1 to 4 phases shifted by 120 degrees, the ISR cost is measured with dedicated timers (2 per analyzer)
+ * and with a shared timebase (1 timer for all the analyzers), as well as the phase angles reported between phases.
+ */
+#include <MycilaPulseAnalyzer.h>
+
+#include <chrono>
+#include <initializer_list>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_PHASES 4
+
+// number of grid periods to simulate per run
+#define BENCH_PERIODS 10000
+
+// accepted error on the phase angles, in degrees
+#define BENCH_ANGLE_TOLERANCE 2
+
+static const int8_t pins[MAX_PHASES] = {35, 36, 37, 38};
+
+typedef struct {
+    const char* name;
+    Mycila::PulseAnalyzer::Type type;
+    // signal period in ns
+    uint64_t period;
+    // high level duration in ns
+    uint64_t width;
+    // angles are reported modulo 180 degrees when the pulse does not tell the voltage polarity
+    uint16_t modulo;
+} Scenario;
+
+static const Scenario scenarios[] = {
+  {"TYPE_SEMI_PERIOD (BM1Z102FJ 50 Hz)", Mycila::PulseAnalyzer::Type::TYPE_SEMI_PERIOD, 20000000, 10000000, 360},
+  {"TYPE_SHORT (Robodyn 50 Hz)", Mycila::PulseAnalyzer::Type::TYPE_SHORT, 10000000, 450000, 180},
+};
+
+static uint32_t zeroCrossCount = 0;
+
+static void onZeroCross(int16_t delay, void* arg) { zeroCrossCount++; }
+
+static inline uint64_t elapsed(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// load: time spent in the ISRs per simulated second, in us
+static bool run(const Scenario& scenario, size_t phases, bool shared, double* load) {
+  Mycila::PulseTimebase timebase;
+  Mycila::PulseAnalyzer analyzers[MAX_PHASES];
+
+  Mycila::PulseSimulator::reset();
+  zeroCrossCount = 0;
+
+  for (size_t i = 0; i < phases; i++) {
+    if (shared)
+      analyzers[i].setTimebase(&timebase);
+    analyzers[i].onZeroCross(onZeroCross);
+    analyzers[i].begin(pins[i]);
+  }
+  const size_t timers = Mycila::PulseSimulator::getTimerCount();
+
+  // next edge of each phase: phase i is late by i * 120 degrees
+  const uint64_t gridPeriod = scenario.type == Mycila::PulseAnalyzer::Type::TYPE_SHORT ? scenario.period * 2 : scenario.period;
+  uint64_t next[MAX_PHASES];
+  bool level[MAX_PHASES] = {};
+  for (size_t i = 0; i < phases; i++)
+    next[i] = 1000000 + gridPeriod * (i % 3) / 3;
+
+  uint64_t edgesTime = 0, alarmsTime = 0, edges = 0;
+  const uint64_t end = 1000000 + gridPeriod * BENCH_PERIODS;
+
+  while (true) {
+    size_t p = 0;
+    for (size_t i = 1; i < phases; i++)
+      if (next[i] < next[p])
+        p = i;
+    if (next[p] > end)
+      break;
+
+    auto start = std::chrono::steady_clock::now();
+    Mycila::PulseSimulator::advanceTo(next[p]);
+    alarmsTime += elapsed(start);
+
+    level[p] = !level[p];
+    start = std::chrono::steady_clock::now();
+    Mycila::PulseSimulator::setLevel(pins[p], level[p]);
+    edgesTime += elapsed(start);
+    edges++;
+
+    next[p] += level[p] ? scenario.width : scenario.period - scenario.width;
+  }
+
+  bool ok = true;
+  for (size_t i = 0; i < phases; i++)
+    ok &= analyzers[i].getType() == scenario.type;
+
+  *load = (edgesTime + alarmsTime) / 1000.0 / (end / 1e9);
+
+  printf("  %zu phase(s), %s: %zu timer(s), %7.1f ns/edge, %7.1f ns/ZC event, ISR load %6.1f us/s\n",
+         phases,
+         shared ? "shared timebase " : "dedicated timers",
+         timers,
+         static_cast<double>(edgesTime) / edges,
+         zeroCrossCount ? static_cast<double>(alarmsTime) / zeroCrossCount : 0,
+         *load);
+
+  if (shared) {
+    printf("    phase angles:");
+    for (size_t i = 1; i < phases; i++) {
+      const uint16_t angle = analyzers[i].getPhaseAngle(analyzers[0]);
+      const uint16_t expected = (i % 3) * 120 % scenario.modulo;
+      const int32_t error = static_cast<int32_t>(angle) - expected;
+      const bool good = error <= BENCH_ANGLE_TOLERANCE && error >= -BENCH_ANGLE_TOLERANCE;
+      ok &= good;
+      printf(" L%zu=%" PRIu16 " deg (%" PRIu16 " us)%s", i + 1, angle, analyzers[i].getPhaseOffset(analyzers[0]), good ? "" : " FAILED");
+    }
+    printf("%s\n", phases == 1 ? " -" : "");
+  }
+
+  for (size_t i = 0; i < phases; i++)
+    analyzers[i].end();
+  timebase.end();
+
+  if (!ok)
+    printf("    FAILED\n");
+  return ok;
+}
+
+int main() {
+  bool ok = true;
+  for (const Scenario& scenario : scenarios) {
+    printf("%s\n", scenario.name);
+    for (bool shared : {false, true}) {
+      double previous = 0;
+      for (size_t phases = 1; phases <= MAX_PHASES; phases++) {
+        double load;
+        ok &= run(scenario, phases, shared, &load);
+        if (phases > 1)
+          printf("    added phase: %+6.1f us/s\n", load - previous);
+        previous = load;
+      }
+    }
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
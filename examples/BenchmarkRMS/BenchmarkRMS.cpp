@@ -0,0 +1,354 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Host benchmark of the RMS pipeline, driven by the simulated backend.
+ *
+ * Run with: PLATFORMIO_SRC_DIR=examples/BenchmarkRMS pio run -e native && .pio/build/native/program
+ *
+ * An analyzer follows a BM1Z102FJ signal (edges at the zero-crossings) while a synthetic source samples the grid voltage
+ * in phase with it. The grid frequency, the voltage and the shape of the sine change at each step, and for each one:
+ * - the RMS and peak voltage of each cycle are checked against the ones of the signal,
+ * - the sample rate must follow the grid frequency (N samples per cycle),
+ * and the worst error of a window of N samples at a fixed rate (N x 50 or 60 Hz) is shown for comparison.
+ * The source must be stopped when the grid is lost.
+ *
+ * Then the throughput of the pipeline is measured with a source replaying samples from memory,
+ * with a reader thread polling the results at the same time, which must never be torn.
+ */
+#include <MycilaPulseAnalyzer.h>
+#include <MycilaPulseRMS.h>
+
+#include <atomic>
+#include <chrono>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#define PIN_ZC 35
+
+// samples per grid cycle
+#define SAMPLES 512
+
+// 325 V peak (230 V RMS) is 1300 ADC units
+#define SCALE 250000
+
+// grid cycles of each step, and at the beginning of a step while the analyzer and the pipeline follow the change
+#define BENCH_STEP_CYCLES   200
+#define BENCH_SETTLE_CYCLES 100
+
+// cycles of samples of the throughput test (replayed), and their number of different amplitudes
+#define BENCH_THROUGHPUT_CYCLES 40000
+#define BENCH_SHAPES            16
+
+// RMS and peak errors allowed, in %
+#define MAX_RMS_ERROR  0.2
+#define MAX_PEAK_ERROR 0.5
+
+typedef struct {
+    // frequency in mHz, amplitude in ADC units, 3rd harmonic in %
+    uint32_t frequency;
+    uint16_t amplitude;
+    int8_t harmonic;
+    // grid lost before the step
+    bool outage;
+} Step;
+
+static const Step steps[] = {
+  {50000, 1300, 0, false},
+  {49800, 1200, 0, false},
+  {50200, 1300, 10, false},
+  {50050, 1100, -10, false},
+  {60000, 1300, 0, true},
+  {59900, 1250, 5, false},
+};
+
+static constexpr size_t STEPS = sizeof(steps) / sizeof(steps[0]);
+
+static Mycila::PulseAnalyzer analyzer;
+static Mycila::PulseRMS rms;
+
+typedef struct {
+    bool settling;
+    double rms;
+    double peak;
+    // rate of N samples per cycle of the signal
+    double coherent;
+    uint32_t cycles;
+    double rmsError;
+    double peakError;
+    uint32_t offsetError;
+    // last rate, and cycles drifting by more than a quarter of a sample at their rate
+    uint32_t rate;
+    uint32_t drifting;
+    uint32_t buffered;
+} Stats;
+
+static Stats stats;
+
+static inline uint64_t elapsed(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// RMS and peak of sin(x) + h sin(3x), for an amplitude of 1
+static double shapeRMS(int8_t harmonic) { return sqrt((1 + harmonic * harmonic / 10000.0) / 2); }
+static double shapePeak(int8_t harmonic) {
+  double peak = 0;
+  for (int i = 0; i < 100000; i++) {
+    const double x = 2 * M_PI * i / 100000;
+    const double v = fabs(sin(x) + harmonic / 100.0 * sin(3 * x));
+    if (v > peak)
+      peak = v;
+  }
+  return peak;
+}
+
+// worst error of the RMS of a sine over SAMPLES samples at a fixed rate, whatever the phase
+static double fixedRateError(uint32_t frequency, uint32_t rate) {
+  double worst = 0;
+  for (int p = 0; p < 360; p++) {
+    double sum = 0;
+    double squares = 0;
+    for (int i = 0; i < SAMPLES; i++) {
+      const double v = sin(2 * M_PI * frequency / 1000.0 * i / rate + p * M_PI / 180);
+      sum += v;
+      squares += v * v;
+    }
+    const double value = sqrt(squares / SAMPLES - (sum / SAMPLES) * (sum / SAMPLES));
+    const double error = fabs(value / M_SQRT1_2 - 1);
+    if (error > worst)
+      worst = error;
+  }
+  return worst * 100;
+}
+
+static void onCycle(const Mycila::PulseRMS::Result& result, void*) {
+  if (stats.settling)
+    return;
+  stats.cycles++;
+
+  const double rmsError = fabs(result.rms / stats.rms - 1) * 100;
+  const double peakError = fabs(result.peak / stats.peak - 1) * 100;
+  const uint32_t offsetError = result.offset > 2048 ? result.offset - 2048 : 2048 - result.offset;
+  if (rmsError > stats.rmsError)
+    stats.rmsError = rmsError;
+  if (peakError > stats.peakError)
+    stats.peakError = peakError;
+  if (offsetError > stats.offsetError)
+    stats.offsetError = offsetError;
+  stats.rate = result.rate;
+  if (fabs(result.rate - stats.coherent) * SAMPLES * 4 > stats.coherent)
+    stats.drifting++;
+
+  // published before the callback
+  Mycila::PulseRMS::Result last;
+  if (rms.getResult(&last) && last.cycle == result.cycle && last.rms == result.rms)
+    stats.buffered++;
+}
+
+// samples replayed from memory, as fast as the pipeline reads them
+class BufferSource : public Mycila::PulseSampleSource {
+  public:
+    bool start(uint32_t rate) override {
+      position = 0;
+      return rate > 0;
+    }
+    void stop() override { remaining = 0; }
+    size_t read(uint16_t* samples, size_t count) override {
+      if (count > remaining)
+        count = remaining;
+      if (count > BENCH_SHAPES * SAMPLES - position)
+        count = BENCH_SHAPES * SAMPLES - position;
+      memcpy(samples, &buffer[position], count * sizeof(uint16_t));
+      position = (position + count) % (BENCH_SHAPES * SAMPLES);
+      remaining -= count;
+      return count;
+    }
+
+    uint16_t buffer[BENCH_SHAPES * SAMPLES];
+    size_t position = 0;
+    uint64_t remaining = 0;
+};
+
+static BufferSource buffer;
+
+typedef struct {
+    uint64_t polls;
+    uint64_t torn;
+    uint64_t backwards;
+} Reader;
+
+// results of each shape of the replayed cycles
+static uint32_t shapeRMSResult[BENCH_SHAPES];
+static uint32_t shapePeakResult[BENCH_SHAPES];
+
+static void read(Reader* reader, const std::atomic<bool>* running) {
+  uint32_t cycle = 0;
+  while (running->load(std::memory_order_relaxed)) {
+    Mycila::PulseRMS::Result result;
+    if (!rms.getResult(&result))
+      continue;
+    reader->polls++;
+    const size_t shape = (result.cycle - 1) % BENCH_SHAPES;
+    if (result.samples != SAMPLES || result.rms != shapeRMSResult[shape] || result.peak != shapePeakResult[shape])
+      reader->torn++;
+    if (result.cycle < cycle)
+      reader->backwards++;
+    cycle = result.cycle;
+  }
+}
+
+int main() {
+  Mycila::PulseSyntheticSource source;
+  uint32_t errors = 0;
+
+  Mycila::PulseSimulator::reset();
+  analyzer.onZeroCross(Mycila::PulseRMS::onZeroCross, &rms);
+  analyzer.begin(PIN_ZC);
+
+  rms.setSamplesPerCycle(SAMPLES);
+  rms.setScale(SCALE);
+  rms.onCycle(onCycle);
+  rms.begin(&analyzer, &source);
+
+  // time of the next rising zero-crossing, and grid period in ns
+  uint64_t now = 1000000;
+  uint64_t period = 0;
+
+  for (size_t s = 0; s < STEPS; s++) {
+    const Step& step = steps[s];
+
+    if (step.outage) {
+      // grid lost: the analyzer is offline after 400 ms, then the source must be stopped
+      const uint64_t end = now + 1000000000;
+      for (; now < end; now += 10000000) {
+        Mycila::PulseSimulator::advanceTo(now);
+        rms.process();
+      }
+      const bool stopped = !rms.isSampling();
+      if (!stopped)
+        errors++;
+      printf("Grid lost: source %s\n", stopped ? "stopped" : "still sampling FAILED");
+    }
+
+    period = 1000000000000ULL / step.frequency;
+    source.setSignal(2048, step.amplitude, step.frequency, now, step.harmonic);
+
+    stats = {};
+    stats.settling = true;
+    stats.rms = step.amplitude * shapeRMS(step.harmonic) * SCALE / 1000;
+    stats.peak = step.amplitude * shapePeak(step.harmonic) * SCALE / 1000;
+    stats.coherent = static_cast<double>(step.frequency) * SAMPLES / 1000;
+
+    // the first step and the one after the outage wait for the analyzer to lock
+    const uint32_t settle = !s || step.outage ? 2 * BENCH_SETTLE_CYCLES : BENCH_SETTLE_CYCLES;
+    const uint32_t restarts = rms.getRestartCount();
+    for (uint32_t c = 0; c < settle + BENCH_STEP_CYCLES; c++) {
+      stats.settling = c < settle;
+      Mycila::PulseSimulator::advanceTo(now);
+      Mycila::PulseSimulator::setLevel(PIN_ZC, true);
+      rms.process();
+      Mycila::PulseSimulator::advanceTo(now + period / 2);
+      Mycila::PulseSimulator::setLevel(PIN_ZC, false);
+      rms.process();
+      now += period;
+    }
+
+    const bool good = !stats.drifting && stats.cycles + 2 >= BENCH_STEP_CYCLES && stats.buffered == stats.cycles &&
+                      stats.rmsError <= MAX_RMS_ERROR && stats.peakError <= MAX_PEAK_ERROR && stats.offsetError <= 1;
+    if (!good)
+      errors++;
+    printf("Step %zu: %6.3f Hz, %4" PRIu16 " units, H3 %+3d%%: %" PRIu32 " cycles at %" PRIu32 " Hz (%" PRIu32 " restart(s)), RMS %6.1f V (error %.3f%%), peak %6.1f V (error %.3f%%), offset error %" PRIu32 "%s\n",
+           s + 1,
+           step.frequency / 1000.0,
+           step.amplitude,
+           step.harmonic,
+           stats.cycles,
+           stats.rate,
+           rms.getRestartCount() - restarts,
+           stats.rms / 1000,
+           stats.rmsError,
+           stats.peak / 1000,
+           stats.peakError,
+           stats.offsetError,
+           good ? "" : " FAILED");
+    printf("        fixed rate %" PRIu32 " Hz: RMS error up to %.3f%%\n",
+           (step.frequency < 55000 ? 50 : 60) * SAMPLES,
+           fixedRateError(step.frequency, (step.frequency < 55000 ? 50 : 60) * SAMPLES));
+  }
+
+  printf("Synthetic source: %" PRIu64 " samples since the last start\n", source.getSampleCount());
+
+  // throughput: cycles of several amplitudes replayed from memory
+  for (size_t k = 0; k < BENCH_SHAPES; k++) {
+    for (size_t i = 0; i < SAMPLES; i++)
+      buffer.buffer[k * SAMPLES + i] = static_cast<uint16_t>(round(2048 + (400 + 60 * k) * sin(2 * M_PI * i / SAMPLES)));
+  }
+
+  rms.end();
+  rms.onCycle(nullptr);
+  rms.begin(&analyzer, &buffer);
+
+  // the source starts at the next cycle
+  for (int h = 0; h < 4; h++) {
+    Mycila::PulseSimulator::advanceTo(now);
+    Mycila::PulseSimulator::setLevel(PIN_ZC, !(h & 1));
+    rms.process();
+    now += period / 2;
+  }
+
+  // results of each shape, one cycle at a time
+  for (uint32_t cycle = 1; cycle <= BENCH_SHAPES; cycle++) {
+    buffer.remaining = SAMPLES;
+    rms.process();
+    Mycila::PulseRMS::Result result = {};
+    if (!rms.getResult(&result) || result.cycle != cycle) {
+      printf("Replay: cycle %" PRIu32 " missing FAILED\n", cycle);
+      errors++;
+    }
+    shapeRMSResult[cycle - 1] = result.rms;
+    shapePeakResult[cycle - 1] = result.peak;
+  }
+
+  // process() alone
+  buffer.remaining = static_cast<uint64_t>(BENCH_THROUGHPUT_CYCLES) * SAMPLES;
+  auto start = std::chrono::steady_clock::now();
+  size_t samples = 0;
+  while (buffer.remaining)
+    samples += rms.process();
+  const double alone = static_cast<double>(elapsed(start)) / samples;
+
+  // with a reader
+  Reader reader = {};
+  std::atomic<bool> running{true};
+  std::thread thread(read, &reader, &running);
+  buffer.remaining = static_cast<uint64_t>(BENCH_THROUGHPUT_CYCLES) * SAMPLES;
+  start = std::chrono::steady_clock::now();
+  samples = 0;
+  while (buffer.remaining)
+    samples += rms.process();
+  const double contended = static_cast<double>(elapsed(start)) / samples;
+  running.store(false, std::memory_order_relaxed);
+  thread.join();
+
+  printf("Throughput: %5.2f ns/sample (%.1f Msamples/s, %.0f cycles of %d samples/s) alone, %5.2f ns/sample with a reader\n",
+         alone,
+         1000 / alone,
+         1000000000 / (alone * SAMPLES),
+         SAMPLES,
+         contended);
+  printf("Reader: %" PRIu64 " results read, torn: %" PRIu64 ", going backwards: %" PRIu64 "\n", reader.polls, reader.torn, reader.backwards);
+  if (reader.torn || reader.backwards || rms.getCycleCount() != BENCH_SHAPES + 2 * BENCH_THROUGHPUT_CYCLES)
+    errors++;
+
+  rms.end();
+  analyzer.end();
+
+  printf("%" PRIu32 " error(s)\n", errors);
+  if (errors)
+    printf("FAILED\n");
+  return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
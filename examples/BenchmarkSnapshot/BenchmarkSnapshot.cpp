@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Host benchmark of the measurement snapshot, driven by the simulated backend.
+ *
+ * Run with: PLATFORMIO_SRC_DIR=examples/BenchmarkSnapshot pio run -e native && .pio/build/native/program
+ *
+ * The main thread plays the ISRs: it feeds a Robodyn 50 Hz signal and a BM1Z102FJ 60 Hz signal in turn, with an outage
+ * in between which resets the analyzer. A reader thread polls the measurements at the same time, like a task on the
+ * other core, and checks that they belong together: pulse type, nominal semi-period and period of the same signal,
+ * or all zero after a reset.
+ * The snapshot must never be torn. The getters called one after the other are checked the same way for comparison.
+ * The cost of both sides is measured: edges with and without a concurrent reader, and the reads without a writer.
+ */
+#include <MycilaPulseAnalyzer.h>
+
+#include <atomic>
+#include <chrono>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+#define PIN_ZC 35
+
+// number of signal changes, each followed by an outage
+#define BENCH_CYCLES 20000
+
+// signal duration of each cycle, and outage after it (ns)
+#define BENCH_SIGNAL 1000000000ULL
+#define BENCH_OUTAGE 500000000ULL
+
+// number of reads to measure the cost of the reader side
+#define BENCH_READS 1000000
+
+typedef struct {
+    const char* name;
+    Mycila::PulseAnalyzer::Type type;
+    uint16_t nominalSemiPeriod;
+    // signal period and high level duration in ns
+    uint64_t period;
+    uint64_t width;
+} Signal;
+
+static const Signal signals[] = {
+  {"TYPE_SHORT (Robodyn 50 Hz)", Mycila::PulseAnalyzer::Type::TYPE_SHORT, 10000, 10000000, 450000},
+  {"TYPE_SEMI_PERIOD (BM1Z102FJ 60 Hz)", Mycila::PulseAnalyzer::Type::TYPE_SEMI_PERIOD, 8333, 16666667, 8333333},
+};
+
+static Mycila::PulseAnalyzer analyzer;
+
+typedef struct {
+    uint64_t polls;
+    // snapshots copied, or skipped because the generation did not change
+    uint64_t snapshots;
+    uint64_t skipped;
+    uint64_t tornSnapshots;
+    uint64_t tornGetters;
+    uint64_t backwards;
+} Reader;
+
+static inline uint64_t elapsed(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// measurements of one of the signals, or of none after a reset
+static bool consistent(Mycila::PulseAnalyzer::Type type, uint16_t nominalSemiPeriod, uint16_t period, uint16_t periodMin, uint16_t periodMax) {
+  if (type == Mycila::PulseAnalyzer::Type::TYPE_UNKNOWN)
+    return !nominalSemiPeriod && !period && !periodMin && !periodMax;
+  for (const Signal& signal : signals) {
+    if (type == signal.type)
+      return nominalSemiPeriod == signal.nominalSemiPeriod &&
+             period + (nominalSemiPeriod >> 5) > nominalSemiPeriod && period < nominalSemiPeriod + (nominalSemiPeriod >> 5) &&
+             periodMin <= period && period <= periodMax;
+  }
+  return false;
+}
+
+static void read(Reader* reader, const std::atomic<bool>* running) {
+  uint32_t generation = 0;
+  while (running->load(std::memory_order_relaxed)) {
+    reader->polls++;
+
+    // what a task on the other core would do without the snapshot
+    const Mycila::PulseAnalyzer::Type type = analyzer.getType();
+    const uint16_t nominalSemiPeriod = analyzer.getNominalGridSemiPeriod();
+    const uint16_t period = analyzer.getPeriod();
+    const uint16_t periodMin = analyzer.getMinPeriod();
+    const uint16_t periodMax = analyzer.getMaxPeriod();
+    if (!consistent(type, nominalSemiPeriod, period, periodMin, periodMax))
+      reader->tornGetters++;
+
+    if (analyzer.getSnapshotGeneration() == generation) {
+      reader->skipped++;
+      continue;
+    }
+
+    const Mycila::PulseAnalyzer::Snapshot snapshot = analyzer.getSnapshot();
+    reader->snapshots++;
+    if (snapshot.generation < generation)
+      reader->backwards++;
+    generation = snapshot.generation;
+    if (!consistent(snapshot.type, snapshot.nominalSemiPeriod, snapshot.period, snapshot.periodMin, snapshot.periodMax))
+      reader->tornSnapshots++;
+  }
+}
+
+// feeds the signals and the outages, returns the number of edges
+static uint64_t write(uint64_t* now) {
+  uint64_t edges = 0;
+  for (size_t cycle = 0; cycle < BENCH_CYCLES; cycle++) {
+    const Signal& signal = signals[cycle % 2];
+    const uint64_t end = *now + BENCH_SIGNAL;
+    while (*now < end) {
+      Mycila::PulseSimulator::advanceTo(*now);
+      Mycila::PulseSimulator::setLevel(PIN_ZC, true);
+      Mycila::PulseSimulator::advanceTo(*now + signal.width);
+      Mycila::PulseSimulator::setLevel(PIN_ZC, false);
+      *now += signal.period;
+      edges += 2;
+    }
+    *now += BENCH_OUTAGE;
+    Mycila::PulseSimulator::advanceTo(*now);
+  }
+  return edges;
+}
+
+int main() {
+  Mycila::PulseSimulator::reset();
+  analyzer.begin(PIN_ZC);
+
+  uint64_t now = 1000000;
+  uint32_t errors = 0;
+
+  // writer alone
+  auto start = std::chrono::steady_clock::now();
+  uint64_t edges = write(&now);
+  const double alone = static_cast<double>(elapsed(start)) / edges;
+
+  // writer with a concurrent reader
+  Reader reader = {};
+  std::atomic<bool> running{true};
+  std::thread thread(read, &reader, &running);
+  start = std::chrono::steady_clock::now();
+  edges = write(&now);
+  const double contended = static_cast<double>(elapsed(start)) / edges;
+  running.store(false, std::memory_order_relaxed);
+  thread.join();
+
+  printf("Writer: %7.1f ns/edge alone, %7.1f ns/edge with a reader (%" PRIu64 " edges, generation %" PRIu32 ")\n",
+         alone,
+         contended,
+         edges,
+         analyzer.getSnapshotGeneration());
+  printf("Reader: %" PRIu64 " polls, %" PRIu64 " snapshots copied, %" PRIu64 " skipped (same generation)\n",
+         reader.polls,
+         reader.snapshots,
+         reader.skipped);
+  printf("  torn snapshots: %" PRIu64 ", generation going backwards: %" PRIu64 "\n", reader.tornSnapshots, reader.backwards);
+  printf("  torn getter reads: %" PRIu64 " (%.4f%% of the polls)\n", reader.tornGetters, reader.polls ? 100.0 * reader.tornGetters / reader.polls : 0);
+  if (reader.tornSnapshots || reader.backwards || !reader.snapshots)
+    errors++;
+
+  // reader side without a writer: signal locked
+  const Signal& signal = signals[0];
+  for (size_t i = 0; i < 100; i++) {
+    Mycila::PulseSimulator::advanceTo(now);
+    Mycila::PulseSimulator::setLevel(PIN_ZC, true);
+    Mycila::PulseSimulator::advanceTo(now + signal.width);
+    Mycila::PulseSimulator::setLevel(PIN_ZC, false);
+    now += signal.period;
+  }
+
+  // read through a volatile pointer: the fields are loaded at each iteration
+  const Mycila::PulseAnalyzer* volatile target = &analyzer;
+  uint64_t sink = 0;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < BENCH_READS; i++)
+    sink += target->getSnapshot().period;
+  const double snapshot = static_cast<double>(elapsed(start)) / BENCH_READS;
+
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < BENCH_READS; i++)
+    sink += target->getSnapshotGeneration();
+  const double generation = static_cast<double>(elapsed(start)) / BENCH_READS;
+
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < BENCH_READS; i++) {
+    const Mycila::PulseAnalyzer* a = target;
+    sink += a->getType() + a->getNominalGridSemiPeriod() + a->getPeriod() + a->getMinPeriod() + a->getMaxPeriod();
+  }
+  const double getters = static_cast<double>(elapsed(start)) / BENCH_READS;
+
+  printf("Reads: %7.1f ns/getSnapshot(), %7.1f ns/getSnapshotGeneration(), %7.1f ns for 5 getters (%" PRIu64 ")\n", snapshot, generation, getters, sink & 1);
+
+  const Mycila::PulseAnalyzer::Snapshot last = analyzer.getSnapshot();
+  if (last.type != signal.type || last.nominalSemiPeriod != signal.nominalSemiPeriod || !last.isOnline())
+    errors++;
+
+  analyzer.end();
+
+  // end() publishes the reset
+  if (analyzer.getSnapshot().isOnline())
+    errors++;
+
+  printf("%" PRIu32 " error(s)\n", errors);
+  if (errors)
+    printf("FAILED\n");
+  return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,217 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Host benchmark of the binary telemetry, driven by the simulated backend.
+ *
+ * Run with: PLATFORMIO_SRC_DIR=examples/BenchmarkTelemetry pio run -e native && .pio/build/native/program
+ *
+ * An analyzer is locked on a BM1Z102FJ 50 Hz signal, then its state is encoded in telemetry frames and decoded back:
+ * - the decoded frames must match the getters, and a stream of frames must be split back,
+ * - the encode time and the size are compared to toJson() + serializeJson() (with -D MYCILA_JSON_SUPPORT, as in the native env),
+ *   as well as the heap allocations of the JSON document,
+ * - the JSON decoded from a frame on the host must be the same as the one of toJson() on the device.
+ */
+#include <MycilaPulseAnalyzer.h>
+#include <MycilaPulseTelemetry.h>
+
+#include <chrono>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PIN_ZC 35
+
+// number of frames encoded to measure the cost
+#define BENCH_FRAMES 100000
+
+// number of frames of the stream
+#define BENCH_STREAM 16
+
+// BM1Z102FJ 50 Hz
+#define SIGNAL_PERIOD 20000000
+#define SIGNAL_WIDTH  10000000
+
+static inline uint64_t elapsed(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+#ifdef MYCILA_JSON_SUPPORT
+// counts the heap allocations of the JSON documents
+class CountingAllocator : public ArduinoJson::Allocator {
+  public:
+    void* allocate(size_t size) override {
+      allocations++;
+      return malloc(size);
+    }
+    void deallocate(void* pointer) override { free(pointer); }
+    void* reallocate(void* pointer, size_t size) override {
+      allocations++;
+      return realloc(pointer, size);
+    }
+    uint64_t allocations = 0;
+};
+#endif
+
+// frame against the getters of the analyzer
+static bool matches(const Mycila::PulseTelemetry::Frame& frame, const Mycila::PulseAnalyzer& analyzer) {
+  const Mycila::PulseAnalyzer::Snapshot snapshot = analyzer.getSnapshot();
+  return frame.generation == snapshot.generation &&
+         frame.type == snapshot.type &&
+         frame.nominalSemiPeriod == analyzer.getNominalGridSemiPeriod() &&
+         frame.period == analyzer.getPeriod() &&
+         frame.periodMin == analyzer.getMinPeriod() &&
+         frame.periodMax == analyzer.getMaxPeriod() &&
+         frame.periodVariance == analyzer.getPeriodVariance() &&
+         frame.periodNs == analyzer.getPeriodNs() &&
+         frame.width == analyzer.getWidth() &&
+         frame.widthMin == analyzer.getMinWidth() &&
+         frame.widthMax == analyzer.getMaxWidth() &&
+         frame.widthVariance == analyzer.getWidthVariance() &&
+         frame.pllFrequency == analyzer.getPLLFrequency() &&
+         frame.pllPhaseError == analyzer.getPLLPhaseError() &&
+         frame.zeroCrosses == analyzer.getZeroCrossCount() &&
+         frame.glitches == analyzer.getGlitchCount() &&
+         (frame.flags & Mycila::PulseTelemetry::FLAG_ONLINE) && (frame.flags & Mycila::PulseTelemetry::FLAG_PLL) &&
+         (frame.flags & Mycila::PulseTelemetry::FLAG_PLL_LOCKED) && (frame.flags & Mycila::PulseTelemetry::FLAG_ADAPTIVE_FILTER) &&
+         !(frame.flags & Mycila::PulseTelemetry::FLAG_LATENCY_COMPENSATION);
+}
+
+int main() {
+  Mycila::PulseAnalyzer analyzer;
+  uint32_t errors = 0;
+
+  Mycila::PulseSimulator::reset();
+  analyzer.setPLLEnabled(true);
+  analyzer.setAdaptiveFilterEnabled(true);
+  analyzer.begin(PIN_ZC);
+
+  uint64_t now = 1000000;
+  for (size_t i = 0; i < 500; i++) {
+    Mycila::PulseSimulator::advanceTo(now);
+    Mycila::PulseSimulator::setLevel(PIN_ZC, true);
+    Mycila::PulseSimulator::advanceTo(now + SIGNAL_WIDTH);
+    Mycila::PulseSimulator::setLevel(PIN_ZC, false);
+    now += SIGNAL_PERIOD;
+  }
+
+  // the state does not change while it is encoded: measure the cost, then check the last frame
+  uint8_t buffer[sizeof(Mycila::PulseTelemetry::Frame)];
+  size_t size = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < BENCH_FRAMES; i++)
+    size = analyzer.toTelemetry(buffer, sizeof(buffer));
+  const double encode = static_cast<double>(elapsed(start)) / BENCH_FRAMES;
+
+  Mycila::PulseTelemetry::Frame frame;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < BENCH_FRAMES; i++)
+    Mycila::PulseTelemetry::decode(buffer, size, &frame);
+  const double decode = static_cast<double>(elapsed(start)) / BENCH_FRAMES;
+
+  const bool decoded = size == sizeof(frame) && Mycila::PulseTelemetry::decode(buffer, size, &frame) == size && matches(frame, analyzer);
+  if (!decoded)
+    errors++;
+  printf("Telemetry: %zu bytes, %7.1f ns/encode, %7.1f ns/decode, frame %s\n", size, encode, decode, decoded ? "matches the getters" : "FAILED");
+
+  // a frame does not fit: nothing written
+  if (analyzer.toTelemetry(buffer, sizeof(buffer) - 1) != 0 || Mycila::PulseTelemetry::decode(buffer, sizeof(buffer) - 1, &frame) != 0)
+    errors++;
+
+  // stream of frames, with one of a future version (longer) in the middle which is skipped
+  uint8_t stream[BENCH_STREAM * (sizeof(frame) + 8)];
+  size_t length = 0;
+  uint32_t sent = 0;
+  for (size_t i = 0; i < BENCH_STREAM; i++) {
+    if (i == BENCH_STREAM / 2) {
+      memset(&stream[length], 0xAA, sizeof(frame) + 8);
+      stream[length] = MYCILA_PULSE_TELEMETRY_VERSION + 1;
+      stream[length + 1] = sizeof(frame) + 8;
+      length += sizeof(frame) + 8;
+      continue;
+    }
+    length += analyzer.toTelemetry(&stream[length], sizeof(stream) - length);
+    sent++;
+    // next period
+    Mycila::PulseSimulator::advanceTo(now);
+    Mycila::PulseSimulator::setLevel(PIN_ZC, true);
+    Mycila::PulseSimulator::advanceTo(now + SIGNAL_WIDTH);
+    Mycila::PulseSimulator::setLevel(PIN_ZC, false);
+    now += SIGNAL_PERIOD;
+  }
+
+  uint32_t received = 0;
+  uint32_t skipped = 0;
+  uint32_t generation = 0;
+  bool ordered = true;
+  for (size_t position = 0; position < length;) {
+    const size_t n = Mycila::PulseTelemetry::decode(&stream[position], length - position, &frame);
+    if (!n) {
+      // other version: skip it
+      skipped++;
+      position += stream[position + 1];
+      continue;
+    }
+    if (frame.generation <= generation)
+      ordered = false;
+    generation = frame.generation;
+    received++;
+    position += n;
+  }
+  if (received != sent || skipped != 1 || !ordered)
+    errors++;
+  printf("Stream: %" PRIu32 " frames sent, %" PRIu32 " decoded, %" PRIu32 " of another version skipped, generations %s\n",
+         sent,
+         received,
+         skipped,
+         ordered ? "increasing" : "FAILED");
+
+#ifdef MYCILA_JSON_SUPPORT
+  CountingAllocator allocator;
+  char json[1024];
+  size_t jsonSize = 0;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < BENCH_FRAMES; i++) {
+    JsonDocument doc(&allocator);
+    analyzer.toJson(doc.to<JsonObject>());
+    jsonSize = serializeJson(doc, json, sizeof(json));
+  }
+  const double jsonEncode = static_cast<double>(elapsed(start)) / BENCH_FRAMES;
+
+  printf("toJson(): %zu bytes, %7.1f ns/encode (serialized), %.1f heap allocations/encode\n",
+         jsonSize,
+         jsonEncode,
+         static_cast<double>(allocator.allocations) / BENCH_FRAMES);
+  printf("Telemetry: %.1fx smaller, %.1fx faster\n", static_cast<double>(jsonSize) / size, jsonEncode / encode);
+
+  // the host decodes the frame to the same JSON as the device
+  JsonDocument device;
+  analyzer.toJson(device.to<JsonObject>());
+  serializeJson(device, json, sizeof(json));
+
+  analyzer.toTelemetry(buffer, sizeof(buffer));
+  Mycila::PulseTelemetry::decode(buffer, sizeof(buffer), &frame);
+  JsonDocument host;
+  Mycila::PulseTelemetry::toJson(frame, host.to<JsonObject>());
+  char decodedJson[1024];
+  serializeJson(host, decodedJson, sizeof(decodedJson));
+
+  #ifndef MYCILA_PULSE_ISR_CYCLES
+  const bool same = strcmp(json, decodedJson) == 0;
+  if (!same)
+    errors++;
+  printf("Decoded JSON %s\n", same ? "same as toJson()" : "FAILED");
+  #endif
+  printf("%s\n", decodedJson);
+#else
+  printf("toJson(): build with -D MYCILA_JSON_SUPPORT to compare\n");
+#endif
+
+  analyzer.end();
+
+  printf("%" PRIu32 " error(s)\n", errors);
+  if (errors)
+    printf("FAILED\n");
+  return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
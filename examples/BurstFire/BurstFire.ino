@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Run with: -D CONFIG_ARDUINO_ISR_IRAM=1
+ *
+ * 4 zero-cross SSR outputs in burst fire (cycle skipping), switched from the ZC events.
+ * The ZC event must come before the zero-crossing (default shift: -150 us): the outputs are set for the coming half-cycle.
+ */
+#include <MycilaPulseAnalyzer.h>
+#include <MycilaPulseBurstFire.h>
+
+#ifdef CONFIG_IDF_TARGET_ESP32C3
+  #define PIN_ZC 3
+static const int8_t outputs[4] = {4, 5, 6, 7};
+#else
+  #define PIN_ZC 35
+static const int8_t outputs[4] = {25, 26, 27, 32};
+#endif
+
+static const uint16_t powers[] = {0, Mycila::PulseBurstFire::POWER_MAX / 4, Mycila::PulseBurstFire::POWER_MAX / 2, Mycila::PulseBurstFire::POWER_MAX / 4 * 3, Mycila::PulseBurstFire::POWER_MAX};
+
+Mycila::PulseTimebase timebase;
+Mycila::PulseAnalyzer pulseAnalyzer;
+Mycila::PulseBurstFire burst;
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial)
+    continue;
+
+  for (size_t i = 0; i < 4; i++)
+    burst.attach(outputs[i]);
+
+  pulseAnalyzer.setTimebase(&timebase);
+  pulseAnalyzer.onZeroCross(Mycila::PulseBurstFire::onZeroCross, &burst);
+  pulseAnalyzer.begin(PIN_ZC);
+
+  burst.begin(&timebase);
+}
+
+static size_t step = 0;
+
+void loop() {
+  // each output at a different power, rotating every 5 seconds
+  for (size_t i = 0; i < 4; i++)
+    burst.setPower(i, powers[(step + i) % 5]);
+  step++;
+
+  for (size_t t = 0; t < 5; t++) {
+    Serial.printf("online=%d, half-cycles=%" PRIu32 ", conducted=%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ", balance=%d,%d,%d,%d\n",
+                  pulseAnalyzer.isOnline(),
+                  burst.getHalfCycleCount(),
+                  burst.getConductedCount(0),
+                  burst.getConductedCount(1),
+                  burst.getConductedCount(2),
+                  burst.getConductedCount(3),
+                  burst.getBalance(0),
+                  burst.getBalance(1),
+                  burst.getBalance(2),
+                  burst.getBalance(3));
+    delay(1000);
+  }
+}
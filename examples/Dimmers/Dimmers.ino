@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Run with: -D CONFIG_ARDUINO_ISR_IRAM=1
+ *
+ * 4 thyristor / TRIAC outputs driven from the ZC events with a single timer, shared with the analyzer.
+ * To shift the the ZC event, use: -D MYCILA_PULSE_ZC_SHIFT_US=x
+ */
+#include <MycilaPulseAnalyzer.h>
+#include <MycilaPulseDimmer.h>
+#include <MycilaPulsePower.h>
+
+#ifdef CONFIG_IDF_TARGET_ESP32C3
+  #define PIN_ZC 3
+static const int8_t outputs[4] = {4, 5, 6, 7};
+#else
+  #define PIN_ZC 35
+static const int8_t outputs[4] = {25, 26, 27, 32};
+#endif
+
+static const uint16_t powers[] = {0, Mycila::PulsePower::POWER_MAX / 4, Mycila::PulsePower::POWER_MAX / 2, Mycila::PulsePower::POWER_MAX / 4 * 3, Mycila::PulsePower::POWER_MAX};
+
+Mycila::PulseTimebase timebase;
+Mycila::PulseAnalyzer pulseAnalyzer;
+Mycila::PulseDimmer dimmer;
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial)
+    continue;
+
+  for (size_t i = 0; i < 4; i++)
+    dimmer.attach(outputs[i]);
+
+  pulseAnalyzer.setTimebase(&timebase);
+  pulseAnalyzer.onZeroCross(Mycila::PulseDimmer::onZeroCross, &dimmer);
+  pulseAnalyzer.begin(PIN_ZC);
+
+  dimmer.begin(&timebase);
+}
+
+static size_t step = 0;
+
+void loop() {
+  // each output at a different power, rotating every 5 seconds
+  const uint16_t semiPeriod = pulseAnalyzer.getNominalGridSemiPeriod();
+  if (semiPeriod) {
+    for (size_t i = 0; i < 4; i++)
+      dimmer.setFiringDelay(i, Mycila::PulsePower::getFiringDelay(semiPeriod, powers[(step + i) % 5], true));
+    step++;
+  }
+
+  for (size_t t = 0; t < 5; t++) {
+    Serial.printf("online=%d, semi-period=%" PRIu16 " us, delays=%" PRIu16 ",%" PRIu16 ",%" PRIu16 ",%" PRIu16 " us\n",
+                  pulseAnalyzer.isOnline(),
+                  dimmer.getSemiPeriod(),
+                  dimmer.getFiringDelay(0),
+                  dimmer.getFiringDelay(1),
+                  dimmer.getFiringDelay(2),
+                  dimmer.getFiringDelay(3));
+    delay(1000);
+  }
+}
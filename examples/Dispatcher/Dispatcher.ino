@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Run with: -D CONFIG_ARDUINO_ISR_IRAM=1
+ *
+ * Deferred delivery of the edge and ZC events to a regular task: the handler is not in IRAM,
+ * can log and block, and receives the events in batches.
+ */
+#include <MycilaPulseAnalyzer.h>
+#include <MycilaPulseDispatcher.h>
+
+Mycila::PulseAnalyzer pulseAnalyzer;
+Mycila::PulseDispatcher dispatcher;
+
+static uint32_t zeroCrosses = 0;
+static uint32_t edges = 0;
+static uint32_t batches = 0;
+static uint32_t largestBatch = 0;
+static uint32_t lost = 0;
+static uint32_t lastZeroCross = 0;
+static uint32_t lastReport = 0;
+
+// regular code, called from the dispatcher task
+static void onEvents(const Mycila::PulseDispatcher::Event* events, size_t count, uint32_t dropped, void* arg) {
+  batches++;
+  lost += dropped;
+  if (count > largestBatch)
+    largestBatch = count;
+
+  for (size_t i = 0; i < count; i++) {
+    const Mycila::PulseDispatcher::Event& event = events[i];
+    if (event.kind == Mycila::PulseDispatcher::Kind::EVENT_EDGE) {
+      edges++;
+      continue;
+    }
+
+    zeroCrosses++;
+    // i.e. integrate the energy over the last semi-period here
+    lastZeroCross = event.timestamp + event.delay;
+
+    if (event.timestamp - lastReport >= 1000000) {
+      lastReport = event.timestamp;
+      Serial.printf("ZC: %" PRIu32 ", edges: %" PRIu32 ", batches: %" PRIu32 " (largest: %" PRIu32 "), dropped: %" PRIu32 ", last ZC at %" PRIu32 " us\n",
+                    zeroCrosses,
+                    edges,
+                    batches,
+                    largestBatch,
+                    lost,
+                    lastZeroCross);
+      largestBatch = 0;
+    }
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial)
+    continue;
+
+  dispatcher.begin(onEvents, nullptr, 4096, 1);
+
+  pulseAnalyzer.onEdge(Mycila::PulseDispatcher::onEdge, &dispatcher);
+  pulseAnalyzer.onZeroCross(Mycila::PulseDispatcher::onZeroCross, &dispatcher);
+  pulseAnalyzer.begin(35);
+}
+
+void loop() {
+  vTaskDelete(NULL);
+}
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Run with: -D CONFIG_ARDUINO_ISR_IRAM=1 -D MYCILA_PULSE_EDGE_BUFFER_SIZE=256
+ *
+ * The edges recorded by the ISR are drained in batches from a task, outside of the ISR constraints.
+ */
+#include <MycilaPulseAnalyzer.h>
+
+#if MYCILA_PULSE_EDGE_BUFFER_SIZE == 0
+  #error "This example requires -D MYCILA_PULSE_EDGE_BUFFER_SIZE=256"
+#endif
+
+Mycila::PulseAnalyzer pulseAnalyzer;
+
+static void drainEdges(void* arg) {
+  uint32_t rising = 0;
+  uint32_t falling = 0;
+  uint32_t last = 0;
+  while (true) {
+    const Mycila::PulseAnalyzer::Edge* edges;
+    size_t count;
+    while ((count = pulseAnalyzer.peekEdges(&edges)) > 0) {
+      for (size_t i = 0; i < count; i++) {
+        if (edges[i].event == Mycila::PulseAnalyzer::Event::SIGNAL_RISING)
+          rising++;
+        else
+          falling++;
+        last = edges[i].timestamp;
+      }
+      pulseAnalyzer.consumeEdges(count);
+    }
+
+    Serial.printf("rising=%" PRIu32 " falling=%" PRIu32 " last=%" PRIu32 " us overflow=%" PRIu32 "\n", rising, falling, last, pulseAnalyzer.getEdgeOverflowCount());
+
+    // 1 second at 50 Hz is 200 edges for short pulses: the buffer must be larger
+    delay(1000);
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial)
+    continue;
+
+  pulseAnalyzer.begin(35);
+
+  xTaskCreate(drainEdges, "drainEdges", 4096, NULL, uxTaskPriorityGet(NULL), NULL);
+}
+
+void loop() {
+  vTaskDelete(NULL);
+}
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Run with: -D CONFIG_ARDUINO_ISR_IRAM=1 -D MYCILA_PULSE_EDGE_BUFFER_SIZE=256
+ *
+ * Grid quality analytics (frequency, RoCoF, frequency deviation histogram, half-cycle asymmetry)
+ * computed in a task from the edges recorded by the ISR.
+ */
+#include <MycilaPulseAnalyzer.h>
+#include <MycilaPulseGridAnalytics.h>
+
+#if MYCILA_PULSE_EDGE_BUFFER_SIZE == 0
+  #error "This example requires -D MYCILA_PULSE_EDGE_BUFFER_SIZE=256"
+#endif
+
+Mycila::PulseAnalyzer pulseAnalyzer;
+Mycila::PulseGridAnalytics analytics;
+
+static void analyze(void* arg) {
+  while (true) {
+    analytics.update(pulseAnalyzer);
+
+    Serial.printf("frequency=%" PRIu32 " mHz, RoCoF=%" PRId32 " mHz/s (max %" PRIu32 " mHz/s), asymmetry=%" PRId32 " ns, DC offset=%" PRId32 " ppm\n",
+                  analytics.getFrequency(),
+                  analytics.getRoCoF(),
+                  analytics.getWindow(0).rocofMax,
+                  analytics.getAsymmetry(),
+                  analytics.getDCOffset());
+
+#ifdef MYCILA_JSON_SUPPORT
+    JsonDocument doc;
+    analytics.toJson(doc.to<JsonObject>());
+    serializeJson(doc, Serial);
+    Serial.println();
+#endif
+
+    // 1 second at 50 Hz is 200 edges for short pulses: the buffer must be larger
+    delay(1000);
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial)
+    continue;
+
+  pulseAnalyzer.begin(35);
+
+  xTaskCreate(analyze, "analyze", 4096, NULL, uxTaskPriorityGet(NULL), NULL);
+}
+
+void loop() {
+  vTaskDelete(NULL);
+}
@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Run with: -D CONFIG_ARDUINO_ISR_IRAM=1 -D MYCILA_PULSE_ISR_CYCLES
+ *
+ * Compare the interrupt latency of the analyzer across the interrupt options of begin():
+ * each configuration runs for 10 s on a ZC signal, while Wi-Fi scans keep core 0 busy.
+ * The latency is the time from the ZC timer alarm to the start of its ISR, which delays all the onZeroCross callbacks.
+ *
+ * The GPIO ISR service is installed once per boot by its first user: the priority and core of the edge interrupt
+ * only change after a reboot. Set the configuration to start with -D LATENCY_CONFIG=x (index in configs).
+ *
+ * Without Wi-Fi load: -D LATENCY_NO_WIFI
+ */
+#include <MycilaPulseAnalyzer.h>
+
+#ifndef LATENCY_NO_WIFI
+  #include <WiFi.h>
+#endif
+
+#ifndef MYCILA_PULSE_ISR_CYCLES
+  #error "Build with -D MYCILA_PULSE_ISR_CYCLES"
+#endif
+
+#ifndef LATENCY_CONFIG
+  #define LATENCY_CONFIG 0
+#endif
+
+#define PIN_ZC            35
+#define LATENCY_PERIOD_MS 10000
+
+typedef struct {
+    const char* name;
+    uint8_t priority;
+    bool shared;
+    int8_t core;
+} Config;
+
+static const Config configs[] = {
+  {"default", 0, true, -1},
+  {"dedicated", 0, false, -1},
+  {"priority 3", 3, false, -1},
+#if portNUM_PROCESSORS > 1
+  {"priority 3, core 1", 3, false, 1},
+#endif
+};
+
+static constexpr size_t CONFIG_COUNT = sizeof(configs) / sizeof(configs[0]);
+
+Mycila::PulseAnalyzer pulseAnalyzer;
+
+static size_t current = LATENCY_CONFIG % CONFIG_COUNT;
+static uint32_t start = 0;
+
+static void startConfig() {
+  const Config& config = configs[current];
+  Mycila::PulseAnalyzer::Options options;
+  options.priority = config.priority;
+  options.shared = config.shared;
+  options.core = config.core;
+  if (!pulseAnalyzer.begin(PIN_ZC, options))
+    Serial.printf("%-20s failed to start\n", config.name);
+  start = millis();
+}
+
+static void printConfig() {
+  const Mycila::PulseAnalyzer::ISRCycles& latency = pulseAnalyzer.getZeroCrossLatency();
+  const Mycila::PulseAnalyzer::ISRCycles& edge = pulseAnalyzer.getEdgeISRCycles();
+  const Mycila::PulseAnalyzer::ISRCycles& zc = pulseAnalyzer.getZeroCrossISRCycles();
+  Serial.printf("%-20s ZC latency (ns): min %6" PRIu32 " avg %6" PRIu32 " max %6" PRIu32 " | edge ISR (cycles): avg %5" PRIu32 " max %5" PRIu32 " | ZC ISR (cycles): avg %5" PRIu32 " max %5" PRIu32 " | %" PRIu32 " ZC\n",
+                configs[current].name,
+                latency.count ? latency.min : 0,
+                latency.avg(),
+                latency.max,
+                edge.avg(),
+                edge.max,
+                zc.avg(),
+                zc.max,
+                latency.count);
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial)
+    continue;
+
+#ifndef LATENCY_NO_WIFI
+  WiFi.mode(WIFI_STA);
+#endif
+
+  startConfig();
+}
+
+void loop() {
+#ifndef LATENCY_NO_WIFI
+  // keep the Wi-Fi stack busy on core 0
+  if (WiFi.scanComplete() != WIFI_SCAN_RUNNING)
+    WiFi.scanNetworks(true);
+#endif
+
+  if (millis() - start >= LATENCY_PERIOD_MS) {
+    printConfig();
+    pulseAnalyzer.end();
+    current = (current + 1) % CONFIG_COUNT;
+    startConfig();
+  }
+
+  delay(100);
+}
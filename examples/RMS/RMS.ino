@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * RMS and peak voltage of each grid cycle, from a voltage divider biased at mid-scale on an ADC1 pin.
+ * The ADC converts 512 samples per grid cycle, at a rate following the grid frequency measured by the analyzer.
+ */
+#include <MycilaPulseAnalyzer.h>
+#include <MycilaPulseRMS.h>
+
+#ifdef CONFIG_IDF_TARGET_ESP32C3
+  #define PIN_ZC  3
+  #define PIN_ADC 2
+#else
+  #define PIN_ZC  35
+  #define PIN_ADC 36
+#endif
+
+// uV at the divider input per ADC unit: 757 uV (3.1 V / 4095) x divider ratio of 200
+#define SCALE 151400
+
+Mycila::PulseAnalyzer pulseAnalyzer;
+Mycila::PulseADCSource adc(PIN_ADC);
+Mycila::PulseRMS rms;
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial)
+    continue;
+
+  rms.setScale(SCALE);
+  pulseAnalyzer.onZeroCross(Mycila::PulseRMS::onZeroCross, &rms);
+  pulseAnalyzer.begin(PIN_ZC);
+  rms.begin(&pulseAnalyzer, &adc);
+}
+
+void loop() {
+  Mycila::PulseRMS::Result result;
+  if (rms.getResult(&result)) {
+    Serial.printf("cycle=%" PRIu32 ", rate=%" PRIu32 " Hz, offset=%" PRIu16 ", rms=%" PRIu32 " mV, peak=%" PRIu32 " mV, restarts=%" PRIu32 "\n",
+                  result.cycle,
+                  result.rate,
+                  result.offset,
+                  result.rms,
+                  result.peak,
+                  rms.getRestartCount());
+  } else {
+    Serial.printf("online=%d, sampling=%d\n", pulseAnalyzer.isOnline(), rms.isSampling());
+  }
+  delay(1000);
+}
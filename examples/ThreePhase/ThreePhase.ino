@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Run with: -D CONFIG_ARDUINO_ISR_IRAM=1
+ *
+ * One analyzer per phase, all sharing a single timer.
+ * Use ZCD modules telling the voltage polarity (BM1Z102FJ, JSY) to get the phase angles over 360 degrees.
+ */
+#include <MycilaPulseAnalyzer.h>
+
+#ifdef CONFIG_IDF_TARGET_ESP32C3
+static const int8_t pins[3] = {3, 4, 5};
+#else
+static const int8_t pins[3] = {35, 34, 39};
+#endif
+
+static volatile uint32_t zeroCrossCount[3] = {0, 0, 0};
+static void ARDUINO_ISR_ATTR onZeroCross(int16_t delay, void* arg) {
+  const size_t phase = reinterpret_cast<uintptr_t>(arg);
+  zeroCrossCount[phase] = zeroCrossCount[phase] + 1;
+}
+
+Mycila::PulseTimebase timebase;
+Mycila::PulseAnalyzer pulseAnalyzers[3];
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial)
+    continue;
+
+  for (size_t i = 0; i < 3; i++) {
+    pulseAnalyzers[i].setTimebase(&timebase);
+    pulseAnalyzers[i].onZeroCross(onZeroCross, reinterpret_cast<void*>(i));
+    pulseAnalyzers[i].begin(pins[i]);
+  }
+}
+
+void loop() {
+  for (size_t i = 0; i < 3; i++) {
+    Serial.printf("L%d: online=%d, period=%" PRIu16 " us, ZC events=%" PRIu32 ", angle=%" PRIu16 " deg (%" PRIu16 " us)\n",
+                  static_cast<int>(i + 1),
+                  pulseAnalyzers[i].isOnline(),
+                  pulseAnalyzers[i].getPeriod(),
+                  zeroCrossCount[i],
+                  pulseAnalyzers[i].getPhaseAngle(pulseAnalyzers[0]),
+                  pulseAnalyzers[i].getPhaseOffset(pulseAnalyzers[0]));
+  }
+  delay(1000);
+}
@@ -7,6 +7,7 @@
  * To shift the the ZC event, use: -D MYCILA_PULSE_ZC_SHIFT_US=x
  */
 #include <MycilaPulseAnalyzer.h>
+#include <MycilaPulsePower.h>
 
 #include <esp32-hal-gpio.h>
 #include <hal/gpio_ll.h>
@@ -115,7 +116,7 @@ void setup() {
 
 uint32_t lastTime = 0;
 size_t i = 0;
-float dutyCycles[5] = {0, 0.25, 0.50, 0.75, 1};
+uint16_t powers[5] = {0, Mycila::PulsePower::POWER_MAX / 4, Mycila::PulsePower::POWER_MAX / 2, Mycila::PulsePower::POWER_MAX / 4 * 3, Mycila::PulsePower::POWER_MAX};
 void loop() {
   if (millis() - lastTime > 2000) {
     const bool online = pulseAnalyzer.isOnline();
@@ -132,8 +133,9 @@ void loop() {
     }
 
     if (online) {
-      firingDelay = dutyCycles[i] * semiPeriod;
-      Serial.printf("Duty cycle: %f, firing delay: %" PRIu32 "\n", dutyCycles[i], firingDelay);
+      // firing delay delivering the power to a resistive load, kept PHASE_DELAY_MIN_US (MYCILA_PULSE_DIMMER_MIN_DELAY_US) away from the zero-crossings
+      firingDelay = Mycila::PulsePower::getFiringDelay(semiPeriod, powers[i], true);
+      Serial.printf("Power: %d%%, firing delay: %" PRIu32 "\n", powers[i] * 100 / Mycila::PulsePower::POWER_MAX, firingDelay);
 
       i = (i + 1) % 5;
     } else {
@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Run with: -D CONFIG_ARDUINO_ISR_IRAM=1
+ *
+ * Record the raw edges of the ZC signal in a binary trace, to replay them on a host with the TraceReplay tool.
+ *
+ * By default, the trace is printed in hexadecimal on the serial port: disable the logs, capture the output to a file,
+ * then convert it with: xxd -r -p capture.txt trace.bin
+ *
+ * With -D TRACE_PARTITION=\"trace\", the trace is written to a data partition of the flash instead
+ * (i.e. trace,data,0x40,,1M in the partition table), then read with: esptool.py read_flash <offset> <size> trace.bin
+ */
+#include <MycilaPulseAnalyzer.h>
+#include <MycilaPulseTrace.h>
+
+Mycila::PulseAnalyzer pulseAnalyzer;
+Mycila::PulseTraceRecorder recorder;
+
+static void printHex(const uint8_t* data, size_t size) {
+  for (size_t i = 0; i < size; i++)
+    Serial.printf("%02x", data[i]);
+  Serial.println();
+}
+
+static void drain(void* arg) {
+  uint8_t chunk[128];
+  while (true) {
+#ifdef TRACE_PARTITION
+    recorder.flush();
+    if (!recorder.isRecording()) {
+      Serial.printf("Trace complete: %u bytes\n", recorder.getPartitionSize());
+      vTaskDelete(NULL);
+    }
+#else
+    size_t count;
+    while ((count = recorder.read(chunk, sizeof(chunk))) > 0)
+      printHex(chunk, count);
+#endif
+    // the ring holds about 10 s of signal
+    delay(500);
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial)
+    continue;
+
+  pulseAnalyzer.setTraceRecorder(&recorder);
+  pulseAnalyzer.begin(35);
+
+#ifdef TRACE_PARTITION
+  if (!recorder.begin(TRACE_PARTITION))
+    return;
+#else
+  recorder.begin();
+  printHex(reinterpret_cast<const uint8_t*>(&recorder.getHeader()), sizeof(Mycila::PulseTrace::Header));
+#endif
+
+  xTaskCreate(drain, "drain", 4096, NULL, uxTaskPriorityGet(NULL), NULL);
+}
+
+void loop() {
+  vTaskDelete(NULL);
+}
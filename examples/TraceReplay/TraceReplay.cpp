@@ -0,0 +1,410 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Host replay tool of the binary edge traces recorded by a PulseTraceRecorder, driven by the simulated backend.
+ *
+ * Run with: PLATFORMIO_SRC_DIR=examples/TraceReplay pio run -e native && .pio/build/native/program [options] [trace.bin]
+ *
+ * The trace file is mapped in memory and its edges are fed to the analyzer through the simulated pin, as fast as possible:
+ * the real edge ISR, ZC timer and watchdog code is run on the recorded signal. The pulse type detections, the online / offline
+ * transitions and a summary of the analysis are printed.
+ *
+ * Options:
+ *   --pll          enable the PLL mode (same as the device)
+ *   --filter       enable the adaptive filter (same as the device)
+ *   --mcpwm        record the self test with the MCPWM capture backend (edge times from the capture counts)
+ *   --events       print the time of each ZC event
+ *   --vcd <file>   export the signal and the ZC events to a VCD file, for a waveform viewer (i.e. GTKWave, PulseView)
+ *   --record <f>   file of the self test trace (default: /tmp/pulse-trace.bin)
+ *
+ * Without a trace file, a self test is run: a signal of TRACE_HOURS hours with jitter, spikes and an outage is recorded
+ * by a live analyzer with a PulseTraceRecorder, then the trace is replayed, and both analyses must give the same results.
+ *
+ * The exit code is not 0 if the trace is invalid, if no pulse type was detected, or if the self test failed.
+ */
+#include <MycilaPulseAnalyzer.h>
+#include <MycilaPulseTrace.h>
+
+#include <chrono>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#define PIN_ZC 35
+
+// duration of the self test signal
+#define TRACE_HOURS 1
+
+// width of the ZC event pulses in the VCD file, in ns
+#define VCD_ZC_PULSE_NS 100000
+
+typedef struct {
+    bool pll = false;
+    bool filter = false;
+    bool mcpwm = false;
+    bool events = false;
+    const char* vcd = nullptr;
+    const char* record = "/tmp/pulse-trace.bin";
+    const char* trace = nullptr;
+} Options;
+
+typedef struct {
+    Mycila::PulseAnalyzer::Type type;
+    uint16_t period;
+    uint16_t width;
+    uint32_t gridFrequency;
+    uint32_t zeroCrossCount;
+    uint32_t glitchCount;
+    uint32_t gapCount;
+    uint32_t noiseCount;
+    uint32_t offlineCount;
+} Result;
+
+static const char* typeName(Mycila::PulseAnalyzer::Type type) {
+  switch (type) {
+    case Mycila::PulseAnalyzer::Type::TYPE_SHORT:
+      return "TYPE_SHORT";
+    case Mycila::PulseAnalyzer::Type::TYPE_SEMI_PERIOD:
+      return "TYPE_SEMI_PERIOD";
+    case Mycila::PulseAnalyzer::Type::TYPE_FULL_PERIOD:
+      return "TYPE_FULL_PERIOD";
+    default:
+      return "TYPE_UNKNOWN";
+  }
+}
+
+static Result result(const Mycila::PulseAnalyzer& analyzer) {
+  return {analyzer.getType(),
+          analyzer.getPeriod(),
+          analyzer.getWidth(),
+          analyzer.getGridFrequencyMilliHz(),
+          analyzer.getZeroCrossCount(),
+          analyzer.getGlitchCount(),
+          analyzer.getGapCount(),
+          analyzer.getNoiseCount(),
+          analyzer.getOfflineCount()};
+}
+
+static void print(const Result& r) {
+  printf("  type:        %s\n", typeName(r.type));
+  printf("  period:      %" PRIu16 " us, width %" PRIu16 " us, grid %" PRIu32 " mHz\n", r.period, r.width, r.gridFrequency);
+  printf("  diagnostics: %" PRIu32 " ZC events, %" PRIu32 " glitches, %" PRIu32 " gaps, %" PRIu32 " noise, %" PRIu32 " offline\n",
+         r.zeroCrossCount,
+         r.glitchCount,
+         r.gapCount,
+         r.noiseCount,
+         r.offlineCount);
+}
+
+static inline double elapsed(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+///////////////////////////////////////////////////////////////////////////
+// VCD export
+///////////////////////////////////////////////////////////////////////////
+
+// signal level ('!') and ZC event pulses ('"'), written in time order
+typedef struct {
+    FILE* file = nullptr;
+    uint64_t time = UINT64_MAX;
+    // end of the last ZC event pulse, 0 if none pending
+    uint64_t zcEnd = 0;
+} Vcd;
+
+static Vcd vcd;
+
+static void vcdChange(uint64_t ns, char value, char id) {
+  if (!vcd.file)
+    return;
+  // end of the ZC event pulse first
+  if (vcd.zcEnd && vcd.zcEnd <= ns) {
+    const uint64_t end = vcd.zcEnd;
+    vcd.zcEnd = 0;
+    vcdChange(end, '0', '"');
+  }
+  if (ns != vcd.time) {
+    fprintf(vcd.file, "#%" PRIu64 "\n", ns);
+    vcd.time = ns;
+  }
+  fprintf(vcd.file, "%c%c\n", value, id);
+}
+
+static bool vcdOpen(const char* path) {
+  vcd.file = fopen(path, "w");
+  if (!vcd.file)
+    return false;
+  fprintf(vcd.file, "$version MycilaPulseAnalyzer TraceReplay $end\n");
+  fprintf(vcd.file, "$timescale 1ns $end\n");
+  fprintf(vcd.file, "$scope module pulse $end\n");
+  fprintf(vcd.file, "$var wire 1 ! signal $end\n");
+  fprintf(vcd.file, "$var wire 1 \" zc $end\n");
+  fprintf(vcd.file, "$upscope $end\n");
+  fprintf(vcd.file, "$enddefinitions $end\n");
+  fprintf(vcd.file, "$dumpvars\nx!\n0\"\n$end\n");
+  return true;
+}
+
+static void vcdClose() {
+  if (!vcd.file)
+    return;
+  if (vcd.zcEnd)
+    vcdChange(vcd.zcEnd, '0', '"');
+  fclose(vcd.file);
+  vcd = Vcd();
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Replay
+///////////////////////////////////////////////////////////////////////////
+
+static bool printEvents = false;
+
+static void onZeroCross(int16_t delay, void* arg) {
+  const uint64_t now = Mycila::PulseSimulator::now();
+  if (printEvents)
+    printf("%14.3f ms: ZC\n", now / 1e6);
+  if (vcd.file) {
+    if (vcd.zcEnd)
+      vcdChange(vcd.zcEnd, '0', '"');
+    vcdChange(now, '1', '"');
+    vcd.zcEnd = now + VCD_ZC_PULSE_NS;
+  }
+}
+
+// time of the replay is offset by 1 ms so that the analyzer is started before the first edge
+static bool replay(const uint8_t* data, size_t size, const Options& options, Result* out) {
+  Mycila::PulseTrace::Reader reader;
+  if (!reader.begin(data, size)) {
+    fprintf(stderr, "Invalid trace: bad header\n");
+    return false;
+  }
+
+  const Mycila::PulseTrace::Header& header = reader.getHeader();
+  printf("Trace: version %" PRIu8 ", %" PRIu32 " Hz, %zu bytes\n", header.version, header.resolution, size);
+
+  if (options.vcd && !vcdOpen(options.vcd)) {
+    fprintf(stderr, "Cannot write %s\n", options.vcd);
+    return false;
+  }
+  printEvents = options.events;
+
+  Mycila::PulseAnalyzer analyzer;
+  Mycila::PulseSimulator::reset();
+  Mycila::PulseSimulator::setInterruptLatency(0);
+  analyzer.setPLLEnabled(options.pll);
+  analyzer.setAdaptiveFilterEnabled(options.filter);
+  analyzer.onZeroCross(onZeroCross);
+  analyzer.begin(PIN_ZC);
+
+  Mycila::PulseAnalyzer::Type type = Mycila::PulseAnalyzer::Type::TYPE_UNKNOWN;
+  bool online = false;
+  uint64_t resyncs = 0;
+  uint64_t ns = 0;
+  Mycila::PulseTrace::Record record;
+
+  const auto start = std::chrono::steady_clock::now();
+  while (reader.next(&record)) {
+    ns = 1000000 + record.time / header.resolution * 1000000000 + record.time % header.resolution * 1000000000 / header.resolution;
+    Mycila::PulseSimulator::advanceTo(ns);
+
+    if (online != analyzer.isOnline()) {
+      online = !online;
+      printf("%14.3f ms: %s\n", Mycila::PulseSimulator::now() / 1e6, online ? "online" : "offline");
+    }
+    if (record.resync) {
+      if (reader.getCount() > 1)
+        printf("%14.3f ms: edges lost by the recorder\n", ns / 1e6);
+      resyncs++;
+    }
+
+    vcdChange(ns, record.level ? '1' : '0', '!');
+    Mycila::PulseSimulator::setLevel(PIN_ZC, record.level);
+
+    if (type != analyzer.getType()) {
+      type = analyzer.getType();
+      printf("%14.3f ms: %s, period %" PRIu16 " us, width %" PRIu16 " us\n", ns / 1e6, typeName(type), analyzer.getPeriod(), analyzer.getWidth());
+    }
+  }
+  const double seconds = elapsed(start);
+
+  if (reader.getPosition() != size)
+    printf("Trace: end after %zu bytes (%zu bytes not decoded)\n", reader.getPosition(), size - reader.getPosition());
+
+  *out = result(analyzer);
+  analyzer.end();
+  vcdClose();
+
+  const double duration = ns ? (ns - 1000000) / 1e9 : 0;
+  printf("Replay: %" PRIu64 " edges, %.1f s of signal in %.3f s (x%.0f), %.1f ns/edge, %" PRIu64 " recorder drops\n",
+         reader.getCount(),
+         duration,
+         seconds,
+         seconds > 0 ? duration / seconds : 0,
+         reader.getCount() ? seconds * 1e9 / reader.getCount() : 0,
+         resyncs ? resyncs - 1 : 0);
+  print(*out);
+  return true;
+}
+
+static bool replayFile(const char* path, const Options& options, Result* out) {
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Cannot open %s\n", path);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    fprintf(stderr, "Cannot read %s\n", path);
+    close(fd);
+    return false;
+  }
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "Cannot map %s\n", path);
+    return false;
+  }
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+  const bool ok = replay(static_cast<const uint8_t*>(data), st.st_size, options, out);
+  munmap(data, st.st_size);
+  return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Self test
+///////////////////////////////////////////////////////////////////////////
+
+// deterministic pseudo-random jitter
+static uint32_t seed = 1;
+static int64_t jitter(uint32_t amplitude) {
+  seed = seed * 1664525 + 1013904223;
+  return static_cast<int64_t>(seed % (2 * amplitude + 1)) - amplitude;
+}
+
+static Mycila::PulseTraceRecorder recorder;
+
+// Robodyn at 49.98 Hz, 20 us jitter, a spike every 1000 pulses, 3 s outage in the middle, 2 to 5 us interrupt latency
+static bool record(const Options& options, Result* out) {
+  const uint64_t period = 10004002;
+  const uint64_t width = 450000;
+  const uint64_t pulses = static_cast<uint64_t>(TRACE_HOURS) * 3600 * 1000000000 / period;
+
+  Mycila::PulseAnalyzer analyzer;
+  Mycila::PulseSimulator::reset();
+  analyzer.setPLLEnabled(options.pll);
+  analyzer.setAdaptiveFilterEnabled(options.filter);
+  analyzer.setTraceRecorder(&recorder);
+  analyzer.begin(PIN_ZC, options.mcpwm ? Mycila::PulseAnalyzer::Capture::CAPTURE_MCPWM : Mycila::PulseAnalyzer::Capture::CAPTURE_GPIO);
+  recorder.begin();
+
+  std::vector<uint8_t> trace;
+  const Mycila::PulseTrace::Header& header = recorder.getHeader();
+  trace.insert(trace.end(), reinterpret_cast<const uint8_t*>(&header), reinterpret_cast<const uint8_t*>(&header) + sizeof(header));
+  uint8_t chunk[256];
+
+  const auto start = std::chrono::steady_clock::now();
+  uint64_t t = 1000000;
+  for (uint64_t i = 0; i < pulses; i++) {
+    if (i == pulses / 2)
+      t += 3000000000;
+    for (bool level : {true, false}) {
+      Mycila::PulseSimulator::advanceTo(t + jitter(20000));
+      Mycila::PulseSimulator::setInterruptLatency(3500 + jitter(1500));
+      Mycila::PulseSimulator::setLevel(PIN_ZC, level);
+      t += level ? width : period - width;
+    }
+    if (i % 1000 == 999) {
+      Mycila::PulseSimulator::advanceTo(t - period / 2);
+      Mycila::PulseSimulator::setLevel(PIN_ZC, true);
+      Mycila::PulseSimulator::advanceTo(t - period / 2 + 100000);
+      Mycila::PulseSimulator::setLevel(PIN_ZC, false);
+    }
+    // drain the ring like a task would do
+    size_t count;
+    while ((count = recorder.read(chunk, sizeof(chunk))) > 0)
+      trace.insert(trace.end(), chunk, chunk + count);
+  }
+  const double seconds = elapsed(start);
+
+  *out = result(analyzer);
+  analyzer.end();
+  recorder.end();
+
+  printf("Record: %" PRIu32 " edges, %" PRIu32 " dropped, %zu bytes (%.2f bytes/edge) in %.3f s\n",
+         recorder.getCount(),
+         recorder.getDroppedCount(),
+         trace.size(),
+         static_cast<double>(trace.size() - sizeof(header)) / recorder.getCount(),
+         seconds);
+  print(*out);
+
+  FILE* file = fopen(options.record, "wb");
+  if (!file || fwrite(trace.data(), 1, trace.size(), file) != trace.size()) {
+    fprintf(stderr, "Cannot write %s\n", options.record);
+    if (file)
+      fclose(file);
+    return false;
+  }
+  fclose(file);
+  return recorder.getDroppedCount() == 0;
+}
+
+static bool same(const Result& a, const Result& b) {
+  // the recorded times are rounded to the us: the averages can move by 1 us
+  return a.type == b.type &&
+         abs(a.period - b.period) <= 1 &&
+         abs(a.width - b.width) <= 1 &&
+         a.glitchCount == b.glitchCount &&
+         a.gapCount == b.gapCount &&
+         a.noiseCount == b.noiseCount &&
+         a.offlineCount == b.offlineCount &&
+         (a.zeroCrossCount > b.zeroCrossCount ? a.zeroCrossCount - b.zeroCrossCount : b.zeroCrossCount - a.zeroCrossCount) <= 1;
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--pll")) {
+      options.pll = true;
+    } else if (!strcmp(argv[i], "--filter")) {
+      options.filter = true;
+    } else if (!strcmp(argv[i], "--mcpwm")) {
+      options.mcpwm = true;
+    } else if (!strcmp(argv[i], "--events")) {
+      options.events = true;
+    } else if (!strcmp(argv[i], "--vcd") && i + 1 < argc) {
+      options.vcd = argv[++i];
+    } else if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+      options.record = argv[++i];
+    } else if (argv[i][0] != '-' && !options.trace) {
+      options.trace = argv[i];
+    } else {
+      fprintf(stderr, "Usage: %s [--pll] [--filter] [--mcpwm] [--events] [--vcd file.vcd] [--record file.bin] [trace.bin]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  Result replayed;
+  if (options.trace) {
+    const bool ok = replayFile(options.trace, options, &replayed);
+    return ok && replayed.type != Mycila::PulseAnalyzer::Type::TYPE_UNKNOWN ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  Result recorded;
+  printf("Self test: %d h signal recorded to %s\n", TRACE_HOURS, options.record);
+  if (!record(options, &recorded))
+    return EXIT_FAILURE;
+  if (!replayFile(options.record, options, &replayed))
+    return EXIT_FAILURE;
+  const bool ok = same(recorded, replayed) && recorded.type == Mycila::PulseAnalyzer::Type::TYPE_SHORT;
+  printf("Result: %s\n", ok ? "OK" : "FAILED");
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -3,25 +3,64 @@
  * Copyright (C) Mathieu Carbou
  */
 #include "MycilaPulseAnalyzer.h"
+#include "MycilaPulseTelemetry.h"
 
-// memory
-#include <esp_attr.h>
-
-// gpio
-#include <driver/gpio.h>
-#include <esp32-hal-gpio.h>
-#include <hal/gpio_ll.h>
-#include <soc/gpio_struct.h>
+#ifdef MYCILA_PULSE_SIMULATION
+  // simulated gpio, timers and logging
+  #include "priv/simulated_hal.h"
+#else
+  // memory
+  #include <esp_attr.h>
+
+  // time
+  #include <esp_timer.h>
+
+  // gpio
+  #include <driver/gpio.h>
+  #include <esp32-hal-gpio.h>
+  #include <hal/gpio_ll.h>
+  #include <soc/gpio_struct.h>
+
+  // logging
+  #include <esp32-hal-log.h>
+
+  // timers
+  #include "priv/inlined_gptimer.h"
+
+  // interrupt allocation
+  #include <esp_intr_alloc.h>
+  #include <freertos/FreeRTOS.h>
+  #include <freertos/semphr.h>
+  #include <freertos/task.h>
+
+  // profile persistence
+  #include <Preferences.h>
+
+  // capture backends
+  #if SOC_GPIO_SUPPORT_ETM && SOC_TIMER_SUPPORT_ETM
+    #include <driver/gpio_etm.h>
+    #include <driver/gptimer_etm.h>
+  #endif
+  #if SOC_MCPWM_SUPPORTED
+    #include <driver/mcpwm_cap.h>
+  #endif
+
+  #ifdef MYCILA_PULSE_DEBUG
+    #include <rom/ets_sys.h>
+  #endif
+
+  #ifdef MYCILA_PULSE_ISR_CYCLES
+    #include <esp_cpu.h>
+  #endif
+#endif
 
-// logging
-#include <esp32-hal-log.h>
+// nominal grid periods
+#include "priv/grid_periods.h"
 
-// timers
-#include "priv/inlined_gptimer.h"
+// running ISRs
+#include "priv/isr_scope.h"
 
-#ifdef MYCILA_PULSE_DEBUG
-  #include <rom/ets_sys.h>
-#endif
+#include <string.h>
 
 #ifdef MYCILA_LOGGER_SUPPORT
   #include <MycilaLogger.h>
@@ -44,118 +83,388 @@ extern Mycila::Logger logger;
                                         (((1ULL << (gpio_num)) & SOC_GPIO_VALID_GPIO_MASK) != 0))
 #endif
 
-// Periods
+// no edge for this time => offline
+#define MYCILA_PULSE_OFFLINE_US (20 * MYCILA_PERIOD_48_US) // more than 400 ms
 
-#define MYCILA_PERIOD_48_US 20800 // for 48 Hz
-#define MYCILA_PERIOD_49_US 20408 // for 49 Hz
-#define MYCILA_PERIOD_50_US 20000 // for 50 Hz
-#define MYCILA_PERIOD_51_US 19608 // for 51 Hz
-#define MYCILA_PERIOD_52_US 19200 // for 52 Hz
+// pulse width filtering to avoid spurious detections
+#define MYCILA_PULSE_MIN_WIDTH_US 100
+#define MYCILA_PULSE_MAX_WIDTH_US 21000
 
-#define MYCILA_PERIOD_58_US 17240 // for 58 Hz
-#define MYCILA_PERIOD_59_US 16950 // for 59 Hz
-#define MYCILA_PERIOD_60_US 16666 // for 60 Hz
-#define MYCILA_PERIOD_61_US 16394 // for 61 Hz
-#define MYCILA_PERIOD_62_US 16130 // for 62 Hz
+// fractional bits of the moving averages
+#define MYCILA_PULSE_EWMA_FRAC_BITS 4
 
-// Semi-periods
+static_assert(!(MYCILA_PULSE_EARLY_LOCK_SAMPLES & 1) && MYCILA_PULSE_EARLY_LOCK_SAMPLES < MYCILA_PULSE_SAMPLES, "MYCILA_PULSE_EARLY_LOCK_SAMPLES must be even and below MYCILA_PULSE_SAMPLES");
+static_assert(!(MYCILA_PULSE_WARM_LOCK_SAMPLES & 1) && MYCILA_PULSE_WARM_LOCK_SAMPLES < MYCILA_PULSE_SAMPLES, "MYCILA_PULSE_WARM_LOCK_SAMPLES must be even and below MYCILA_PULSE_SAMPLES");
 
-#define MYCILA_SEMI_PERIOD_48_US 10400 // for 48 Hz
-#define MYCILA_SEMI_PERIOD_49_US 10204 // for 49 Hz
-#define MYCILA_SEMI_PERIOD_50_US 10000 // for 50 Hz
-#define MYCILA_SEMI_PERIOD_51_US 9804  // for 51 Hz
-#define MYCILA_SEMI_PERIOD_52_US 9600  // for 52 Hz
+// Sorted values: index of the first value above the sample (binary search)
+__attribute__((always_inline)) inline static uint16_t upperBound(const uint16_t* values, uint16_t count, uint16_t sample) {
+  uint16_t low = 0;
+  uint16_t high = count;
+  while (low < high) {
+    const uint16_t middle = (low + high) >> 1;
+    if (values[middle] <= sample)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low;
+}
 
-#define MYCILA_SEMI_PERIOD_58_US 8620 // for 58 Hz
-#define MYCILA_SEMI_PERIOD_59_US 8475 // for 59 Hz
-#define MYCILA_SEMI_PERIOD_60_US 8333 // for 60 Hz
-#define MYCILA_SEMI_PERIOD_61_US 8197 // for 61 Hz
-#define MYCILA_SEMI_PERIOD_62_US 8065 // for 62 Hz
+// Sorted values: insert the sample, count is the number of values before
+__attribute__((always_inline)) inline static void insertSorted(uint16_t* values, uint16_t count, uint16_t sample) {
+  const uint16_t index = upperBound(values, count, sample);
+  for (uint16_t i = count; i > index; i--)
+    values[i] = values[i - 1];
+  values[index] = sample;
+}
 
-// pulse width filtering to avoid spurious detections
-#define MYCILA_PULSE_MIN_WIDTH_US 100
-#define MYCILA_PULSE_MAX_WIDTH_US 21000
+// Sorted values of a round of analysis
+__attribute__((always_inline)) inline static void clear(Mycila::PulseAnalyzer::Samples* samples) { samples->count = 0; }
 
-#define PERIODS_LEN 10 // array length of the PERIODS and SEMI_PERIODS arrays
-
-static constexpr uint16_t PERIODS[] = {
-  MYCILA_PERIOD_48_US,
-  MYCILA_PERIOD_49_US,
-  MYCILA_PERIOD_50_US,
-  MYCILA_PERIOD_51_US,
-  MYCILA_PERIOD_52_US,
-  MYCILA_PERIOD_58_US,
-  MYCILA_PERIOD_59_US,
-  MYCILA_PERIOD_60_US,
-  MYCILA_PERIOD_61_US,
-  MYCILA_PERIOD_62_US,
-};
-static constexpr uint16_t SEMI_PERIODS[] = {
-  MYCILA_SEMI_PERIOD_48_US,
-  MYCILA_SEMI_PERIOD_49_US,
-  MYCILA_SEMI_PERIOD_50_US,
-  MYCILA_SEMI_PERIOD_51_US,
-  MYCILA_SEMI_PERIOD_52_US,
-  MYCILA_SEMI_PERIOD_58_US,
-  MYCILA_SEMI_PERIOD_59_US,
-  MYCILA_SEMI_PERIOD_60_US,
-  MYCILA_SEMI_PERIOD_61_US,
-  MYCILA_SEMI_PERIOD_62_US,
-};
+__attribute__((always_inline)) inline static void add(Mycila::PulseAnalyzer::Samples* samples, uint16_t sample) {
+  if (samples->count < MYCILA_PULSE_SAMPLES / 2)
+    insertSorted(samples->values, samples->count++, sample);
+}
 
-// search the closest value in above arrays sorted in descending order
-__attribute__((always_inline)) inline static uint16_t closest(const uint16_t* array, uint16_t n) {
-  int32_t left = 0, right = PERIODS_LEN - 1, mid;
-
-  // binary search
-  while (left <= right) {
-    mid = left + ((right - left) >> 1);
-    // found!
-    if (array[mid] == n)
-      return n;
-    // if middle value is greater than n, search in the remaining right half
-    if (array[mid] > n)
-      left = mid + 1;
-    else
-      right = mid - 1; // right can become before left
+// Trimmed mean of the samples of a round of analysis, with the min and max of the samples kept (count > 0)
+__attribute__((always_inline)) inline static uint16_t trimmedMean(const Mycila::PulseAnalyzer::Samples* samples, uint16_t* min = nullptr, uint16_t* max = nullptr) {
+#if MYCILA_PULSE_TRIM_SHIFT
+  const uint16_t trim = samples->count >> MYCILA_PULSE_TRIM_SHIFT;
+#else
+  const uint16_t trim = 0;
+#endif
+  const uint16_t end = samples->count - trim;
+  uint32_t sum = 0;
+  for (uint16_t i = trim; i < end; i++)
+    sum += samples->values[i];
+  if (min)
+    *min = samples->values[trim];
+  if (max)
+    *max = samples->values[end - 1];
+  return sum / (end - trim);
+}
+
+#if MYCILA_PULSE_TRACKING_WINDOW
+// Sliding median: adds the sample in place of the oldest one once the window is full, and returns the median
+__attribute__((always_inline)) inline static uint16_t median(Mycila::PulseAnalyzer::Window* window, uint16_t sample) {
+  if (window->count == MYCILA_PULSE_TRACKING_WINDOW) {
+    // drop the oldest value: the last one equal to it in the sorted values
+    uint16_t index = upperBound(window->values, window->count, window->arrivals[window->oldest]) - 1;
+    window->count--;
+    for (; index < window->count; index++)
+      window->values[index] = window->values[index + 1];
   }
+  window->arrivals[window->oldest] = sample;
+  window->oldest = window->oldest + 1 == MYCILA_PULSE_TRACKING_WINDOW ? 0 : window->oldest + 1;
+  insertSorted(window->values, window->count++, sample);
+  return window->values[window->count >> 1];
+}
+#endif
 
-  // Safely handle bounds - ensure we don't access invalid array indices
-  if (right < 0)
-    return array[0]; // Use first element if right underflowed
-  if (left >= PERIODS_LEN)
-    return array[PERIODS_LEN - 1]; // Use last element if left overflowed
+// Exponentially weighted moving average and variance, integer only.
+// avg is a fixed point value with MYCILA_PULSE_EWMA_FRAC_BITS fractional bits, var is in unit^2.
+// Returns the new average, rounded.
+__attribute__((always_inline)) inline static uint16_t ewma(uint32_t* avg, uint32_t* var, uint16_t sample) {
+  // rounded steps so that the average converges to the sample and not 1 unit below or above
+  const uint32_t s = static_cast<uint32_t>(sample) << MYCILA_PULSE_EWMA_FRAC_BITS;
+  if (s > *avg)
+    *avg += (s - *avg + (1 << (MYCILA_PULSE_EWMA_SHIFT - 1))) >> MYCILA_PULSE_EWMA_SHIFT;
+  else
+    *avg -= (*avg - s + (1 << (MYCILA_PULSE_EWMA_SHIFT - 1))) >> MYCILA_PULSE_EWMA_SHIFT;
+
+  const uint16_t mean = (*avg + (1 << (MYCILA_PULSE_EWMA_FRAC_BITS - 1))) >> MYCILA_PULSE_EWMA_FRAC_BITS;
+  const uint32_t dev = sample > mean ? sample - mean : mean - sample;
+  const uint32_t sq = dev * dev; // fits: dev < 2^16
+  if (sq > *var)
+    *var += (sq - *var) >> MYCILA_PULSE_EWMA_SHIFT;
+  else
+    *var -= (*var - sq) >> MYCILA_PULSE_EWMA_SHIFT;
+
+  return mean;
+}
 
-  // Both indices are valid, return the closest value
-  uint16_t leftDiff = (array[left] > n) ? (array[left] - n) : (n - array[left]);
-  uint16_t rightDiff = (array[right] > n) ? (array[right] - n) : (n - array[right]);
+// single producer (ISR): no need for an atomic increment
+__attribute__((always_inline)) inline static void increment(std::atomic<uint32_t>* counter) {
+  counter->store(counter->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
 
-  return (leftDiff < rightDiff) ? array[left] : array[right];
+#ifdef MYCILA_PULSE_ISR_CYCLES
+__attribute__((always_inline)) inline static void add(Mycila::PulseAnalyzer::ISRCycles* cycles, uint32_t sample) {
+  if (sample < cycles->min)
+    cycles->min = sample;
+  if (sample > cycles->max)
+    cycles->max = sample;
+  cycles->total += sample;
+  cycles->count++;
 }
 
+// CPU cycles spent from the creation of the scope to its end
+class ISRCyclesScope {
+  public:
+    __attribute__((always_inline)) inline explicit ISRCyclesScope(Mycila::PulseAnalyzer::ISRCycles* cycles) : _cycles(cycles), _start(esp_cpu_get_cycle_count()) {}
+    __attribute__((always_inline)) inline ~ISRCyclesScope() { add(_cycles, esp_cpu_get_cycle_count() - _start); }
+
+  private:
+    Mycila::PulseAnalyzer::ISRCycles* _cycles;
+    uint32_t _start;
+};
+  #define ISR_CYCLES(cycles) ISRCyclesScope isrCyclesScope(cycles)
+static constexpr bool isrCycles = true;
+#else
+  #define ISR_CYCLES(cycles)
+static constexpr bool isrCycles = false;
+#endif
+
 #ifdef MYCILA_JSON_SUPPORT
 void Mycila::PulseAnalyzer::toJson(const JsonObject& root) const {
-  root["enabled"] = isEnabled();
-  root["online"] = isOnline();
-  root["type"] = static_cast<uint8_t>(_type);
-  root["frequency"] = getFrequency();
-  root["period"] = _period;
-  root["period_min"] = _periodMin;
-  root["period_max"] = _periodMax;
-  root["shift"] = _shift;
-  root["width"] = _width;
-  root["width_min"] = _widthMin;
-  root["width_max"] = _widthMax;
-  root["grid"]["frequency"] = getNominalGridFrequency();
-  root["grid"]["period"] = getNominalGridPeriod();
-  root["grid"]["semi-period"] = getNominalGridSemiPeriod();
-}
-#endif
-
-bool Mycila::PulseAnalyzer::begin(int8_t pinZC) {
+  // same JSON as the one decoded from the telemetry frame on a host
+  PulseTelemetry::Frame frame;
+  toTelemetry(reinterpret_cast<uint8_t*>(&frame), sizeof(frame));
+  PulseTelemetry::toJson(frame, root);
+  #ifdef MYCILA_PULSE_ISR_CYCLES
+  root["diagnostics"]["edge_isr_cycles"]["min"] = _edgeISRCycles.count ? _edgeISRCycles.min : 0;
+  root["diagnostics"]["edge_isr_cycles"]["avg"] = _edgeISRCycles.avg();
+  root["diagnostics"]["edge_isr_cycles"]["max"] = _edgeISRCycles.max;
+  root["diagnostics"]["zc_isr_cycles"]["min"] = _zcISRCycles.count ? _zcISRCycles.min : 0;
+  root["diagnostics"]["zc_isr_cycles"]["avg"] = _zcISRCycles.avg();
+  root["diagnostics"]["zc_isr_cycles"]["max"] = _zcISRCycles.max;
+  root["diagnostics"]["zc_latency_ns"]["min"] = _zcLatency.count ? _zcLatency.min : 0;
+  root["diagnostics"]["zc_latency_ns"]["avg"] = _zcLatency.avg();
+  root["diagnostics"]["zc_latency_ns"]["max"] = _zcLatency.max;
+  #endif
+}
+#endif
+
+size_t Mycila::PulseAnalyzer::toTelemetry(uint8_t* buffer, size_t size) const {
+  if (size < sizeof(PulseTelemetry::Frame))
+    return 0;
+
+  // measurements of the same edge
+  const Snapshot snapshot = getSnapshot();
+
+  PulseTelemetry::Frame frame;
+  frame.version = MYCILA_PULSE_TELEMETRY_VERSION;
+  frame.size = sizeof(frame);
+  frame.flags = (isEnabled() ? PulseTelemetry::FLAG_ENABLED : 0) |
+                (isEnabled() && snapshot.isOnline() ? PulseTelemetry::FLAG_ONLINE : 0) |
+                (_filter ? PulseTelemetry::FLAG_ADAPTIVE_FILTER : 0) |
+                (_compensation ? PulseTelemetry::FLAG_LATENCY_COMPENSATION : 0) |
+                (_pll ? PulseTelemetry::FLAG_PLL : 0) |
+                (isPLLLocked() ? PulseTelemetry::FLAG_PLL_LOCKED : 0);
+  frame.generation = snapshot.generation;
+  frame.type = static_cast<uint8_t>(snapshot.type);
+  frame.reserved = 0;
+  frame.shift = _shift;
+  frame.nominalSemiPeriod = snapshot.nominalSemiPeriod;
+  frame.period = snapshot.period;
+  frame.periodMin = snapshot.periodMin;
+  frame.periodMax = snapshot.periodMax;
+  frame.periodVariance = snapshot.periodVariance;
+  frame.periodNs = snapshot.periodNs;
+  frame.width = snapshot.width;
+  frame.widthMin = snapshot.widthMin;
+  frame.widthMax = snapshot.widthMax;
+  frame.pllPhaseError = _pllPhaseError;
+  frame.widthVariance = snapshot.widthVariance;
+  frame.latencyCompensation = getLatencyCompensation();
+  frame.pllFrequency = getPLLFrequency();
+  frame.glitches = getGlitchCount();
+  frame.gaps = getGapCount();
+  frame.noise = getNoiseCount();
+  frame.classificationFailures = getClassificationFailureCount();
+  frame.offline = getOfflineCount();
+  frame.zeroCrosses = getZeroCrossCount();
+
+  memcpy(buffer, &frame, sizeof(frame));
+  return sizeof(frame);
+}
+
+void Mycila::PulseAnalyzer::resetDiagnostics() {
+  _glitchCount.store(0, std::memory_order_relaxed);
+  _gapCount.store(0, std::memory_order_relaxed);
+  _noiseCount.store(0, std::memory_order_relaxed);
+  _classificationFailureCount.store(0, std::memory_order_relaxed);
+  _offlineCount.store(0, std::memory_order_relaxed);
+  _zeroCrossCount.store(0, std::memory_order_relaxed);
+#ifdef MYCILA_PULSE_ISR_CYCLES
+  _edgeISRCycles = {UINT32_MAX, 0, 0, 0};
+  _zcISRCycles = {UINT32_MAX, 0, 0, 0};
+  _zcLatency = {UINT32_MAX, 0, 0, 0};
+#endif
+}
+
+Mycila::PulseAnalyzer::Snapshot Mycila::PulseAnalyzer::getSnapshot() const {
+  Snapshot snapshot;
+  uint32_t sequence;
+  uint32_t check;
+  do {
+    sequence = _snapshotSequence.load(std::memory_order_acquire);
+    snapshot = _snapshot;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    check = _snapshotSequence.load(std::memory_order_relaxed);
+  } while ((sequence & 1) || sequence != check);
+  snapshot.generation = sequence >> 1;
+  return snapshot;
+}
+
+Mycila::PulseAnalyzer::Profile Mycila::PulseAnalyzer::getProfile() const {
+  if (_type && !_confirm)
+    return {_type, _nominalSemiPeriod, _period, _width};
+  return _profile;
+}
+
+bool Mycila::PulseAnalyzer::setProfile(const Profile& profile) {
+  if (isEnabled()) {
+    LOGE(TAG, "Cannot set the profile: analyzer is running");
+    return false;
+  }
+
+  // semi-period of the grid, in the unit of the period of this pulse type
+  const uint16_t period = profile.type == Type::TYPE_FULL_PERIOD ? profile.nominalSemiPeriod << 1 : profile.nominalSemiPeriod;
+
+  if ((profile.type != Type::TYPE_SHORT && profile.type != Type::TYPE_SEMI_PERIOD && profile.type != Type::TYPE_FULL_PERIOD) ||
+      profile.nominalSemiPeriod != closest(SEMI_PERIODS, profile.nominalSemiPeriod) ||
+      profile.period + (period >> 4) < period || profile.period > period + (period >> 4) ||
+      profile.width < MYCILA_PULSE_MIN_WIDTH_US || profile.width > MYCILA_PULSE_MAX_WIDTH_US) {
+    LOGW(TAG, "Invalid profile: type=%d, semi-period=%" PRIu16 " us, period=%" PRIu16 " us, width=%" PRIu16 " us", profile.type, profile.nominalSemiPeriod, profile.period, profile.width);
+    return false;
+  }
+
+  _profile = profile;
+  return true;
+}
+
+#ifndef MYCILA_PULSE_SIMULATION
+bool Mycila::PulseAnalyzer::loadProfile(const char* name) {
+  Preferences preferences;
+  if (!preferences.begin(name, true))
+    return false;
+  Profile profile;
+  const bool loaded = preferences.getBytes("profile", &profile, sizeof(profile)) == sizeof(profile);
+  preferences.end();
+  return loaded && setProfile(profile);
+}
+
+bool Mycila::PulseAnalyzer::saveProfile(const char* name) const {
+  const Profile profile = getProfile();
+  if (!profile.type)
+    return false;
+  Preferences preferences;
+  if (!preferences.begin(name, false))
+    return false;
+  // NVS wear: only write a changed profile
+  Profile stored;
+  bool saved = preferences.getBytes("profile", &stored, sizeof(stored)) == sizeof(stored) && memcmp(&stored, &profile, sizeof(profile)) == 0;
+  if (!saved)
+    saved = preferences.putBytes("profile", &profile, sizeof(profile)) == sizeof(profile);
+  preferences.end();
+  return saved;
+}
+#endif
+
+uint16_t Mycila::PulseAnalyzer::getPhaseOffset(const PulseAnalyzer& reference) const {
+  if (!_timebase || _timebase != reference._timebase || !isOnline() || !reference.isOnline())
+    return 0;
+  // _period is the grid semi-period, except for full period pulses
+  const int32_t modulo = _type == Type::TYPE_SEMI_PERIOD ? _period << 1 : _period;
+  // lower 32 bits: correct as long as the edges are less than 35 minutes apart
+  int32_t offset = static_cast<int32_t>(_lastRising - reference._lastRising) % modulo;
+  if (offset < 0)
+    offset += modulo;
+  return offset;
+}
+
+uint16_t Mycila::PulseAnalyzer::getPhaseAngle(const PulseAnalyzer& reference) const {
+  if (!_period)
+    return 0;
+  const uint32_t offset = getPhaseOffset(reference);
+  const uint32_t modulo = _type == Type::TYPE_SEMI_PERIOD ? _period << 1 : _period;
+  const uint32_t degrees = _type == Type::TYPE_SHORT ? 180 : 360;
+  return (offset * degrees + (modulo >> 1)) / modulo % degrees;
+}
+
+#ifndef MYCILA_PULSE_SIMULATION
+typedef struct {
+    Mycila::PulseAnalyzer* instance;
+    int8_t pinZC;
+    const Mycila::PulseAnalyzer::Options* options;
+    SemaphoreHandle_t done;
+    bool result;
+} BeginRequest;
+
+void Mycila::PulseAnalyzer::_beginTask(void* arg) {
+  BeginRequest* request = static_cast<BeginRequest*>(arg);
+  request->result = request->instance->_begin(request->pinZC, *request->options);
+  xSemaphoreGive(request->done);
+  vTaskDelete(NULL);
+}
+#endif
+
+bool Mycila::PulseAnalyzer::begin(int8_t pinZC, const Options& options) {
   if (isEnabled())
     return true;
 
+  if (options.priority > 3) {
+    LOGE(TAG, "Invalid interrupt priority: %" PRIu8, options.priority);
+    return false;
+  }
+
+#ifdef MYCILA_PULSE_SIMULATION
+  if (options.core > 0) {
+    LOGE(TAG, "Invalid core: %" PRId8, options.core);
+    return false;
+  }
+  return _begin(pinZC, options);
+#else
+  if (options.core >= portNUM_PROCESSORS) {
+    LOGE(TAG, "Invalid core: %" PRId8, options.core);
+    return false;
+  }
+  if (options.core < 0 || options.core == xPortGetCoreID())
+    return _begin(pinZC, options);
+
+  // interrupts are allocated on the core calling the drivers: install them from a task pinned to the requested core
+  BeginRequest request = {this, pinZC, &options, xSemaphoreCreateBinary(), false};
+  if (!request.done) {
+    LOGE(TAG, "Failed to create semaphore");
+    return false;
+  }
+  if (xTaskCreatePinnedToCore(_beginTask, "pulse_begin", 4096, &request, uxTaskPriorityGet(NULL), NULL, options.core) != pdPASS) {
+    LOGE(TAG, "Failed to create task on core %" PRId8, options.core);
+    vSemaphoreDelete(request.done);
+    return false;
+  }
+  xSemaphoreTake(request.done, portMAX_DELAY);
+  vSemaphoreDelete(request.done);
+  return request.result;
+#endif
+}
+
+bool Mycila::PulseAnalyzer::_begin(int8_t pinZC, const Options& options) {
+  const Capture capture = options.capture;
+
+  switch (capture) {
+    case Capture::CAPTURE_GPIO:
+      break;
+#if SOC_GPIO_SUPPORT_ETM && SOC_TIMER_SUPPORT_ETM
+    case Capture::CAPTURE_ETM:
+      break;
+#endif
+#if SOC_MCPWM_SUPPORTED
+    case Capture::CAPTURE_MCPWM:
+      break;
+#endif
+    default:
+      LOGE(TAG, "Capture backend %" PRIu8 " not supported on this chip", static_cast<uint8_t>(capture));
+      return false;
+  }
+
+  // the ETM capture latches the timer count: it cannot be shared between several analyzers
+  if (_timebase && capture == Capture::CAPTURE_ETM) {
+    LOGE(TAG, "Capture backend %" PRIu8 " not supported with a shared timebase", static_cast<uint8_t>(capture));
+    return false;
+  }
+
   if (GPIO_IS_VALID_GPIO(pinZC)) {
     _pinZC = (gpio_num_t)pinZC;
     pinMode(_pinZC, INPUT);
@@ -166,14 +475,48 @@ bool Mycila::PulseAnalyzer::begin(int8_t pinZC) {
     return false;
   }
 
-  LOGI(TAG, "Enable Pulse Analyzer on pin %" PRIu8, pinZC);
+  LOGI(TAG, "Enable Pulse Analyzer on pin %" PRIu8 " with capture backend %" PRIu8 ", interrupt priority %" PRIu8 " (%s)", pinZC, static_cast<uint8_t>(capture), options.priority, options.shared ? "shared" : "dedicated");
+
+  _capture = capture;
+  _priority = options.priority;
+  _shared = options.shared;
+
+  _compensationTicks = 0;
+  _compensationAvg = 0;
+  _compensationVariance = 0;
+
+  resetDiagnostics();
+
+  if (_timebase) {
+    // shared timebase: 2 compare slots instead of 2 timers
+    if (!_timebase->begin(_priority, _shared)) {
+      _pinZC = GPIO_NUM_NC;
+      return false;
+    }
+    _onlineSlot = _timebase->attach(_onlineSlotISR, this);
+    _zcSlot = _timebase->attach(_zcSlotISR, this);
+    if (_onlineSlot < 0 || _zcSlot < 0) {
+      LOGE(TAG, "No free slot in the shared timebase");
+      _timebase->detach(_onlineSlot);
+      _timebase->detach(_zcSlot);
+      _onlineSlot = -1;
+      _zcSlot = -1;
+      _pinZC = GPIO_NUM_NC;
+      return false;
+    }
+    // start watchdog, then ZC pulse detection
+    _lastEdge = _timebase->now();
+    _timebase->schedule(_onlineSlot, _lastEdge + MYCILA_PULSE_OFFLINE_US);
+    _startCapture();
+    return true;
+  }
 
   gptimer_config_t timer_config;
   timer_config.clk_src = GPTIMER_CLK_SRC_DEFAULT;
   timer_config.direction = GPTIMER_COUNT_UP;
-  timer_config.resolution_hz = 1000000; // 1MHz resolution
-  timer_config.flags.intr_shared = true;
-  timer_config.intr_priority = 0;
+  timer_config.resolution_hz = MYCILA_PULSE_TIMER_RESOLUTION_HZ;
+  timer_config.flags.intr_shared = _shared;
+  timer_config.intr_priority = _priority;
 #if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
   timer_config.flags.backup_before_sleep = false;
 #endif
@@ -200,12 +543,11 @@ bool Mycila::PulseAnalyzer::begin(int8_t pinZC) {
   ESP_ERROR_CHECK(gptimer_start(_zcTimer));
 
   // start ZC pulse detection
-
-  attachInterruptArg(_pinZC, _edgeISR, this, CHANGE);
+  _startCapture();
 
   // start watchdog timer
   gptimer_alarm_config_t online_alarm_cfg;
-  online_alarm_cfg.alarm_count = 20 * MYCILA_PERIOD_48_US; // more than 400 ms
+  online_alarm_cfg.alarm_count = MYCILA_PULSE_OFFLINE_US * MYCILA_PULSE_TICKS_PER_US;
   online_alarm_cfg.reload_count = 0;
   online_alarm_cfg.flags.auto_reload_on_alarm = true;
   ESP_ERROR_CHECK(gptimer_set_alarm_action(_onlineTimer, &online_alarm_cfg));
@@ -220,126 +562,667 @@ void Mycila::PulseAnalyzer::end() {
 
   LOGI(TAG, "Disable Pulse Analyzer on pin %" PRIu8, (uint8_t)_pinZC);
 
-  ESP_ERROR_CHECK(gptimer_stop(_onlineTimer));
-  ESP_ERROR_CHECK(gptimer_disable(_onlineTimer));
-  ESP_ERROR_CHECK(gptimer_del_timer(_onlineTimer));
-  _onlineTimer = NULL;
+  // stop edge capture before deleting the timers it uses
+  _stopCapture();
+  waitISR(&_edgeISRRunning);
+
+  if (_timebase) {
+    // the slot callbacks already collected by the timebase return at once, and detach() waits for them
+    const int8_t onlineSlot = _onlineSlot;
+    const int8_t zcSlot = _zcSlot;
+    _onlineSlot = -1;
+    _zcSlot = -1;
+    _timebase->detach(onlineSlot);
+    _timebase->detach(zcSlot);
+  } else {
+    ESP_ERROR_CHECK(gptimer_stop(_onlineTimer));
+    ESP_ERROR_CHECK(gptimer_disable(_onlineTimer));
+    ESP_ERROR_CHECK(gptimer_del_timer(_onlineTimer));
+    _onlineTimer = NULL;
+
+    ESP_ERROR_CHECK(gptimer_stop(_zcTimer));
+    ESP_ERROR_CHECK(gptimer_disable(_zcTimer));
+    ESP_ERROR_CHECK(gptimer_del_timer(_zcTimer));
+    _zcTimer = NULL;
+  }
 
-  ESP_ERROR_CHECK(gptimer_stop(_zcTimer));
-  ESP_ERROR_CHECK(gptimer_disable(_zcTimer));
-  ESP_ERROR_CHECK(gptimer_del_timer(_zcTimer));
-  _zcTimer = NULL;
+  _pinZC = GPIO_NUM_NC;
 
-  detachInterrupt(_pinZC);
+  // the state is reset once the ISRs still running on the other core are done
+  waitISR(&_timerISRRunning);
+  _reset();
+}
 
-  _pinZC = GPIO_NUM_NC;
+void Mycila::PulseAnalyzer::_startCapture() {
+  switch (_capture) {
+#if SOC_GPIO_SUPPORT_ETM && SOC_TIMER_SUPPORT_ETM
+    case Capture::CAPTURE_ETM: {
+      // latch the watchdog timer count at each edge: it is read in _edgeISR
+      gpio_etm_event_config_t event_config = {};
+      event_config.edge = GPIO_ETM_EVENT_EDGE_ANY;
+      ESP_ERROR_CHECK(gpio_new_etm_event(&event_config, &_etmEvent));
+      ESP_ERROR_CHECK(gpio_etm_event_bind_gpio(_etmEvent, _pinZC));
+      gptimer_etm_task_config_t task_config = {};
+      task_config.task_type = GPTIMER_ETM_TASK_CAPTURE;
+      ESP_ERROR_CHECK(gptimer_new_etm_task(_onlineTimer, &task_config, &_etmTask));
+      esp_etm_channel_config_t channel_config = {};
+      ESP_ERROR_CHECK(esp_etm_new_channel(&channel_config, &_etmChannel));
+      ESP_ERROR_CHECK(esp_etm_channel_connect(_etmChannel, _etmEvent, _etmTask));
+      ESP_ERROR_CHECK(esp_etm_channel_enable(_etmChannel));
+      _installGPIOISRService();
+      attachInterruptArg(_pinZC, _edgeHandlers.edge, this, CHANGE);
+      break;
+    }
+#endif
+#if SOC_MCPWM_SUPPORTED
+    case Capture::CAPTURE_MCPWM: {
+      mcpwm_capture_timer_config_t capture_timer_config = {};
+      capture_timer_config.group_id = 0;
+      capture_timer_config.clk_src = MCPWM_CAPTURE_CLK_SRC_DEFAULT;
+      ESP_ERROR_CHECK(mcpwm_new_capture_timer(&capture_timer_config, &_captureTimer));
+      uint32_t resolution;
+      ESP_ERROR_CHECK(mcpwm_capture_timer_get_resolution(_captureTimer, &resolution));
+      _captureTicksPerUs = resolution / 1000000;
+      _lastCapture = 0;
+      _traceTime = 0;
+      mcpwm_capture_channel_config_t channel_config = {};
+      channel_config.gpio_num = _pinZC;
+      channel_config.prescale = 1;
+      channel_config.flags.pos_edge = true;
+      channel_config.flags.neg_edge = true;
+      channel_config.intr_priority = _priority;
+      ESP_ERROR_CHECK(mcpwm_new_capture_channel(_captureTimer, &channel_config, &_captureChannel));
+      mcpwm_capture_event_callbacks_t capture_callbacks = {};
+      capture_callbacks.on_cap = _edgeHandlers.capture;
+      ESP_ERROR_CHECK(mcpwm_capture_channel_register_event_callbacks(_captureChannel, &capture_callbacks, this));
+      ESP_ERROR_CHECK(mcpwm_capture_channel_enable(_captureChannel));
+      ESP_ERROR_CHECK(mcpwm_capture_timer_enable(_captureTimer));
+      ESP_ERROR_CHECK(mcpwm_capture_timer_start(_captureTimer));
+      break;
+    }
+#endif
+    default:
+      _installGPIOISRService();
+      attachInterruptArg(_pinZC, _edgeHandlers.edge, this, CHANGE);
+      break;
+  }
+}
+
+void Mycila::PulseAnalyzer::_installGPIOISRService() {
+  // default options: let attachInterruptArg() install the service as usual
+  if (!_priority && _shared)
+    return;
+  // the service is installed on the current core, which is the requested one (see begin())
+  int flags = ARDUINO_ISR_FLAG | (_priority ? ESP_INTR_FLAG_LEVEL1 << (_priority - 1) : ESP_INTR_FLAG_LOWMED);
+  if (_shared)
+    flags |= ESP_INTR_FLAG_SHARED;
+  const esp_err_t err = gpio_install_isr_service(flags);
+  if (err == ESP_ERR_INVALID_STATE)
+    LOGW(TAG, "GPIO ISR service already installed: keeping its interrupt priority and core");
+  else if (err != ESP_OK)
+    LOGE(TAG, "Failed to install GPIO ISR service: %s", esp_err_to_name(err));
+}
+
+void Mycila::PulseAnalyzer::_stopCapture() {
+  switch (_capture) {
+#if SOC_GPIO_SUPPORT_ETM && SOC_TIMER_SUPPORT_ETM
+    case Capture::CAPTURE_ETM:
+      detachInterrupt(_pinZC);
+      ESP_ERROR_CHECK(esp_etm_channel_disable(_etmChannel));
+      ESP_ERROR_CHECK(esp_etm_del_channel(_etmChannel));
+      ESP_ERROR_CHECK(esp_etm_del_task(_etmTask));
+      ESP_ERROR_CHECK(esp_etm_del_event(_etmEvent));
+      _etmChannel = nullptr;
+      _etmTask = nullptr;
+      _etmEvent = nullptr;
+      break;
+#endif
+#if SOC_MCPWM_SUPPORTED
+    case Capture::CAPTURE_MCPWM:
+      ESP_ERROR_CHECK(mcpwm_capture_timer_stop(_captureTimer));
+      ESP_ERROR_CHECK(mcpwm_capture_timer_disable(_captureTimer));
+      ESP_ERROR_CHECK(mcpwm_capture_channel_disable(_captureChannel));
+      ESP_ERROR_CHECK(mcpwm_del_capture_channel(_captureChannel));
+      ESP_ERROR_CHECK(mcpwm_del_capture_timer(_captureTimer));
+      _captureChannel = nullptr;
+      _captureTimer = nullptr;
+      break;
+#endif
+    default:
+      detachInterrupt(_pinZC);
+      break;
+  }
+}
+
+void ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_reset() {
+  // keep the profile of a confirmed detection to detect the same signal again quickly
+  if (_type && !_confirm)
+    _profile = {_type, _nominalSemiPeriod, _period, _width};
 
   _size = 0;
+  _confirm = 0;
+  _confirmOutliers = 0;
+  _filterRejects = 0;
   _lastEvent = Event::SIGNAL_NONE;
   _type = Type::TYPE_UNKNOWN;
   _shift = 0;
+  _lastDiff = 0;
+  _lastTicks = 0;
 
   _period = 0;
   _periodMin = 0;
   _periodMax = 0;
+  _periodAvg = 0;
+  _periodVariance = 0;
+  _periodNs = 0;
 
   _nominalSemiPeriod = 0;
 
   _width = 0;
   _widthMin = 0;
   _widthMax = 0;
+  _widthAvg = 0;
+  _widthVariance = 0;
+
+  _pllPeriod = 0;
+  _pllAlarm = 0;
+  _pllPhaseError = 0;
+  _pllLocked = false;
+
+  _publish();
 }
 
-bool ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_zcTimerISR(gptimer_handle_t timer, const gptimer_alarm_event_data_t* event, void* arg) {
+void ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_publish() {
+  // one writer at a time, on both cores: the readers copy again while the sequence is odd or has changed
+  portENTER_CRITICAL_SAFE(&_snapshotLock);
+  // odd while writing, and even after, whatever the previous value
+  const uint32_t sequence = (_snapshotSequence.load(std::memory_order_relaxed) + 1) | 1;
+  _snapshotSequence.store(sequence, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  _snapshot.type = _type;
+  _snapshot.nominalSemiPeriod = _nominalSemiPeriod;
+  _snapshot.period = _period;
+  _snapshot.periodMin = _periodMin;
+  _snapshot.periodMax = _periodMax;
+  _snapshot.periodVariance = _periodVariance;
+  _snapshot.periodNs = _periodNs;
+  _snapshot.width = _width;
+  _snapshot.widthMin = _widthMin;
+  _snapshot.widthMax = _widthMax;
+  _snapshot.widthVariance = _widthVariance;
+
+  _snapshotSequence.store(sequence + 1, std::memory_order_release);
+  portEXIT_CRITICAL_SAFE(&_snapshotLock);
+}
+
+bool ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_zcTimerISR(gptimer_handle_t timer, const gptimer_alarm_event_data_t*, void* arg) {
   Mycila::PulseAnalyzer* instance = (Mycila::PulseAnalyzer*)arg;
+  ISRScope scope(&instance->_timerISRRunning);
+  int16_t delay = -instance->_shiftZC;
+  if (instance->_compensation || isrCycles) {
+    // the timer is reloaded to 0 on the alarm: its count is the time elapsed since then
+    uint64_t count;
+    if (inlined_gptimer_get_raw_count(timer, &count) == ESP_OK)
+      delay = instance->_zcMeasureLatency(count > UINT32_MAX ? UINT32_MAX : count);
+  }
+  ISR_CYCLES(&instance->_zcISRCycles);
+  increment(&instance->_zeroCrossCount);
   if (instance->_onZeroCross)
-    instance->_onZeroCross(-instance->_shiftZC, instance->_onZeroCrossArg);
+    instance->_onZeroCross(delay, instance->_onZeroCrossArg);
   return false;
 }
 
-bool ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_onlineTimerISR(gptimer_handle_t timer, const gptimer_alarm_event_data_t* event, void* arg) {
+bool ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_onlineTimerISR(gptimer_handle_t, const gptimer_alarm_event_data_t*, void* arg) {
   Mycila::PulseAnalyzer* instance = (Mycila::PulseAnalyzer*)arg;
+  ISRScope scope(&instance->_timerISRRunning);
 
-  inlined_gptimer_set_raw_count(instance->_zcTimer, 0);
-  inlined_gptimer_set_alarm_action(instance->_zcTimer, nullptr);
+  // the watchdog keeps firing while there is no edge: only count the resets of an ongoing analysis
+  if (instance->_lastEvent != Event::SIGNAL_NONE)
+    increment(&instance->_offlineCount);
 
-  instance->_size = 0;
-  instance->_lastEvent = Event::SIGNAL_NONE;
-  instance->_type = Type::TYPE_UNKNOWN;
-  instance->_shift = 0;
+  instance->_zcStop();
+  instance->_reset();
 
-  instance->_period = 0;
-  instance->_periodMin = 0;
-  instance->_periodMax = 0;
+  return false;
+}
 
-  instance->_nominalSemiPeriod = 0;
+void ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_zcSlotISR(void* arg) {
+  Mycila::PulseAnalyzer* instance = (Mycila::PulseAnalyzer*)arg;
+  ISRScope scope(&instance->_timerISRRunning);
+  // called after end() detached the slot (the timebase calls the callbacks out of its lock): nothing to do
+  const int8_t slot = instance->_zcSlot;
+  if (slot < 0)
+    return;
+  int16_t delay = -instance->_shiftZC;
+  if (instance->_compensation || isrCycles) {
+    // the periodic deadline has already been moved to the next semi-period by the timebase
+    PulseTimebase* timebase = instance->_timebase;
+    const uint64_t alarm = timebase->getDeadline(slot) - timebase->getPeriod(slot);
+    const uint64_t now = timebase->now();
+    delay = instance->_zcMeasureLatency(now > alarm ? (now - alarm) * MYCILA_PULSE_TICKS_PER_US : 0);
+  }
+  ISR_CYCLES(&instance->_zcISRCycles);
+  increment(&instance->_zeroCrossCount);
+  if (instance->_onZeroCross)
+    instance->_onZeroCross(delay, instance->_onZeroCrossArg);
+}
 
-  instance->_width = 0;
-  instance->_widthMin = 0;
-  instance->_widthMax = 0;
+int16_t ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_zcMeasureLatency(uint32_t latency) {
+#ifdef MYCILA_PULSE_ISR_CYCLES
+  add(&_zcLatency, latency * 1000 / MYCILA_PULSE_TICKS_PER_US);
+#endif
 
-  return false;
+  if (!_compensation || latency > MYCILA_PULSE_LATENCY_MAX_US * MYCILA_PULSE_TICKS_PER_US)
+    return -_shiftZC;
+
+  // the alarm of this event was advanced by the current compensation
+  const int32_t advance = _compensationTicks;
+  if (!_compensationAvg)
+    _compensationAvg = latency << MYCILA_PULSE_EWMA_FRAC_BITS;
+  _compensationTicks = ewma(&_compensationAvg, &_compensationVariance, latency);
+
+  // the zero-crossing was expected -shift after the alarm + advance, and this ISR started latency after the alarm
+  return -_shiftZC + (advance - static_cast<int32_t>(latency)) / MYCILA_PULSE_TICKS_PER_US;
+}
+
+void ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_onlineSlotISR(void* arg) {
+  Mycila::PulseAnalyzer* instance = (Mycila::PulseAnalyzer*)arg;
+  ISRScope scope(&instance->_timerISRRunning);
+  // called after end() detached the slot (the timebase calls the callbacks out of its lock): nothing to do
+  const int8_t slot = instance->_onlineSlot;
+  if (slot < 0)
+    return;
+  PulseTimebase* timebase = instance->_timebase;
+
+  // the deadline is not moved on each edge: it is checked here instead, once per timeout
+  const uint64_t now = timebase->now();
+  const uint64_t lastEdge = instance->_lastEdge;
+  if (now - lastEdge < MYCILA_PULSE_OFFLINE_US) {
+    timebase->schedule(slot, lastEdge + MYCILA_PULSE_OFFLINE_US);
+    return;
+  }
+
+  if (instance->_lastEvent != Event::SIGNAL_NONE)
+    increment(&instance->_offlineCount);
+
+  instance->_zcStop();
+  instance->_reset();
+
+  timebase->schedule(slot, now + MYCILA_PULSE_OFFLINE_US);
+}
+
+void ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_zcStart(uint32_t count, uint32_t period) {
+  if (_timebase) {
+    // the timebase counts in us
+    _timebase->schedule(_zcSlot, _timebase->now() + (period - count) / MYCILA_PULSE_TICKS_PER_US, period / MYCILA_PULSE_TICKS_PER_US);
+  } else {
+    gptimer_alarm_config_t alarm_cfg;
+    alarm_cfg.alarm_count = period;
+    alarm_cfg.reload_count = 0;
+    alarm_cfg.flags.auto_reload_on_alarm = true;
+    inlined_gptimer_set_raw_count(_zcTimer, count);
+    inlined_gptimer_set_alarm_action(_zcTimer, &alarm_cfg);
+  }
+}
+
+void ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_zcSetCount(uint32_t count, uint32_t period) {
+  if (_timebase)
+    _timebase->schedule(_zcSlot, _timebase->now() + (period - count) / MYCILA_PULSE_TICKS_PER_US, period / MYCILA_PULSE_TICKS_PER_US);
+  else
+    inlined_gptimer_set_raw_count(_zcTimer, count);
+}
+
+bool ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_zcGetCount(uint64_t* count) const {
+  if (!_timebase)
+    return inlined_gptimer_get_raw_count(_zcTimer, count) == ESP_OK;
+
+  const uint64_t deadline = _timebase->getDeadline(_zcSlot);
+  const uint32_t period = _timebase->getPeriod(_zcSlot);
+  if (deadline == UINT64_MAX)
+    return false;
+  const uint64_t now = _timebase->now();
+  const uint64_t remaining = deadline > now ? deadline - now : 0;
+  *count = remaining >= period ? 0 : (period - remaining) * MYCILA_PULSE_TICKS_PER_US;
+  return true;
+}
+
+void ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_zcStop() {
+  if (_timebase) {
+    _timebase->cancel(_zcSlot);
+  } else {
+    inlined_gptimer_set_raw_count(_zcTimer, 0);
+    inlined_gptimer_set_alarm_action(_zcTimer, nullptr);
+  }
+}
+
+uint32_t ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_pllMeasuredPeriod() const {
+  // _period is the grid period for full period pulses, and the grid semi-period for the other ones
+  const uint32_t period = _periodAvg * MYCILA_PULSE_TICKS_PER_US << (MYCILA_PULSE_PLL_FRAC_BITS - MYCILA_PULSE_EWMA_FRAC_BITS);
+  return _type == Type::TYPE_FULL_PERIOD ? period >> 1 : period;
 }
 
+void ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_pllSync(int32_t pos) {
+  uint64_t count;
+  if (!_zcGetCount(&count))
+    return;
+
+  // phase error, wrapped around the auto-reload of the ZC timer
+  // error > 0 means that the ZC timer is late compared to the signal
+  const int32_t period = _pllAlarm;
+  int32_t error = pos - static_cast<int32_t>(count);
+  if (error > (period >> 1))
+    error -= period;
+  else if (error < -(period >> 1))
+    error += period;
+
+  _pllPhaseError = error / MYCILA_PULSE_TICKS_PER_US;
+
+  if (error > MYCILA_PULSE_PLL_CAPTURE_US * MYCILA_PULSE_TICKS_PER_US || error < -MYCILA_PULSE_PLL_CAPTURE_US * MYCILA_PULSE_TICKS_PER_US) {
+    // out of the capture range: hard sync like without the PLL and restart from the measured period
+    _pllLocked = false;
+    _pllPeriod = _pllMeasuredPeriod();
+    count = pos;
+
+  } else {
+    _pllLocked = error <= MYCILA_PULSE_PLL_LOCK_US * MYCILA_PULSE_TICKS_PER_US && error >= -MYCILA_PULSE_PLL_LOCK_US * MYCILA_PULSE_TICKS_PER_US;
+
+    // frequency correction (integral): a late timer means that its period is too long
+    _pllPeriod -= error * (1 << (MYCILA_PULSE_PLL_FRAC_BITS - MYCILA_PULSE_PLL_KI_SHIFT));
+
+    // keep the period within 6% of the nominal one
+    const uint32_t nominal = static_cast<uint32_t>(_nominalSemiPeriod) * MYCILA_PULSE_TICKS_PER_US << MYCILA_PULSE_PLL_FRAC_BITS;
+    if (_pllPeriod > nominal + (nominal >> 4))
+      _pllPeriod = nominal + (nominal >> 4);
+    else if (_pllPeriod < nominal - (nominal >> 4))
+      _pllPeriod = nominal - (nominal >> 4);
+
+    // phase correction (proportional)
+    const int32_t correction = error / (1 << MYCILA_PULSE_PLL_KP_SHIFT);
+    if (!correction && _pllAlarm == ((_pllPeriod + (1 << (MYCILA_PULSE_PLL_FRAC_BITS - 1))) >> MYCILA_PULSE_PLL_FRAC_BITS))
+      return;
+
+    int32_t next = static_cast<int32_t>(count) + correction;
+    if (next < 0)
+      next += period;
+    else if (next >= period)
+      next -= period;
+    count = next;
+  }
+
+  // the timer count must stay below the alarm, otherwise the alarm would be missed:
+  // if the period gets shorter than the current position, the update is postponed to the next edge.
+  const uint32_t alarm = (_pllPeriod + (1 << (MYCILA_PULSE_PLL_FRAC_BITS - 1))) >> MYCILA_PULSE_PLL_FRAC_BITS;
+  if (alarm != _pllAlarm && count < alarm) {
+    _pllAlarm = alarm;
+    _zcStart(count, alarm);
+  } else if (count < _pllAlarm) {
+    _zcSetCount(count, _pllAlarm);
+  }
+}
+
+template <Mycila::PulseAnalyzer::Type TYPE, uint8_t FREQUENCY>
 void ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_edgeISR(void* arg) {
   Mycila::PulseAnalyzer* instance = (Mycila::PulseAnalyzer*)arg;
-  gptimer_handle_t zcTimer = instance->_zcTimer;
+  ISRScope scope(&instance->_edgeISRRunning);
+  ISR_CYCLES(&instance->_edgeISRCycles);
   gptimer_handle_t onlineTimer = instance->_onlineTimer;
 
-  if (!onlineTimer || !zcTimer)
+  if (!instance->_isStarted())
     return;
 
   uint64_t diff;
-  if (inlined_gptimer_get_raw_count(onlineTimer, &diff) != ESP_OK)
+  uint64_t latency = 0;
+
+  if (instance->_timebase) {
+    // shared timebase: time since the last edge, in us
+    diff = (instance->_timebase->now() - instance->_lastEdge) * MYCILA_PULSE_TICKS_PER_US;
+#if SOC_GPIO_SUPPORT_ETM && SOC_TIMER_SUPPORT_ETM
+  } else if (instance->_capture == Capture::CAPTURE_ETM) {
+    // count latched at the edge, then current count (reading the current count overwrites the latched one)
+    uint64_t now;
+    if (inlined_gptimer_get_captured_count(onlineTimer, &diff) != ESP_OK || inlined_gptimer_get_raw_count(onlineTimer, &now) != ESP_OK)
+      return;
+    // the watchdog timer might have been reloaded in between
+    latency = now > diff ? now - diff : 0;
+#endif
+  } else if (inlined_gptimer_get_raw_count(onlineTimer, &diff) != ESP_OK) {
     return;
+  }
+
+  // Edge detection
+  const Event event = gpio_ll_get_level(&GPIO, instance->_pinZC) ? Event::SIGNAL_RISING : Event::SIGNAL_FALLING;
+
+  if (instance->_trace)
+    instance->_trace->record(esp_timer_get_time() - latency / MYCILA_PULSE_TICKS_PER_US, event == Event::SIGNAL_RISING);
+
+  instance->_processEdge<TYPE, FREQUENCY>(diff > UINT32_MAX ? UINT32_MAX : diff, event, latency);
+}
+
+#if SOC_MCPWM_SUPPORTED
+template <Mycila::PulseAnalyzer::Type TYPE, uint8_t FREQUENCY>
+bool ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_captureISR(mcpwm_cap_channel_handle_t, const mcpwm_capture_event_data_t* event, void* arg) {
+  Mycila::PulseAnalyzer* instance = (Mycila::PulseAnalyzer*)arg;
+  ISRScope scope(&instance->_edgeISRRunning);
+  ISR_CYCLES(&instance->_edgeISRCycles);
+
+  if (!instance->_isStarted())
+    return false;
+
+  if (instance->_trace) {
+    // edge time from the capture counts, like the analysis: the interrupt latency is not recorded
+    const int64_t now = esp_timer_get_time();
+    if (!instance->_traceTime || now - instance->_traceTime > MYCILA_PULSE_OFFLINE_US) {
+      // first edge, or after an outage (the capture counter might have wrapped): from the current time
+      instance->_traceTime = now;
+      instance->_traceRemainder = 0;
+    } else {
+      // below 2^32 ticks: less than MYCILA_PULSE_OFFLINE_US since the last traced edge
+      const uint32_t ticks = event->cap_value - instance->_traceCapture + instance->_traceRemainder;
+      instance->_traceTime += ticks / instance->_captureTicksPerUs;
+      instance->_traceRemainder = ticks % instance->_captureTicksPerUs;
+    }
+    instance->_traceCapture = event->cap_value;
+    instance->_trace->record(instance->_traceTime, event->cap_edge == MCPWM_CAP_EDGE_POS);
+  }
+
+  // capture timer is 32 bits: the difference is correct across a wrap around
+  const uint64_t diff = static_cast<uint64_t>(event->cap_value - instance->_lastCapture) * MYCILA_PULSE_TICKS_PER_US / instance->_captureTicksPerUs;
+
+  if (instance->_processEdge<TYPE, FREQUENCY>(diff > UINT32_MAX ? UINT32_MAX : diff, event->cap_edge == MCPWM_CAP_EDGE_POS ? Event::SIGNAL_RISING : Event::SIGNAL_FALLING, 0))
+    instance->_lastCapture = event->cap_value;
+
+  return false;
+}
+#endif
+
+bool ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_matchesProfile() const {
+  if (!_profile.type || !_widthSamples.count || !_periodSamples.count)
+    return false;
+  // a period sample of the analysis is made of 2 edges: 2 semi-periods or 2 periods for the long pulses
+  const uint32_t period = _profile.type == Type::TYPE_SHORT ? _profile.period : _profile.period << 1;
+  const uint32_t width = _profile.width;
+  const uint32_t periodAvg = trimmedMean(&_periodSamples);
+  const uint32_t widthAvg = trimmedMean(&_widthSamples);
+  const uint32_t periodTolerance = period >> 5;
+  const uint32_t widthTolerance = (width >> 2) + MYCILA_PULSE_MIN_WIDTH_US;
+  return periodAvg + periodTolerance >= period && periodAvg <= period + periodTolerance && widthAvg + widthTolerance >= width && widthAvg <= width + widthTolerance;
+}
+
+void ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_lock(uint32_t ticks, Event event, uint32_t latency) {
+  // seed the moving averages used after detection
+  _periodAvg = static_cast<uint32_t>(_period) << MYCILA_PULSE_EWMA_FRAC_BITS;
+  _periodVariance = 0;
+  _periodNs = static_cast<uint32_t>(_period) * 1000;
+  _widthAvg = static_cast<uint32_t>(_width) << MYCILA_PULSE_EWMA_FRAC_BITS;
+  _widthVariance = 0;
+#if MYCILA_PULSE_TRACKING_WINDOW
+  _widthWindow.count = 0;
+  _widthWindow.oldest = 0;
+  _periodWindow.count = 0;
+  _periodWindow.oldest = 0;
+#endif
+  _lastDiff = ticks / MYCILA_PULSE_TICKS_PER_US;
+  _lastTicks = ticks;
+
+  // ZC timer position and period in ticks
+  const int32_t semiPeriod = static_cast<int32_t>(_nominalSemiPeriod) * MYCILA_PULSE_TICKS_PER_US;
+  const int32_t shift = _shift * MYCILA_PULSE_TICKS_PER_US;
+  int32_t sum = 0;
+  switch (_type) {
+    case Type::TYPE_FULL_PERIOD:
+    case Type::TYPE_SEMI_PERIOD: {
+      sum = (shift < 0 ? 0 : semiPeriod) - shift;
+      break;
+    }
+    case Type::TYPE_SHORT: {
+      if (event == Event::SIGNAL_FALLING)
+        sum = (static_cast<int32_t>(ticks) >> 1) - shift; // position == middle of the pulse compensated by shift
+      else
+        sum = -(static_cast<int32_t>(ticks) >> 1) - shift;
+      if (sum < 0)
+        sum += semiPeriod;
+      break;
+    }
+    default:
+      assert(false);
+      break;
+  }
+
+  // the edge happened latency ticks ago, and the ZC ISR starts _compensationTicks after the alarm
+  sum += latency + _compensationTicks;
+  while (sum >= semiPeriod)
+    sum -= semiPeriod;
+
+  // the PLL starts from the measured period, the alarm is updated at the next edge
+  _pllPeriod = _pllMeasuredPeriod();
+  _pllAlarm = semiPeriod;
+  _pllPhaseError = 0;
+  _pllLocked = false;
+
+  // start ZC timer
+  _zcStart(sum, semiPeriod);
+
+  _publish();
+}
+
+template <Mycila::PulseAnalyzer::Type TYPE, uint8_t FREQUENCY>
+bool ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_processEdge(uint32_t ticks, Event event, uint32_t latency) {
+  // pulse type and grid semi-period known at compile time, or detected
+  constexpr bool fixed = TYPE != Type::TYPE_UNKNOWN;
+  constexpr uint16_t nominalSemiPeriod = FREQUENCY ? (500000 + (FREQUENCY >> 1)) / FREQUENCY : 0;
+  const Type type = fixed ? TYPE : _type;
+
+  // the pulse is analyzed in us, the ZC timer is placed in ticks
+  const uint32_t diff = ticks / MYCILA_PULSE_TICKS_PER_US;
 
   // Filter out spurious interrupts happening during a slow rising / falling slope
   // See: https://yasolr.carbou.me/blog/2024-07-31_zero-cross_pulse_detection
-  if (diff < MYCILA_PULSE_MIN_WIDTH_US)
-    return;
+  if (diff < MYCILA_PULSE_MIN_WIDTH_US) {
+    increment(&_glitchCount);
+    return false;
+  }
 
-  // Reset Watchdog for online/offline detection
-  inlined_gptimer_set_raw_count(onlineTimer, 0);
+  // no edge for this time => the signal was lost, restart the analysis
+  uint32_t gap = MYCILA_PERIOD_48_US;
+  // edge later than expected by the adaptive filter: the levels it ends and starts are not measured
+  bool late = false;
+
+  // Adaptive filter: once the pulse profile is known, each edge is expected after the pulse width (falling edge)
+  // or after the rest of the signal cycle (rising edge)
+  if (_filter && _type) {
+    // _period is the grid semi-period (short pulses), or half of the signal cycle
+    const uint32_t cycle = type == Type::TYPE_SHORT ? _period : _period << 1;
+    const uint32_t expected = event == Event::SIGNAL_FALLING ? _width : cycle - _width;
+    const uint32_t tolerance = expected >> MYCILA_PULSE_FILTER_TOLERANCE_SHIFT < MYCILA_PULSE_MIN_WIDTH_US ? MYCILA_PULSE_MIN_WIDTH_US : expected >> MYCILA_PULSE_FILTER_TOLERANCE_SHIFT;
+
+    // too early, or a second edge of the same kind: the pulse was not finished
+    if (diff + tolerance < expected || event == _lastEvent) {
+      if (++_filterRejects < MYCILA_PULSE_FILTER_MAX_REJECTS) {
+        increment(&_glitchCount);
+        return false;
+      }
+      // the pulse profile has changed: learn it again from this edge
+      _zcStop();
+      _reset();
+    } else {
+      gap = expected + cycle;
+      // a missed pulse or a longer level: still a valid edge for the ZC timer, but not a period or width sample
+      late = diff > expected + tolerance;
+    }
+  }
+  _filterRejects = 0;
+
+  // Reset Watchdog for online/offline detection, which then counts from the edge
+  if (_timebase) {
+    _lastEdge = _timebase->now() - latency / MYCILA_PULSE_TICKS_PER_US;
+    if (event == Event::SIGNAL_RISING)
+      _lastRising = _lastEdge;
+  } else {
+    inlined_gptimer_set_raw_count(_onlineTimer, latency);
+  }
+
+#if MYCILA_PULSE_EDGE_BUFFER_SIZE > 0
+  // record the edge for the consumer task, or drop it if the buffer is full
+  const uint32_t head = _edgeHead.load(std::memory_order_relaxed);
+  if (head - _edgeTail.load(std::memory_order_acquire) < MYCILA_PULSE_EDGE_BUFFER_SIZE) {
+    Edge* edge = &_edges[head & (MYCILA_PULSE_EDGE_BUFFER_SIZE - 1)];
+    edge->timestamp = esp_timer_get_time() - latency / MYCILA_PULSE_TICKS_PER_US;
+    edge->diff = diff > UINT16_MAX ? UINT16_MAX : diff;
+    edge->event = event;
+    _edgeHead.store(head + 1, std::memory_order_release);
+  } else {
+    increment(&_edgeOverflow);
+  }
+#endif
 
   // long time no see ? => reset
-  if (diff > MYCILA_PERIOD_48_US) {
-    instance->_size = 0;
-    instance->_lastEvent = Event::SIGNAL_NONE;
+  if (diff > gap) {
+    // not counted for the first edge after start or reset
+    if (_lastEvent != Event::SIGNAL_NONE)
+      increment(&_gapCount);
+    _size = 0;
+    _lastEvent = Event::SIGNAL_NONE;
 #ifdef MYCILA_PULSE_DEBUG
     ets_printf("ERR: diff\n");
 #endif
-    return;
+    return true;
   }
 
-  // Edge detection
-  const Event event = gpio_ll_get_level(&GPIO, instance->_pinZC) ? Event::SIGNAL_RISING : Event::SIGNAL_FALLING;
+  // first edge after start or reset: the interval since the previous edge is unknown
+  const bool first = _lastEvent == Event::SIGNAL_NONE;
 
   // noise in edge detection ? => reset count, just in case
   // But this is still possible that the noise is caused by the wrong voltage detection above
   // so we do not update the zcTimer and we let it run if it was started
-  if (instance->_lastEvent == event) {
-    instance->_size = 0;
+  const bool noise = _lastEvent == event;
+  if (noise) {
+    increment(&_noiseCount);
+    _size = 0;
 #ifdef MYCILA_PULSE_DEBUG
     ets_printf("ERR: edge\n");
 #endif
   }
 
-  instance->_lastEvent = event;
+  _lastEvent = event;
 
   // sync alarms for ZC ISR
-  if (instance->_type) {
-    switch (instance->_type) {
+  if (_type) {
+    // ZC timer period in ticks: nominal semi-period, or the one tracked by the PLL
+    const int32_t semiPeriod = _pll ? _pllAlarm : (fixed ? nominalSemiPeriod : _nominalSemiPeriod) * MYCILA_PULSE_TICKS_PER_US;
+    const int32_t shift = _shift * MYCILA_PULSE_TICKS_PER_US;
+    int32_t pos = -1; // expected position of the ZC timer at this edge
+    switch (type) {
       case Type::TYPE_FULL_PERIOD:
       case Type::TYPE_SEMI_PERIOD: {
-        inlined_gptimer_set_raw_count(zcTimer, (instance->_shift < 0 ? 0 : instance->_nominalSemiPeriod) - instance->_shift);
+        pos = (shift < 0 ? 0 : semiPeriod) - shift;
         break;
       }
       case Type::TYPE_SHORT: {
         if (event == Event::SIGNAL_FALLING) {
-          int16_t pos = (static_cast<int16_t>(diff) >> 1) - instance->_shift; // position == middle of the pulse compensated by shift
+          pos = (static_cast<int32_t>(ticks) >> 1) - shift; // position == middle of the pulse compensated by shift
           if (pos < 0)
-            pos += instance->_nominalSemiPeriod;
-          inlined_gptimer_set_raw_count(zcTimer, pos);
+            pos += semiPeriod;
         }
         break;
       }
@@ -347,52 +1230,161 @@ void ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_edgeISR(void* arg) {
         assert(false);
         break;
     }
+    if (pos >= 0) {
+      // the edge happened latency ticks ago, and the ZC ISR starts _compensationTicks after the alarm
+      pos += latency + _compensationTicks;
+      while (pos >= semiPeriod)
+        pos -= semiPeriod;
+      if (_pll)
+        _pllSync(pos);
+      else
+        _zcSetCount(pos, semiPeriod);
+    }
   }
 
   // trigger callback
-  if (instance->_onEdge)
-    instance->_onEdge(event, instance->_onEdgeArg);
+  if (_onEdge)
+    _onEdge(event, _onEdgeArg);
+
+  // Pulse analysis done ? => keep tracking period and width
+  if (_type) {
+    // a period sample is made of a low level followed by a high level, measured on falling edge
+    if (event == Event::SIGNAL_FALLING && !noise && !late && _lastDiff) {
+      uint16_t width = diff;
+      // same unit as the analysis below: the signal of these types lasts 2 semi-periods or 2 periods (over 16 bits)
+      uint16_t period = type == Type::TYPE_SHORT ? diff + _lastDiff : (static_cast<uint32_t>(diff) + _lastDiff) >> 1;
+
+      // early detection: the samples until the end of the round must match, except as many as the trimmed mean drops,
+      // otherwise the analysis restarts
+      bool outlier = false;
+      if (!fixed && _confirm) {
+        const uint16_t expected = _type == Type::TYPE_FULL_PERIOD ? _nominalSemiPeriod << 1 : _nominalSemiPeriod;
+        const uint16_t tolerance = (_width >> 2) + MYCILA_PULSE_MIN_WIDTH_US;
+        outlier = period + (expected >> 4) < expected || period > expected + (expected >> 4) || width + tolerance < _width || width > _width + tolerance;
+        if (outlier && _confirmOutliers) {
+          _confirmOutliers--;
+        } else if (outlier) {
+          increment(&_classificationFailureCount);
+          // the signal does not match the profile it was detected with (if any)
+          _profile.type = Type::TYPE_UNKNOWN;
+          _zcStop();
+          _reset();
+#ifdef MYCILA_PULSE_DEBUG
+          ets_printf("ERR: early\n");
+#endif
+          return true;
+        }
+        _confirm--;
+      }
 
-  // Pulse analysis done ?
-  if (instance->_type)
-    return;
+      // a mismatching sample of an early detection is not measured, like the ones dropped by the trimmed mean
+      if (!outlier) {
+        if (width < _widthMin)
+          _widthMin = width;
+        if (width > _widthMax)
+          _widthMax = width;
+        if (period < _periodMin)
+          _periodMin = period;
+        if (period > _periodMax)
+          _periodMax = period;
+
+#if MYCILA_PULSE_TRACKING_WINDOW
+        // median of the last samples, and the period in ns only when the sample is close to it
+        const uint16_t periodMedian = median(&_periodWindow, period);
+        outlier = period + (periodMedian >> 4) < periodMedian || period > periodMedian + (periodMedian >> 4);
+        width = median(&_widthWindow, width);
+        period = periodMedian;
+#endif
 
-  instance->_widths[instance->_size++] = diff;
+        _width = ewma(&_widthAvg, &_widthVariance, width);
+        _period = ewma(&_periodAvg, &_periodVariance, period);
+      }
 
-  // analyze pulse width when we have all samples
-  if (instance->_size == MYCILA_PULSE_SAMPLES) {
-    // analyze pulse width
-    int32_t value = 0, sum = 0, min = INT32_MAX, max = 0;
-
-    for (size_t i = event == Event::SIGNAL_RISING ? 0 : 1; i < MYCILA_PULSE_SAMPLES; i += 2) {
-      value = instance->_widths[i];
-      sum += value;
-      if (value < min)
-        min = value;
-      if (value > max)
-        max = value;
+      // same period at the timer resolution, in ns
+      if (!outlier) {
+        uint32_t periodNs = (ticks + _lastTicks) * (1000 / MYCILA_PULSE_TICKS_PER_US);
+        if (type != Type::TYPE_SHORT)
+          periodNs >>= 1;
+        _periodNs += (static_cast<int32_t>(periodNs - _periodNs) + (1 << (MYCILA_PULSE_EWMA_SHIFT - 1))) >> MYCILA_PULSE_EWMA_SHIFT;
+      }
+
+      _publish();
+    }
+    _lastDiff = noise || first || late ? 0 : diff;
+    _lastTicks = noise || first || late ? 0 : ticks;
+    return true;
+  }
+
+  if (first) {
+    _lastDiff = 0;
+    return true;
+  }
+
+  if constexpr (fixed) {
+    // known pulse: no analysis, a signal cycle (a low level, then a pulse) matching the pulse type is enough to start the ZC timer
+    if (event == Event::SIGNAL_RISING) {
+      _lastDiff = noise ? 0 : diff;
+      return true;
     }
+    // pulse width, and signal cycle (1/16 tolerance), of the pulse type at the nominal grid frequency
+    constexpr uint32_t widthMin = TYPE == Type::TYPE_SHORT ? MYCILA_PULSE_MIN_WIDTH_US : TYPE == Type::TYPE_SEMI_PERIOD ? nominalSemiPeriod - (nominalSemiPeriod >> 2) : (nominalSemiPeriod << 1) - (nominalSemiPeriod >> 1);
+    constexpr uint32_t widthMax = TYPE == Type::TYPE_SHORT ? nominalSemiPeriod >> 1 : TYPE == Type::TYPE_SEMI_PERIOD ? nominalSemiPeriod + (nominalSemiPeriod >> 2) : MYCILA_PULSE_MAX_WIDTH_US;
+    constexpr uint32_t cycle = TYPE == Type::TYPE_SHORT ? nominalSemiPeriod : TYPE == Type::TYPE_SEMI_PERIOD ? nominalSemiPeriod << 1 : nominalSemiPeriod << 2;
+    const uint32_t low = _lastDiff;
+    _lastDiff = 0;
+    if (noise || !low || diff < widthMin || diff > widthMax || low + diff + (cycle >> 4) < cycle || low + diff > cycle + (cycle >> 4))
+      return true;
+    _type = TYPE;
+    _shift = TYPE == Type::TYPE_FULL_PERIOD ? _shiftZC + _shiftJsySignal : _shiftZC;
+    _width = diff;
+    _widthMin = diff;
+    _widthMax = diff;
+    _period = TYPE == Type::TYPE_FULL_PERIOD ? nominalSemiPeriod << 1 : nominalSemiPeriod;
+    _periodMin = _period;
+    _periodMax = _period;
+    _nominalSemiPeriod = nominalSemiPeriod;
+    _lock(ticks, event, latency);
+    return true;
+  }
 
-    value = (sum << 1) / MYCILA_PULSE_SAMPLES;
+  // running statistics of the round: a width sample on each falling edge, a period sample on each pair of edges
+  if (_size == 0) {
+    clear(&_widthSamples);
+    clear(&_periodSamples);
+  }
+  if (event == Event::SIGNAL_FALLING)
+    add(&_widthSamples, diff);
+  if (_size & 1)
+    add(&_periodSamples, diff + _lastDiff);
+  _lastDiff = diff;
+  _size++;
+
+  // analyze the pulse when we have all samples, or try an early detection on each complete period once we have enough,
+  // or once fewer of them match the last learned profile
+  const bool early = _size < MYCILA_PULSE_SAMPLES;
+  if (!early || (!(_size & 1) && ((MYCILA_PULSE_EARLY_LOCK_SAMPLES && _size >= MYCILA_PULSE_EARLY_LOCK_SAMPLES) || (MYCILA_PULSE_WARM_LOCK_SAMPLES && _size >= MYCILA_PULSE_WARM_LOCK_SAMPLES && _matchesProfile())))) {
+    // analyze pulse width
+    // robust to a few missed or spurious edges: the lowest and highest samples are dropped (see MYCILA_PULSE_TRIM_SHIFT)
+    uint16_t low;
+    uint16_t high;
+    int32_t value = trimmedMean(&_widthSamples, &low, &high);
+    int32_t min = low;
+    int32_t max = high;
+    const int32_t periodValue = trimmedMean(&_periodSamples, &low, &high);
+
+    // early detection only when the samples are consistent: otherwise wait for more of them
+    if (early && (max - min > (value >> 2) + MYCILA_PULSE_MIN_WIDTH_US || high - low > periodValue >> 5))
+      return true;
 
     if (value >= MYCILA_PULSE_MIN_WIDTH_US && value <= MYCILA_PULSE_MAX_WIDTH_US) {
-      instance->_width = value;
-      instance->_widthMin = min;
-      instance->_widthMax = max;
+      _width = value;
+      _widthMin = min;
+      _widthMax = max;
 
       // analyze pulse period
-      value = 0, sum = 0, min = INT32_MAX, max = 0;
-
-      for (size_t i = 1; i < MYCILA_PULSE_SAMPLES; i += 2) {
-        value = instance->_widths[i] + instance->_widths[i - 1];
-        sum += value;
-        if (value < min)
-          min = value;
-        if (value > max)
-          max = value;
-      }
-
-      value = (sum << 1) / MYCILA_PULSE_SAMPLES;
+      value = periodValue;
+      min = low;
+      max = high;
 
 #ifdef MYCILA_PULSE_DEBUG
       ets_printf("DBG: value=%d\n", value);
@@ -412,71 +1404,70 @@ void ARDUINO_ISR_ATTR Mycila::PulseAnalyzer::_edgeISR(void* arg) {
 
         if ((value > MYCILA_PERIOD_52_US && value < MYCILA_PERIOD_48_US) || (value > MYCILA_PERIOD_62_US && value < MYCILA_PERIOD_58_US)) {
           // full period pulses like JSY-MK-194G
-          instance->_type = Type::TYPE_FULL_PERIOD;
+          _type = Type::TYPE_FULL_PERIOD;
           // JSY-MK-194G has a 100 us shift on the right (positif voltage point)
           // JSY-NK-194T has a 1000 us shift on the right (positif voltage point)
           // See: https://forum-photovoltaique.fr/viewtopic.php?p=798444#p798444
-          instance->_shift = instance->_shiftZC + instance->_shiftJsySignal;
+          _shift = _shiftZC + _shiftJsySignal;
 
         } else if ((value > MYCILA_SEMI_PERIOD_52_US && value < MYCILA_SEMI_PERIOD_48_US) || (value > MYCILA_SEMI_PERIOD_62_US && value < MYCILA_SEMI_PERIOD_58_US)) {
           // semi period pulses like BM1Z102FJ
-          instance->_type = Type::TYPE_SEMI_PERIOD;
-          instance->_shift = instance->_shiftZC;
+          _type = Type::TYPE_SEMI_PERIOD;
+          _shift = _shiftZC;
         }
 
       } else if ((value > MYCILA_SEMI_PERIOD_52_US && value < MYCILA_SEMI_PERIOD_48_US) || (value > MYCILA_SEMI_PERIOD_62_US && value < MYCILA_SEMI_PERIOD_58_US)) {
         // short pulses like Robodyn, ZCD from Daniel S, etc
-        instance->_type = Type::TYPE_SHORT;
-        instance->_shift = instance->_shiftZC;
+        _type = Type::TYPE_SHORT;
+        _shift = _shiftZC;
       }
 
-      if (instance->_type != Type::TYPE_UNKNOWN) {
-        instance->_period = value;
-        instance->_periodMin = min;
-        instance->_periodMax = max;
-
-        sum = 0;
-        switch (instance->_type) {
-          case Type::TYPE_FULL_PERIOD: {
-            instance->_nominalSemiPeriod = closest(PERIODS, value) >> 1;
-            sum = (instance->_shift < 0 ? 0 : instance->_nominalSemiPeriod) - instance->_shift;
-            break;
-          }
-          case Type::TYPE_SEMI_PERIOD: {
-            instance->_nominalSemiPeriod = closest(SEMI_PERIODS, value);
-            sum = (instance->_shift < 0 ? 0 : instance->_nominalSemiPeriod) - instance->_shift;
-            break;
-          }
-          case Type::TYPE_SHORT: {
-            instance->_nominalSemiPeriod = closest(SEMI_PERIODS, value);
-            if (event == Event::SIGNAL_FALLING)
-              sum = (static_cast<int16_t>(diff) >> 1) - instance->_shift; // position == middle of the pulse compensated by shift
-            else
-              sum = -(static_cast<int16_t>(diff) >> 1) - instance->_shift;
-            if (sum < 0)
-              sum += instance->_nominalSemiPeriod;
-            break;
-          }
-          default:
-            assert(false);
-            break;
-        }
+      if (_type != Type::TYPE_UNKNOWN) {
+        _period = value;
+        _periodMin = min;
+        _periodMax = max;
+        _nominalSemiPeriod = _type == Type::TYPE_FULL_PERIOD ? closest(PERIODS, value) >> 1 : closest(SEMI_PERIODS, value);
+
+        // an early detection is confirmed by the samples of the rest of the round
+        _confirm = (MYCILA_PULSE_SAMPLES - _size) >> 1;
+#if MYCILA_PULSE_TRIM_SHIFT
+        _confirmOutliers = (MYCILA_PULSE_SAMPLES / 2) >> MYCILA_PULSE_TRIM_SHIFT;
+#endif
 
-        // start ZC timer
-        gptimer_alarm_config_t alarm_cfg;
-        alarm_cfg.alarm_count = instance->_nominalSemiPeriod;
-        alarm_cfg.reload_count = 0;
-        alarm_cfg.flags.auto_reload_on_alarm = true;
-        inlined_gptimer_set_raw_count(zcTimer, sum);
-        inlined_gptimer_set_alarm_action(zcTimer, &alarm_cfg);
-        return;
+        _lock(ticks, event, latency);
+        return true;
       }
     }
 
+    // not detected yet: wait for the other samples of the round
+    if (early)
+      return true;
+
     // reset index for a next round of capture
-    instance->_size = 0;
+    increment(&_classificationFailureCount);
+    _size = 0;
 #ifdef MYCILA_PULSE_DEBUG
     ets_printf("ERR: width\n");
 #endif
   }
+
+  return true;
 }
+
+// edge ISRs of the runtime detecting analyzer and of the PulseAnalyzerT variants
+#if SOC_MCPWM_SUPPORTED
+  #define MYCILA_PULSE_VARIANT(type, frequency) \
+    template void Mycila::PulseAnalyzer::_edgeISR<type, frequency>(void* arg); \
+    template bool Mycila::PulseAnalyzer::_captureISR<type, frequency>(mcpwm_cap_channel_handle_t channel, const mcpwm_capture_event_data_t* event, void* arg);
+#else
+  #define MYCILA_PULSE_VARIANT(type, frequency) \
+    template void Mycila::PulseAnalyzer::_edgeISR<type, frequency>(void* arg);
+#endif
+
+MYCILA_PULSE_VARIANT(Mycila::PulseAnalyzer::Type::TYPE_UNKNOWN, 0)
+MYCILA_PULSE_VARIANT(Mycila::PulseAnalyzer::Type::TYPE_SHORT, 50)
+MYCILA_PULSE_VARIANT(Mycila::PulseAnalyzer::Type::TYPE_SHORT, 60)
+MYCILA_PULSE_VARIANT(Mycila::PulseAnalyzer::Type::TYPE_SEMI_PERIOD, 50)
+MYCILA_PULSE_VARIANT(Mycila::PulseAnalyzer::Type::TYPE_SEMI_PERIOD, 60)
+MYCILA_PULSE_VARIANT(Mycila::PulseAnalyzer::Type::TYPE_FULL_PERIOD, 50)
+MYCILA_PULSE_VARIANT(Mycila::PulseAnalyzer::Type::TYPE_FULL_PERIOD, 60)
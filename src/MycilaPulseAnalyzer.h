@@ -8,9 +8,27 @@
   #include <ArduinoJson.h>
 #endif
 
-#include <driver/gptimer_types.h>
-#include <hal/gpio_types.h>
+#include "MycilaPulseTimebase.h"
+#include "MycilaPulseTrace.h"
+
+#ifdef MYCILA_PULSE_SIMULATION
+  #include "MycilaPulseSimulator.h"
+#else
+  #include <driver/gptimer_types.h>
+  #include <hal/gpio_types.h>
+  #include <soc/soc_caps.h>
+  #if SOC_GPIO_SUPPORT_ETM && SOC_TIMER_SUPPORT_ETM
+    #include <esp_etm.h>
+  #endif
+  #if SOC_MCPWM_SUPPORTED
+    #include <driver/mcpwm_types.h>
+  #endif
+#endif
+
 #include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
 
 #define MYCILA_PULSE_VERSION          "3.0.11"
 #define MYCILA_PULSE_VERSION_MAJOR    3
@@ -20,6 +38,65 @@
 // sample count for analysis
 #define MYCILA_PULSE_SAMPLES 50
 
+#ifndef MYCILA_PULSE_EARLY_LOCK_SAMPLES
+  // Number of consistent samples (edges, even) after which the pulse type can be detected without waiting for all the MYCILA_PULSE_SAMPLES.
+  // The early detection is then confirmed by the samples until MYCILA_PULSE_SAMPLES, and undone if they do not match.
+  // Default to 8: 4 signal periods (40 ms with short pulses at 50 Hz instead of 250 ms). 0 to disable.
+  #define MYCILA_PULSE_EARLY_LOCK_SAMPLES 8
+#endif
+
+#ifndef MYCILA_PULSE_TRIM_SHIFT
+  // Robust average of the samples of a round of pulse analysis (trimmed mean): count / 2^x samples are dropped at each end
+  // (the lowest and the highest), so that a missed or a spurious edge does not push the average out of the grid frequency windows.
+  // An early detection is confirmed with as many mismatching samples. Default to 3: the 3 lowest and the 3 highest
+  // of the 25 period samples of a round. 0 for a plain average.
+  #define MYCILA_PULSE_TRIM_SHIFT 3
+#endif
+
+#ifndef MYCILA_PULSE_TRACKING_WINDOW
+  // Once the pulse type is detected, the moving averages are fed with the median of the last samples (odd, up to 15)
+  // instead of each sample, so that a missed or a spurious edge does not move the period and the width.
+  // The measurements are delayed by half of the window. Default to 0: disabled.
+  #define MYCILA_PULSE_TRACKING_WINDOW 0
+#endif
+
+#if MYCILA_PULSE_TRACKING_WINDOW && (!(MYCILA_PULSE_TRACKING_WINDOW & 1) || MYCILA_PULSE_TRACKING_WINDOW > 15)
+  #error "MYCILA_PULSE_TRACKING_WINDOW must be odd and up to 15"
+#endif
+
+#ifndef MYCILA_PULSE_WARM_LOCK_SAMPLES
+  // Number of samples (edges, even) matching the last learned profile after which the pulse type is detected again,
+  // after an outage or at boot with a restored profile (see setProfile()). Confirmed like an early detection.
+  // Default to 4: 2 signal periods (20 ms with short pulses at 50 Hz). 0 to disable.
+  #define MYCILA_PULSE_WARM_LOCK_SAMPLES 4
+#endif
+
+// fractional bits of the PLL period
+#define MYCILA_PULSE_PLL_FRAC_BITS 8
+
+#ifndef MYCILA_PULSE_TIMER_RESOLUTION_HZ
+  // Resolution of the watchdog and ZC timers of the analyzer, up to 40 MHz (APB clock / 2): 1, 2, 4, 5, 8, 10, 20 or 40 MHz,
+  // so that a tick is a whole number of us and ns.
+  // The edges are timed and the ZC events placed at this resolution (i.e. 25 ns at 40 MHz), see getPeriodNs().
+  // The pulse analysis, the measurements in us and a shared timebase stay at 1 MHz.
+  // Default to 1 MHz.
+  #define MYCILA_PULSE_TIMER_RESOLUTION_HZ 1000000
+#endif
+
+#if MYCILA_PULSE_TIMER_RESOLUTION_HZ % 1000000 != 0 || 1000000000 % MYCILA_PULSE_TIMER_RESOLUTION_HZ != 0 || MYCILA_PULSE_TIMER_RESOLUTION_HZ > 40000000
+  #error "MYCILA_PULSE_TIMER_RESOLUTION_HZ must be 1, 2, 4, 5, 8, 10, 20 or 40 MHz"
+#endif
+
+// timer ticks per microsecond
+#define MYCILA_PULSE_TICKS_PER_US (MYCILA_PULSE_TIMER_RESOLUTION_HZ / 1000000)
+
+#ifndef MYCILA_PULSE_EWMA_SHIFT
+  // Smoothing of the period and width measurements once the pulse type is detected.
+  // Each new sample is weighted 1 / 2^MYCILA_PULSE_EWMA_SHIFT in the moving average and variance.
+  // Default to 4 (1/16): the average follows a change of the grid frequency in about 50 periods.
+  #define MYCILA_PULSE_EWMA_SHIFT 4
+#endif
+
 #ifndef MYCILA_PULSE_ZC_SHIFT_US
   // Shift to apply when setting the zero-crossing timer.
   // By default the zero-crossing is set at the middle of the pulse.
@@ -45,6 +122,57 @@
   #define MYCILA_JSY_194_SIGNAL_SHIFT_US -100
 #endif
 
+#ifndef MYCILA_PULSE_PLL_KP_SHIFT
+  // PLL mode: proportional gain of the phase correction applied at each edge (1 / 2^x of the phase error)
+  #define MYCILA_PULSE_PLL_KP_SHIFT 2
+#endif
+
+#ifndef MYCILA_PULSE_PLL_KI_SHIFT
+  // PLL mode: integral gain of the period correction applied at each edge (1 / 2^x of the phase error), max 8
+  #define MYCILA_PULSE_PLL_KI_SHIFT 6
+#endif
+
+#ifndef MYCILA_PULSE_PLL_LOCK_US
+  // PLL mode: the PLL is considered locked when the phase error is within this range
+  #define MYCILA_PULSE_PLL_LOCK_US 100
+#endif
+
+#ifndef MYCILA_PULSE_PLL_CAPTURE_US
+  // PLL mode: above this phase error, the ZC timer is re-synchronized immediately like without PLL
+  #define MYCILA_PULSE_PLL_CAPTURE_US 1000
+#endif
+
+#ifndef MYCILA_PULSE_FILTER_TOLERANCE_SHIFT
+  // Adaptive filter: an edge is rejected when it arrives earlier than the expected time since the previous edge,
+  // minus 1 / 2^x of it (at least MYCILA_PULSE_MIN_WIDTH_US). Default to 3: 12.5%.
+  #define MYCILA_PULSE_FILTER_TOLERANCE_SHIFT 3
+#endif
+
+#ifndef MYCILA_PULSE_FILTER_MAX_REJECTS
+  // Adaptive filter: consecutive rejected edges after which the pulse profile is considered changed and learned again
+  #define MYCILA_PULSE_FILTER_MAX_REJECTS 50
+#endif
+
+#ifndef MYCILA_PULSE_LATENCY_MAX_US
+  // Latency compensation: measured ZC ISR latencies above this value are ignored (i.e. when an edge moved the ZC timer
+  // between the alarm and the ISR)
+  #define MYCILA_PULSE_LATENCY_MAX_US 200
+#endif
+
+#ifndef MYCILA_PULSE_EDGE_BUFFER_SIZE
+  // Size of the edge buffer (power of 2), 0 to disable it.
+  // When enabled, each edge is recorded by the ISR in a lock-free single-producer / single-consumer ring buffer,
+  // which can be drained from a task with peekEdges() / consumeEdges().
+  #define MYCILA_PULSE_EDGE_BUFFER_SIZE 0
+#endif
+
+#if MYCILA_PULSE_EDGE_BUFFER_SIZE > 0 && (MYCILA_PULSE_EDGE_BUFFER_SIZE & (MYCILA_PULSE_EDGE_BUFFER_SIZE - 1)) != 0
+  #error "MYCILA_PULSE_EDGE_BUFFER_SIZE must be a power of 2"
+#endif
+
+// Measure the CPU cycles spent in the edge and ZC ISRs (min / avg / max), see getEdgeISRCycles() and getZeroCrossISRCycles().
+// #define MYCILA_PULSE_ISR_CYCLES
+
 // #define MYCILA_PULSE_DEBUG
 
 namespace Mycila {
@@ -68,6 +196,102 @@ namespace Mycila {
         TYPE_FULL_PERIOD = 3,
       } Type;
 
+      typedef enum {
+        // GPIO interrupt: edges are timestamped when the ISR runs, so measurements include the interrupt latency.
+        // Available on all chips.
+        CAPTURE_GPIO = 0,
+        // GPIO interrupt + ETM: edges are latched by the timer at the pin edge through the Event Task Matrix.
+        // The interrupt latency is measured and compensated.
+        // Available on chips with GPIO ETM (ESP32-C5, C6, H2, P4).
+        CAPTURE_ETM = 1,
+        // MCPWM capture channel: edges are timestamped by the capture timer at the pin edge.
+        // Period and width are measured without the interrupt latency, but ZC events still include it.
+        // Available on chips with MCPWM (ESP32, S3, C5, C6, H2, P4).
+        CAPTURE_MCPWM = 2,
+      } Capture;
+
+      // Options of begin(): capture backend and allocation of the interrupts
+      typedef struct {
+          Capture capture = Capture::CAPTURE_GPIO;
+          // interrupt priority level of the timers and of the edge capture: 0 for the default one (low or medium), or 1 to 3
+          uint8_t priority = 0;
+          // timer interrupts shared with other peripherals (default), or dedicated CPU interrupts
+          bool shared = true;
+          // core on which the interrupts are allocated (i.e. 1 to keep them away from Wi-Fi on core 0), -1 for the core calling begin()
+          int8_t core = -1;
+      } Options;
+
+      typedef struct {
+          // time of the edge in microseconds (esp_timer_get_time(), lower 32 bits)
+          uint32_t timestamp;
+          // time since the previous edge in microseconds, capped to UINT16_MAX
+          uint16_t diff;
+          // rising or falling edge
+          Event event;
+      } Edge;
+
+      // CPU cycles spent in an ISR (MYCILA_PULSE_ISR_CYCLES)
+      typedef struct {
+          uint32_t min;
+          uint32_t max;
+          uint32_t count;
+          uint64_t total;
+          uint32_t avg() const { return count ? total / count : 0; }
+      } ISRCycles;
+
+      // Samples (us) of a round of pulse analysis, kept sorted for the trimmed mean (see MYCILA_PULSE_TRIM_SHIFT).
+      // Fixed size, integer only: a sample is inserted in O(log n) comparisons and a shift of at most n values.
+      typedef struct {
+          uint16_t values[MYCILA_PULSE_SAMPLES / 2];
+          uint16_t count;
+      } Samples;
+
+#if MYCILA_PULSE_TRACKING_WINDOW
+      // Last samples (us) once the pulse type is detected, sorted for the median, and in arrival order to drop the oldest one
+      typedef struct {
+          uint16_t values[MYCILA_PULSE_TRACKING_WINDOW];
+          uint16_t arrivals[MYCILA_PULSE_TRACKING_WINDOW];
+          uint8_t count;
+          uint8_t oldest;
+      } Window;
+#endif
+
+      // Learned pulse profile, kept across outages and restarts to detect the same signal again quickly.
+      // The shift is not part of it: it comes from the pulse type and the current setZeroCrossEventShift().
+      typedef struct {
+          Type type;
+          // nominal grid semi-period in us
+          uint16_t nominalSemiPeriod;
+          // same units as getPeriod() and getWidth()
+          uint16_t period;
+          uint16_t width;
+      } Profile;
+
+      // Measurements published together by the ISRs, see getSnapshot()
+      typedef struct {
+          // incremented each time the ISRs publish the measurements: compare it to skip unchanged snapshots
+          uint32_t generation;
+          Type type;
+          // nominal grid semi-period in us
+          uint16_t nominalSemiPeriod;
+          // same units as the getters
+          uint16_t period;
+          uint16_t periodMin;
+          uint16_t periodMax;
+          uint32_t periodVariance;
+          uint32_t periodNs;
+          uint16_t width;
+          uint16_t widthMin;
+          uint16_t widthMax;
+          uint32_t widthVariance;
+          // true if connected to the grid
+          bool isOnline() const { return period > 0; }
+      } Snapshot;
+
+      // Analyzer detecting the pulse type and the grid frequency at runtime.
+      // See PulseAnalyzerT for an analyzer specialized at compile time.
+      PulseAnalyzer() : PulseAnalyzer(_handlers<Type::TYPE_UNKNOWN, 0>()) {}
+
       typedef void (*EventCallback)(Event event, void* arg);
 
       // Callback to be called on Zero-Crossing event
@@ -102,13 +326,92 @@ namespace Mycila {
       // Call before begin(), cannot be changed after.
       void setJSY194SignalShift(uint16_t shift) { _shiftJsySignal = shift; }
 
+      // Phase-locked loop mode for the ZC timer.
+      // Instead of re-synchronizing the ZC timer on each edge, its phase and period are corrected a little at each edge.
+      // The ZC events follow the real grid frequency and the jitter of the input signal is filtered out.
+      // Call before begin(), cannot be changed after.
+      void setPLLEnabled(bool enabled) { _pll = enabled; }
+      bool isPLLEnabled() const { return _pll; }
+
+      // Adaptive filter for spurious edges.
+      // Once the pulse type is detected, each edge must not arrive before the time expected from the learned width and period,
+      // instead of only being more than MYCILA_PULSE_MIN_WIDTH_US after the previous one. Edges arriving too early, or a second
+      // edge of the same kind, are dropped without touching the timers, and the long gap after which the analysis restarts is
+      // one signal cycle later than expected instead of a fixed 48 Hz period. An edge arriving later than expected is kept for
+      // the ZC timer, but the levels around it are not measured.
+      // After MYCILA_PULSE_FILTER_MAX_REJECTS consecutive rejected edges, the pulse profile is learned again.
+      // Call before begin(), cannot be changed after.
+      void setAdaptiveFilterEnabled(bool enabled) { _filter = enabled; }
+      bool isAdaptiveFilterEnabled() const { return _filter; }
+
+      // Automatic compensation of the ZC ISR latency.
+      // The time between the ZC timer alarm and the start of the ZC ISR (interrupt dispatch, flash cache, shared interrupts...)
+      // is measured at each ZC event with the timer count, and averaged. The alarm is placed that much earlier, so that onZeroCross
+      // is called at the requested shift from the zero-crossing (setZeroCrossEventShift()), and its delay argument is the
+      // measured time to the zero-crossing instead of -shift.
+      // Call before begin(), cannot be changed after.
+      void setLatencyCompensationEnabled(bool enabled) { _compensation = enabled; }
+      bool isLatencyCompensationEnabled() const { return _compensation; }
+
+      // Latency compensation: average latency of the ZC ISR in ns, by which the ZC events are advanced (0 when disabled)
+      uint32_t getLatencyCompensation() const { return _compensationTicks * 1000 / MYCILA_PULSE_TICKS_PER_US; }
+
+      // Use a timebase shared with other analyzers (i.e. one per phase) instead of allocating 2 timers.
+      // The timebase is started by begin() if needed, and must outlive the analyzer.
+      // CAPTURE_ETM is not supported with a shared timebase.
+      // Call before begin(), cannot be changed after.
+      void setTimebase(PulseTimebase* timebase) { _timebase = timebase; }
+      PulseTimebase* getTimebase() const { return _timebase; }
+
+      // Record the raw edges seen by the edge ISR (before any filtering) in a binary trace, to replay them on a host.
+      // The recorder must outlive the analyzer, and is started and drained by the application (see PulseTraceRecorder).
+      // Call before begin(), cannot be changed after.
+      void setTraceRecorder(PulseTraceRecorder* recorder) { _trace = recorder; }
+      PulseTraceRecorder* getTraceRecorder() const { return _trace; }
+
+      // Last learned pulse profile: the current one once the detection is confirmed, otherwise the one before the last reset
+      // (outage, end()) or the one given to setProfile(). type is TYPE_UNKNOWN when there is none.
+      Profile getProfile() const;
+      // Restore a profile (i.e. saved before a reboot), so that the first edges matching it are enough to detect the pulse type.
+      // If the signal does not match, the pulse is analyzed as usual. Returns false if the profile is not valid.
+      // Call before begin(), cannot be changed after.
+      bool setProfile(const Profile& profile);
+
+#ifndef MYCILA_PULSE_SIMULATION
+      // Load the profile from NVS (Preferences namespace), and restore it with setProfile()
+      bool loadProfile(const char* name = "pulse");
+      // Save the last learned profile to NVS (Preferences namespace): i.e. when online, or before an OTA reboot.
+      // Writes only when the profile has changed.
+      bool saveProfile(const char* name = "pulse") const;
+#endif
+
       /**
        * @brief Start the analyzer
        * @param pinZC Zero-crossing pin
+       * @param capture Edge capture backend (CAPTURE_GPIO by default)
+       *
+       * @return true if the analyzer was started, false if the pin is invalid, the capture backend is not supported on this chip
+       * or the shared timebase has no free slot
+       */
+      bool begin(int8_t pinZC, Capture capture = Capture::CAPTURE_GPIO) {
+        Options options;
+        options.capture = capture;
+        return begin(pinZC, options);
+      }
+
+      /**
+       * @brief Start the analyzer with the interrupts allocated as requested
+       * @param pinZC Zero-crossing pin
+       * @param options Capture backend, interrupt priority, shared or dedicated timer interrupts, and core of the interrupts
+       *
+       * The GPIO interrupts of all the pins are served by the GPIO ISR service, installed once by the first user:
+       * its priority and core are only set if the analyzer is the first one (otherwise a warning is logged).
+       * The MCPWM capture interrupt is always shared by the MCPWM driver.
+       * A shared timebase (setTimebase()) is started with these options if it is not started yet.
        *
-       * @return true if the analyzer was started
+       * @return false in the same cases as begin(pinZC, capture), or if the core or the priority is invalid
        */
-      bool begin(int8_t pinZC);
+      bool begin(int8_t pinZC, const Options& options);
 
       /**
        * @brief Stop the analyzer
@@ -119,6 +422,10 @@ namespace Mycila {
       void toJson(const JsonObject& root) const;
 #endif
 
+      // Write the state and the counters of toJson() in a compact binary frame (see PulseTelemetry), without any allocation.
+      // Returns the size of the frame, or 0 if the buffer is too small (sizeof(PulseTelemetry::Frame)).
+      size_t toTelemetry(uint8_t* buffer, size_t size) const;
+
       // true if the analyzer is enabled and running
       bool isEnabled() const { return _pinZC != GPIO_NUM_NC; }
 
@@ -127,22 +434,42 @@ namespace Mycila {
 
       gpio_num_t getZCPin() const { return _pinZC; }
 
+      // Edge capture backend in use
+      Capture getCapture() const { return _capture; }
+
       // Pulse type detected
       Type getType() const { return _type; }
 
       // last event detected: rising or falling edge
       Event getLastEvent() const { return _lastEvent; }
 
-      // Pulse period in microseconds (average of the last N samples)
+      // Pulse period in microseconds (moving average, updated on each pulse)
       uint16_t getPeriod() const { return _period; }
       // Minimum pulse period ever seen in microseconds
       uint16_t getMinPeriod() const { return _periodMin; }
       // Maximum pulse period ever seen in microseconds
       uint16_t getMaxPeriod() const { return _periodMax; }
+      // Variance of the pulse period in us^2 (moving average, updated on each pulse)
+      uint32_t getPeriodVariance() const { return _periodVariance; }
 
       // Pulse frequency in Hz
       uint8_t getFrequency() const { return _period ? 1000000 / _period : 0; }
 
+      // Pulse period in nanoseconds, timed at MYCILA_PULSE_TIMER_RESOLUTION_HZ (moving average, updated on each pulse)
+      uint32_t getPeriodNs() const { return _periodNs; }
+      // Pulse frequency in mHz, same as getFrequency() with the resolution of getPeriodNs()
+      uint32_t getFrequencyMilliHz() const { return _periodNs ? (1000000000000ULL + (_periodNs >> 1)) / _periodNs : 0; }
+      // Measured grid frequency in mHz (i.e. 49930 for 49.93 Hz)
+      uint32_t getGridFrequencyMilliHz() const { return getGridFrequencyMilliHz(_type, _periodNs); }
+      // Measured grid frequency in mHz of a pulse type and period (i.e. from a Snapshot)
+      static uint32_t getGridFrequencyMilliHz(Type type, uint32_t periodNs) {
+        if (!periodNs)
+          return 0;
+        // periodNs is the grid period for full period pulses, and the grid semi-period for the other ones
+        const uint64_t period = type == Type::TYPE_FULL_PERIOD ? periodNs : static_cast<uint64_t>(periodNs) << 1;
+        return (1000000000000ULL + (period >> 1)) / period;
+      }
+
       // Nominal grid semi-period in microseconds
       uint16_t getNominalGridSemiPeriod() const { return _nominalSemiPeriod; }
       // Nominal grid period in microseconds
@@ -150,18 +477,167 @@ namespace Mycila {
       // Nominal grid frequency in Hz (50 Hz / 60 Hz)
       uint8_t getNominalGridFrequency() const { return _nominalSemiPeriod ? 1000000 / (_nominalSemiPeriod << 1) : 0; }
 
-      // Pulse width in microseconds (average of the last N samples)
+      // PLL mode: true when the phase error is within MYCILA_PULSE_PLL_LOCK_US
+      bool isPLLLocked() const { return _pll && _pllLocked; }
+      // PLL mode: last phase error in microseconds between the ZC timer and the signal (positive when the ZC timer is late)
+      int16_t getPLLPhaseError() const { return _pllPhaseError; }
+      // PLL mode: grid frequency followed by the ZC timer in mHz (i.e. 49930 for 49.93 Hz)
+      uint32_t getPLLFrequency() const { return _pllPeriod ? (1000000000ULL * MYCILA_PULSE_TICKS_PER_US << (MYCILA_PULSE_PLL_FRAC_BITS - 1)) / _pllPeriod : 0; }
+
+      // Shared timebase: time in microseconds from the last rising edge of the reference analyzer to the last rising edge of this one,
+      // modulo the grid period (i.e. 6667 and 13333 us at 50 Hz on a three-phase installation).
+      // TYPE_SHORT pulses do not tell the polarity of the voltage: the offset is then modulo the grid semi-period.
+      // Returns 0 if both analyzers are not online on the same timebase.
+      uint16_t getPhaseOffset(const PulseAnalyzer& reference) const;
+      // Shared timebase: same as getPhaseOffset() in degrees (i.e. 120 and 240 on a three-phase installation)
+      uint16_t getPhaseAngle(const PulseAnalyzer& reference) const;
+
+      // Pulse width in microseconds (moving average, updated on each pulse)
       uint16_t getWidth() const { return _width; }
       // Minimum pulse width ever seen in microseconds
       uint16_t getMinWidth() const { return _widthMin; }
       // Maximum pulse width ever seen in microseconds
       uint16_t getMaxWidth() const { return _widthMax; }
+      // Variance of the pulse width in us^2 (moving average, updated on each pulse)
+      uint32_t getWidthVariance() const { return _widthVariance; }
+
+      // The getters above read one field each: called one after the other from another core, they can return values of
+      // different edges (i.e. a pulse type from before a reset with the period after it).
+      // The snapshot is a copy of all the measurements of the same edge, published by the ISRs with a sequence lock:
+      // the ISRs never wait for the readers, and the reader copies again if a publish happened during the copy.
+      // Call from a task, or from an ISR which cannot preempt the ones of the analyzer.
+      Snapshot getSnapshot() const;
+      // Generation of the last published snapshot, to poll for changes without copying it
+      uint32_t getSnapshotGeneration() const { return _snapshotSequence.load(std::memory_order_acquire) >> 1; }
+
+      // Diagnostics: counters updated by the ISRs since begin() or resetDiagnostics()
+      // Edges filtered out because closer than MYCILA_PULSE_MIN_WIDTH_US to the previous one (slow slope, spike),
+      // or rejected by the adaptive filter
+      uint32_t getGlitchCount() const { return _glitchCount.load(std::memory_order_relaxed); }
+      // Edges coming after a gap longer than a 48 Hz period during the analysis (signal lost for a while)
+      uint32_t getGapCount() const { return _gapCount.load(std::memory_order_relaxed); }
+      // Edges in the same direction as the previous one (missed edge, noise)
+      uint32_t getNoiseCount() const { return _noiseCount.load(std::memory_order_relaxed); }
+      // Rounds of MYCILA_PULSE_SAMPLES edges which did not match any pulse type, or early detections undone by the next samples
+      uint32_t getClassificationFailureCount() const { return _classificationFailureCount.load(std::memory_order_relaxed); }
+      // Resets of the analysis by the watchdog, after no edge for more than 400 ms
+      uint32_t getOfflineCount() const { return _offlineCount.load(std::memory_order_relaxed); }
+      // ZC events fired
+      uint32_t getZeroCrossCount() const { return _zeroCrossCount.load(std::memory_order_relaxed); }
+
+#ifdef MYCILA_PULSE_ISR_CYCLES
+      // Diagnostics: CPU cycles spent in the edge ISR (host simulation: ns)
+      // Values are updated by the ISR while being read: for monitoring only.
+      const ISRCycles& getEdgeISRCycles() const { return _edgeISRCycles; }
+      // Diagnostics: CPU cycles spent in the ZC ISR, including the onZeroCross callback (host simulation: ns)
+      // Values are updated by the ISR while being read: for monitoring only.
+      const ISRCycles& getZeroCrossISRCycles() const { return _zcISRCycles; }
+      // Diagnostics: latency of the ZC ISR in ns, from the timer alarm to the start of the ISR.
+      // This is how late the onZeroCross callback is called: compare it across the interrupt options of begin().
+      const ISRCycles& getZeroCrossLatency() const { return _zcLatency; }
+#endif
+
+      // Diagnostics: reset the counters (and the ISR cycles).
+      // An ISR running at the same time can miss an increment.
+      void resetDiagnostics();
+
+#if MYCILA_PULSE_EDGE_BUFFER_SIZE > 0
+      // Edge buffer: number of edges waiting to be consumed
+      size_t getEdgeCount() const { return _edgeHead.load(std::memory_order_acquire) - _edgeTail.load(std::memory_order_relaxed); }
+
+      // Edge buffer: zero-copy access to the oldest edges waiting to be consumed.
+      // Sets edges to the first one and returns the number of contiguous edges available from there.
+      // Call again after consumeEdges() to get the remaining ones when the buffer wraps around.
+      // Must be called from a single consumer task.
+      size_t peekEdges(const Edge** edges) const {
+        const uint32_t tail = _edgeTail.load(std::memory_order_relaxed);
+        const uint32_t count = _edgeHead.load(std::memory_order_acquire) - tail;
+        const uint32_t index = tail & (MYCILA_PULSE_EDGE_BUFFER_SIZE - 1);
+        *edges = &_edges[index];
+        return count < MYCILA_PULSE_EDGE_BUFFER_SIZE - index ? count : MYCILA_PULSE_EDGE_BUFFER_SIZE - index;
+      }
+
+      // Edge buffer: release the count oldest edges (after peekEdges())
+      void consumeEdges(size_t count) { _edgeTail.store(_edgeTail.load(std::memory_order_relaxed) + count, std::memory_order_release); }
+
+      // Edge buffer: number of edges dropped because the buffer was full
+      uint32_t getEdgeOverflowCount() const { return _edgeOverflow.load(std::memory_order_relaxed); }
+#endif
+
+    protected:
+      // edge ISRs of a variant: TYPE_UNKNOWN and 0 for the runtime detection, or a known pulse type and grid frequency (Hz)
+      typedef struct {
+          void (*edge)(void* arg);
+#if SOC_MCPWM_SUPPORTED
+          bool (*capture)(mcpwm_cap_channel_handle_t channel, const mcpwm_capture_event_data_t* event, void* arg);
+#endif
+      } Handlers;
+
+      template <Type TYPE, uint8_t FREQUENCY>
+      static Handlers _handlers() {
+#if SOC_MCPWM_SUPPORTED
+        return {_edgeISR<TYPE, FREQUENCY>, _captureISR<TYPE, FREQUENCY>};
+#else
+        return {_edgeISR<TYPE, FREQUENCY>};
+#endif
+      }
+
+      // only the ISRs of the variant are linked
+      explicit PulseAnalyzer(const Handlers& handlers) : _edgeHandlers(handlers) {}
+
+      // ISR (instantiated in the .cpp for each variant)
+      template <Type TYPE, uint8_t FREQUENCY>
+      static void _edgeISR(void* arg);
+#if SOC_MCPWM_SUPPORTED
+      template <Type TYPE, uint8_t FREQUENCY>
+      static bool _captureISR(mcpwm_cap_channel_handle_t channel, const mcpwm_capture_event_data_t* event, void* arg);
+#endif
 
     private:
       // ISR
       static bool _onlineTimerISR(gptimer_handle_t timer, const gptimer_alarm_event_data_t* event, void* arg);
       static bool _zcTimerISR(gptimer_handle_t timer, const gptimer_alarm_event_data_t* event, void* arg);
-      static void _edgeISR(void* arg);
+      static void _onlineSlotISR(void* arg);
+      static void _zcSlotISR(void* arg);
+
+      // backend independent edge analysis (ISR)
+      // ticks: time since the previous accepted edge, in timer ticks
+      // latency: time elapsed since the edge happened, in timer ticks (0 if unknown)
+      // returns false if the edge was filtered out
+      template <Type TYPE, uint8_t FREQUENCY>
+      bool _processEdge(uint32_t ticks, Event event, uint32_t latency);
+      // pulse type detected: start tracking it and start the ZC timer from this edge (ISR)
+      void _lock(uint32_t ticks, Event event, uint32_t latency);
+      // whether the samples of the ongoing analysis match the last learned profile
+      bool _matchesProfile() const;
+
+      // edge capture backend
+      bool _begin(int8_t pinZC, const Options& options);
+#ifndef MYCILA_PULSE_SIMULATION
+      static void _beginTask(void* arg);
+#endif
+      void _startCapture();
+      void _installGPIOISRService();
+      void _stopCapture();
+      // true when the timers or the timebase slots are ready (ISR)
+      bool _isStarted() const { return _timebase ? _onlineSlot >= 0 && _zcSlot >= 0 : _onlineTimer && _zcTimer; }
+
+      // reset the analysis state (ISR safe)
+      void _reset();
+      // publish the measurements to the snapshot (ISR safe)
+      void _publish();
+      // PLL mode: correct phase and period of the ZC timer which should be at position pos (ISR)
+      void _pllSync(int32_t pos);
+      // PLL mode: grid semi-period measured by the analyzer in ticks (fixed point, MYCILA_PULSE_PLL_FRAC_BITS fractional bits)
+      uint32_t _pllMeasuredPeriod() const;
+
+      // ZC timer, dedicated or shared (ISR)
+      // count is the position in the period, the ZC event fires when it reaches the period (timer ticks)
+      void _zcStart(uint32_t count, uint32_t period);
+      void _zcSetCount(uint32_t count, uint32_t period);
+      bool _zcGetCount(uint64_t* count) const;
+      int16_t _zcMeasureLatency(uint32_t latency);
+      void _zcStop();
 
       gpio_num_t _pinZC = GPIO_NUM_NC;
 
@@ -169,16 +645,63 @@ namespace Mycila {
       gptimer_handle_t _onlineTimer = nullptr;
       gptimer_handle_t _zcTimer = nullptr;
 
+      // shared timebase (replaces the timers above)
+      PulseTimebase* _timebase = nullptr;
+      volatile int8_t _onlineSlot = -1;
+      volatile int8_t _zcSlot = -1;
+      // timebase time of the last edge, and of the last rising edge (lower 32 bits)
+      uint64_t _lastEdge = 0;
+      uint32_t _lastRising = 0;
+
+      // edge capture backend
+      Capture _capture = Capture::CAPTURE_GPIO;
+      // interrupt allocation (see Options)
+      uint8_t _priority = 0;
+      bool _shared = true;
+#if SOC_GPIO_SUPPORT_ETM && SOC_TIMER_SUPPORT_ETM
+      esp_etm_event_handle_t _etmEvent = nullptr;
+      esp_etm_task_handle_t _etmTask = nullptr;
+      esp_etm_channel_handle_t _etmChannel = nullptr;
+#endif
+#if SOC_MCPWM_SUPPORTED
+      mcpwm_cap_timer_handle_t _captureTimer = nullptr;
+      mcpwm_cap_channel_handle_t _captureChannel = nullptr;
+      uint32_t _captureTicksPerUs = 0;
+      uint32_t _lastCapture = 0;
+      // time of the last traced edge (us, 0 if none) from the capture counts, its capture count and the ticks below 1 us
+      int64_t _traceTime = 0;
+      uint32_t _traceCapture = 0;
+      uint32_t _traceRemainder = 0;
+#endif
+
       // Internal ISR variables
-      uint16_t _widths[MYCILA_PULSE_SAMPLES];
       size_t _size = 0;
+      Samples _widthSamples = {};
+      Samples _periodSamples = {};
+      // remaining period samples to confirm an early detection, and mismatching ones allowed among them
+      uint8_t _confirm = 0;
+      uint8_t _confirmOutliers = 0;
+#if MYCILA_PULSE_TRACKING_WINDOW
+      Window _widthWindow = {};
+      Window _periodWindow = {};
+#endif
+      // last learned profile
+      Profile _profile = {};
       Event _lastEvent = SIGNAL_NONE;
       Type _type = TYPE_UNKNOWN;
+      // last edge interval, used to build a period sample from the next one (us and ticks)
+      uint16_t _lastDiff = 0;
+      uint32_t _lastTicks = 0;
 
       // measured pulse period
       uint16_t _period = 0;
       uint16_t _periodMin = 0;
       uint16_t _periodMax = 0;
+      // moving average of the period (fixed point, 4 fractional bits) and variance
+      uint32_t _periodAvg = 0;
+      uint32_t _periodVariance = 0;
+      // moving average of the period in ns
+      uint32_t _periodNs = 0;
 
       // nominal values
       uint16_t _nominalSemiPeriod = 0;
@@ -187,16 +710,91 @@ namespace Mycila {
       uint16_t _width = 0;
       uint16_t _widthMin = 0;
       uint16_t _widthMax = 0;
+      // moving average of the width (fixed point, 4 fractional bits) and variance
+      uint32_t _widthAvg = 0;
+      uint32_t _widthVariance = 0;
+
+      // adaptive filter: enabled, and consecutive rejected edges
+      bool _filter = false;
+      uint8_t _filterRejects = 0;
+
+      // PLL mode
+      bool _pll = false;
+      bool _pllLocked = false;
+      // ZC timer period in ticks (fixed point, MYCILA_PULSE_PLL_FRAC_BITS fractional bits)
+      uint32_t _pllPeriod = 0;
+      // ZC timer alarm currently set, in ticks
+      uint32_t _pllAlarm = 0;
+      int16_t _pllPhaseError = 0;
+
+      // latency compensation: ticks by which the ZC timer is advanced, and their moving average (fixed point, 4 fractional bits)
+      bool _compensation = false;
+      int32_t _compensationTicks = 0;
+      uint32_t _compensationAvg = 0;
+      uint32_t _compensationVariance = 0;
 
       // shift for ZC event
       int16_t _shiftZC = MYCILA_PULSE_ZC_SHIFT_US;
       int16_t _shiftJsySignal = MYCILA_JSY_194_SIGNAL_SHIFT_US;
       int16_t _shift = 0;
 
+      // diagnostics: written by a single ISR each
+      std::atomic<uint32_t> _glitchCount{0};
+      std::atomic<uint32_t> _gapCount{0};
+      std::atomic<uint32_t> _noiseCount{0};
+      std::atomic<uint32_t> _classificationFailureCount{0};
+      std::atomic<uint32_t> _offlineCount{0};
+      std::atomic<uint32_t> _zeroCrossCount{0};
+#ifdef MYCILA_PULSE_ISR_CYCLES
+      ISRCycles _edgeISRCycles = {UINT32_MAX, 0, 0, 0};
+      ISRCycles _zcISRCycles = {UINT32_MAX, 0, 0, 0};
+      ISRCycles _zcLatency = {UINT32_MAX, 0, 0, 0};
+#endif
+
+#if MYCILA_PULSE_EDGE_BUFFER_SIZE > 0
+      // edge buffer: written by _edgeISR (head), read by a task (tail)
+      Edge _edges[MYCILA_PULSE_EDGE_BUFFER_SIZE];
+      std::atomic<uint32_t> _edgeHead{0};
+      std::atomic<uint32_t> _edgeTail{0};
+      std::atomic<uint32_t> _edgeOverflow{0};
+#endif
+
+      // snapshot of the measurements, and its sequence: odd while an ISR writes it.
+      // The edge ISR and the timer ISRs can run on different cores: the writers are serialized by a spinlock.
+      Snapshot _snapshot = {};
+      std::atomic<uint32_t> _snapshotSequence{0};
+      portMUX_TYPE _snapshotLock = portMUX_INITIALIZER_UNLOCKED;
+
+      // edge ISR and timer ISRs (ZC and watchdog) running, waited for by end().
+      // Each flag is written by ISRs which cannot preempt each other.
+      std::atomic<bool> _edgeISRRunning{false};
+      std::atomic<bool> _timerISRRunning{false};
+
+      // raw edges recorder
+      PulseTraceRecorder* _trace = nullptr;
+
       // events
       EventCallback _onEdge = nullptr;
       void* _onEdgeArg = nullptr;
       Callback _onZeroCross = nullptr;
       void* _onZeroCrossArg = nullptr;
+
+      // edge ISRs of this variant
+      const Handlers _edgeHandlers;
+  };
+
+  // Analyzer specialized at compile time for a known ZC module and grid, i.e. PulseAnalyzerT<PulseAnalyzer::Type::TYPE_SHORT, 50>.
+  // There is no pulse analysis: the ZC timer starts at the first signal cycle whose pulse width and period match the pulse type
+  // at the grid frequency, with the nominal semi-period of the grid frequency.
+  // The edge ISRs have no classification code and no runtime branch on the pulse type,
+  // and the ones of the runtime detecting analyzer are not linked if it is not used.
+  // The measurements, the PLL mode, the adaptive filter and the diagnostics work the same.
+  template <PulseAnalyzer::Type TYPE, uint8_t FREQUENCY>
+  class PulseAnalyzerT : public PulseAnalyzer {
+      static_assert(TYPE == PulseAnalyzer::Type::TYPE_SHORT || TYPE == PulseAnalyzer::Type::TYPE_SEMI_PERIOD || TYPE == PulseAnalyzer::Type::TYPE_FULL_PERIOD, "Unsupported pulse type");
+      static_assert(FREQUENCY == 50 || FREQUENCY == 60, "Unsupported grid frequency");
+
+    public:
+      PulseAnalyzerT() : PulseAnalyzer(_handlers<TYPE, FREQUENCY>()) {}
   };
 } // namespace Mycila
@@ -0,0 +1,187 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ */
+#include "MycilaPulseBurstFire.h"
+
+#ifdef MYCILA_PULSE_SIMULATION
+  // simulated gpio, timers and logging
+  #include "priv/simulated_hal.h"
+#else
+  // memory
+  #include <esp_attr.h>
+
+  // gpio
+  #include <esp32-hal-gpio.h>
+  #include <hal/gpio_ll.h>
+  #include <soc/gpio_struct.h>
+
+  // logging
+  #include <esp32-hal-log.h>
+#endif
+
+// nominal grid periods
+#include "priv/grid_periods.h"
+
+// running ISRs
+#include "priv/isr_scope.h"
+
+#ifdef MYCILA_LOGGER_SUPPORT
+  #include <MycilaLogger.h>
+extern Mycila::Logger logger;
+  #define LOGD(tag, format, ...) logger.debug(tag, format, ##__VA_ARGS__)
+  #define LOGI(tag, format, ...) logger.info(tag, format, ##__VA_ARGS__)
+  #define LOGW(tag, format, ...) logger.warn(tag, format, ##__VA_ARGS__)
+  #define LOGE(tag, format, ...) logger.error(tag, format, ##__VA_ARGS__)
+#else
+  #define LOGD(tag, format, ...) ESP_LOGD(tag, format, ##__VA_ARGS__)
+  #define LOGI(tag, format, ...) ESP_LOGI(tag, format, ##__VA_ARGS__)
+  #define LOGW(tag, format, ...) ESP_LOGW(tag, format, ##__VA_ARGS__)
+  #define LOGE(tag, format, ...) ESP_LOGE(tag, format, ##__VA_ARGS__)
+#endif
+
+#define TAG "PULSE"
+
+// more than this time since the previous ZC event: at least one is missing
+#define MYCILA_PULSE_BURST_GAP_US (MYCILA_SEMI_PERIOD_48_US + (MYCILA_SEMI_PERIOD_48_US >> 1))
+
+int8_t Mycila::PulseBurstFire::attach(int8_t pin) {
+  if (isEnabled()) {
+    LOGE(TAG, "Cannot attach output pin %d: burst fire is running", pin);
+    return -1;
+  }
+
+  if (!GPIO_IS_VALID_GPIO(pin)) {
+    LOGE(TAG, "Invalid output pin: %d", pin);
+    return -1;
+  }
+
+  if (_channels >= MYCILA_PULSE_BURST_CHANNELS) {
+    LOGE(TAG, "No burst fire channel available for pin %d", pin);
+    return -1;
+  }
+
+  const size_t channel = _channels++;
+  _pins[channel] = (gpio_num_t)pin;
+  _powers[channel].store(0, std::memory_order_relaxed);
+
+  pinMode(pin, OUTPUT);
+  gpio_ll_set_level(&GPIO, pin, 0);
+
+  return channel;
+}
+
+bool Mycila::PulseBurstFire::begin(PulseTimebase* timebase) {
+  if (isEnabled())
+    return true;
+
+  LOGI(TAG, "Enable burst fire with %d channels", static_cast<int>(_channels));
+
+  if (!timebase->begin())
+    return false;
+
+  const int8_t slot = timebase->attach(_watchdogISR, this);
+  if (slot < 0) {
+    LOGE(TAG, "No timebase slot available for the burst fire");
+    return false;
+  }
+
+  _timebase = timebase;
+  _halfCycles = 0;
+  for (size_t i = 0; i < _channels; i++)
+    _conducted[i] = 0;
+  _off();
+
+  // the ZC events start once the scheduler is ready
+  std::atomic_thread_fence(std::memory_order_release);
+  _slot = slot;
+
+  return true;
+}
+
+void Mycila::PulseBurstFire::end() {
+  if (!isEnabled())
+    return;
+
+  LOGI(TAG, "Disable burst fire");
+
+  // no new ZC event from now on: wait for the one running on the other core, then for the watchdog (see detach())
+  const int8_t slot = _slot;
+  _slot = -1;
+  waitISR(&_zcISRRunning);
+  _timebase->detach(slot);
+  _timebase = nullptr;
+
+  _off();
+}
+
+void ARDUINO_ISR_ATTR Mycila::PulseBurstFire::_off() {
+  for (size_t i = 0; i < _channels; i++) {
+    // staggered start of the modulators
+    _accumulators[i] = POWER_MAX * i / _channels;
+    _balances[i] = 0;
+    _on[i] = false;
+    gpio_ll_set_level(&GPIO, _pins[i], 0);
+  }
+  _polarity = false;
+  _lastZeroCross = 0;
+}
+
+void ARDUINO_ISR_ATTR Mycila::PulseBurstFire::onZeroCross(int16_t, void* arg) {
+  PulseBurstFire* instance = reinterpret_cast<PulseBurstFire*>(arg);
+  ISRScope scope(&instance->_zcISRRunning);
+  const int8_t slot = instance->_slot;
+  if (slot < 0)
+    return;
+  PulseTimebase* timebase = instance->_timebase;
+
+  // the watchdog does not restart the modulators in the middle
+  portENTER_CRITICAL_SAFE(&instance->_lock);
+
+  const uint64_t now = timebase->now();
+
+  // missing ZC events: the polarity of the coming half-cycle is unknown, the balance restarts
+  if (instance->_lastZeroCross && now - instance->_lastZeroCross > MYCILA_PULSE_BURST_GAP_US) {
+    for (size_t i = 0; i < instance->_channels; i++)
+      instance->_balances[i] = 0;
+  }
+  instance->_lastZeroCross = now;
+  instance->_polarity = !instance->_polarity;
+  instance->_halfCycles++;
+
+  const int8_t sign = instance->_polarity ? 1 : -1;
+
+  for (size_t i = 0; i < instance->_channels; i++) {
+    const uint16_t power = instance->_powers[i].load(std::memory_order_relaxed);
+    bool on = false;
+
+    if (power) {
+      // sigma-delta: conduct once a full half-cycle of power is accumulated, unless it breaks the polarity balance
+      const uint32_t accumulator = instance->_accumulators[i] + power;
+      const int8_t balance = instance->_balances[i] + sign;
+      on = accumulator >= POWER_MAX && balance >= -1 && balance <= 1;
+      if (on) {
+        instance->_accumulators[i] = accumulator - POWER_MAX;
+        instance->_balances[i] = balance;
+        instance->_conducted[i]++;
+      } else {
+        instance->_accumulators[i] = accumulator;
+      }
+    }
+
+    instance->_on[i] = on;
+    gpio_ll_set_level(&GPIO, instance->_pins[i], on);
+  }
+
+  // watchdog: turns off the outputs if the ZC events stop
+  timebase->schedule(slot, now + (MYCILA_SEMI_PERIOD_48_US << 1));
+
+  portEXIT_CRITICAL_SAFE(&instance->_lock);
+}
+
+void ARDUINO_ISR_ATTR Mycila::PulseBurstFire::_watchdogISR(void* arg) {
+  PulseBurstFire* instance = reinterpret_cast<PulseBurstFire*>(arg);
+  portENTER_CRITICAL_SAFE(&instance->_lock);
+  instance->_off();
+  portEXIT_CRITICAL_SAFE(&instance->_lock);
+}
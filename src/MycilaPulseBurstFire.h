@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ */
+#pragma once
+
+#include "MycilaPulseTimebase.h"
+
+#ifndef MYCILA_PULSE_SIMULATION
+  #include <hal/gpio_types.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#ifndef MYCILA_PULSE_BURST_CHANNELS
+  // Maximum number of output channels of a burst fire scheduler
+  #define MYCILA_PULSE_BURST_CHANNELS 4
+#endif
+
+namespace Mycila {
+  // Burst fire (cycle skipping) of several outputs driving zero-cross SSRs, from the ZC events of a PulseAnalyzer.
+  //
+  // At each ZC event, each output is turned on or off for the coming half-cycle: the SSR switches at the next zero-crossing,
+  // so the ZC event must come before it (negative shift, see MYCILA_PULSE_ZC_SHIFT_US).
+  // The half-cycles are chosen by a first order sigma-delta modulator per output (integer, O(1) per output and half-cycle),
+  // which spreads them as evenly as possible to limit the flicker. The modulators of the outputs start staggered, so that
+  // outputs with the same power do not switch together.
+  // A half-cycle is postponed to the next one when it would make the output conduct 2 more half-cycles of a polarity than
+  // of the other one, so that there is no DC component.
+  // If the ZC events stop, the outputs are turned off after 2 semi-periods.
+  class PulseBurstFire {
+    public:
+      // Power of an output always on
+      static constexpr uint16_t POWER_MAX = UINT16_MAX;
+
+      ~PulseBurstFire() { end(); }
+
+      // Add an output channel: returns its index, or -1 if all the channels are taken.
+      // The output starts off.
+      // Call before begin(), cannot be changed after.
+      int8_t attach(int8_t pin);
+
+      // Number of output channels
+      size_t getChannelCount() const { return _channels; }
+
+      /**
+       * @brief Start the scheduler
+       * @param timebase Timebase used to turn the outputs off when the ZC events stop, started if needed. It can be shared with the analyzers.
+       *
+       * Then register the ZC event of the analyzer:
+       * pulseAnalyzer.onZeroCross(Mycila::PulseBurstFire::onZeroCross, &burst);
+       *
+       * @return true if the scheduler was started, false if the timebase has no free slot
+       */
+      bool begin(PulseTimebase* timebase);
+
+      /**
+       * @brief Stop the scheduler and turn off all the outputs, once the ZC event and the watchdog still running on the other core are done
+       */
+      void end();
+
+      // true if the scheduler is running
+      bool isEnabled() const { return _slot >= 0; }
+
+      // Set the power of an output, as the fraction of the half-cycles conducted (0 = off, POWER_MAX = always on).
+      // Can be called from any task or ISR: the new value is used from the next ZC event.
+      void setPower(uint8_t channel, uint16_t power) { _powers[channel].store(power, std::memory_order_relaxed); }
+      uint16_t getPower(uint8_t channel) const { return _powers[channel].load(std::memory_order_relaxed); }
+
+      // true if the output conducts during the current half-cycle
+      bool isOn(uint8_t channel) const { return _on[channel]; }
+
+      // Half-cycles conducted by an output since begin()
+      uint32_t getConductedCount(uint8_t channel) const { return _conducted[channel]; }
+
+      // Half-cycles (ZC events) since begin()
+      uint32_t getHalfCycleCount() const { return _halfCycles; }
+
+      // Half-cycles of one polarity minus the ones of the other polarity conducted by an output: -1, 0 or 1.
+      // The polarity is not known: it is reset when ZC events are missing.
+      int8_t getBalance(uint8_t channel) const { return _balances[channel]; }
+
+      // ZC event callback of a PulseAnalyzer (ISR), with the scheduler as argument
+      static void onZeroCross(int16_t delay, void* arg);
+
+    private:
+      // timebase slot callback (ISR): no ZC event for 2 semi-periods
+      static void _watchdogISR(void* arg);
+
+      // turn off all the outputs and restart the modulators (ISR)
+      void _off();
+
+      PulseTimebase* _timebase = nullptr;
+      // set last by begin() and first by end(): the ZC event does nothing when -1
+      volatile int8_t _slot = -1;
+      // ZC event running, for end()
+      std::atomic<bool> _zcISRRunning{false};
+      // modulators and outputs, shared by the ZC event and the watchdog
+      portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+      gpio_num_t _pins[MYCILA_PULSE_BURST_CHANNELS];
+      size_t _channels = 0;
+
+      // power requested by the application
+      std::atomic<uint16_t> _powers[MYCILA_PULSE_BURST_CHANNELS];
+
+      // sigma-delta modulator: accumulated power not conducted yet, and polarity balance
+      uint32_t _accumulators[MYCILA_PULSE_BURST_CHANNELS];
+      int8_t _balances[MYCILA_PULSE_BURST_CHANNELS];
+      bool _on[MYCILA_PULSE_BURST_CHANNELS];
+      uint32_t _conducted[MYCILA_PULSE_BURST_CHANNELS];
+
+      // polarity of the coming half-cycle, relative to the first one
+      bool _polarity = false;
+      uint32_t _halfCycles = 0;
+      uint64_t _lastZeroCross = 0;
+  };
+} // namespace Mycila
@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ */
+#include "MycilaPulseDimmer.h"
+
+#ifdef MYCILA_PULSE_SIMULATION
+  // simulated gpio, timers and logging
+  #include "priv/simulated_hal.h"
+#else
+  // memory
+  #include <esp_attr.h>
+
+  // gpio
+  #include <esp32-hal-gpio.h>
+  #include <hal/gpio_ll.h>
+  #include <soc/gpio_struct.h>
+
+  // logging
+  #include <esp32-hal-log.h>
+#endif
+
+// nominal grid periods
+#include "priv/grid_periods.h"
+
+// running ISRs
+#include "priv/isr_scope.h"
+
+#ifdef MYCILA_LOGGER_SUPPORT
+  #include <MycilaLogger.h>
+extern Mycila::Logger logger;
+  #define LOGD(tag, format, ...) logger.debug(tag, format, ##__VA_ARGS__)
+  #define LOGI(tag, format, ...) logger.info(tag, format, ##__VA_ARGS__)
+  #define LOGW(tag, format, ...) logger.warn(tag, format, ##__VA_ARGS__)
+  #define LOGE(tag, format, ...) logger.error(tag, format, ##__VA_ARGS__)
+#else
+  #define LOGD(tag, format, ...) ESP_LOGD(tag, format, ##__VA_ARGS__)
+  #define LOGI(tag, format, ...) ESP_LOGI(tag, format, ##__VA_ARGS__)
+  #define LOGW(tag, format, ...) ESP_LOGW(tag, format, ##__VA_ARGS__)
+  #define LOGE(tag, format, ...) ESP_LOGE(tag, format, ##__VA_ARGS__)
+#endif
+
+#define TAG "PULSE"
+
+int8_t Mycila::PulseDimmer::attach(int8_t pin) {
+  if (isEnabled()) {
+    LOGE(TAG, "Cannot attach output pin %d: dimmer is running", pin);
+    return -1;
+  }
+
+  if (!GPIO_IS_VALID_GPIO(pin)) {
+    LOGE(TAG, "Invalid output pin: %d", pin);
+    return -1;
+  }
+
+  if (_channels >= MYCILA_PULSE_DIMMER_CHANNELS) {
+    LOGE(TAG, "No dimmer channel available for pin %d", pin);
+    return -1;
+  }
+
+  const size_t channel = _channels++;
+  _pins[channel] = (gpio_num_t)pin;
+  _commands[channel].store(DELAY_OFF, std::memory_order_relaxed);
+  _delays[channel] = DELAY_OFF;
+
+  pinMode(pin, OUTPUT);
+  gpio_ll_set_level(&GPIO, pin, 0);
+
+  return channel;
+}
+
+bool Mycila::PulseDimmer::begin(PulseTimebase* timebase) {
+  if (isEnabled())
+    return true;
+
+  LOGI(TAG, "Enable dimmer with %d channels", static_cast<int>(_channels));
+
+  if (!timebase->begin())
+    return false;
+
+  const int8_t slot = timebase->attach(_fireISR, this);
+  if (slot < 0) {
+    LOGE(TAG, "No timebase slot available for the dimmer");
+    return false;
+  }
+
+  _timebase = timebase;
+  _firingCount = 0;
+  _nextFiring = 0;
+  _lastZeroCross = 0;
+  _semiPeriod = 0;
+
+  // the ZC events start once the dimmer is ready
+  std::atomic_thread_fence(std::memory_order_release);
+  _slot = slot;
+
+  return true;
+}
+
+void Mycila::PulseDimmer::end() {
+  if (!isEnabled())
+    return;
+
+  LOGI(TAG, "Disable dimmer");
+
+  // no new ZC event from now on: wait for the one running on the other core, then for the firings (see detach())
+  const int8_t slot = _slot;
+  _slot = -1;
+  waitISR(&_zcISRRunning);
+  _timebase->detach(slot);
+  _timebase = nullptr;
+
+  _off();
+}
+
+void ARDUINO_ISR_ATTR Mycila::PulseDimmer::_off() {
+  _firingCount = 0;
+  _nextFiring = 0;
+  for (size_t i = 0; i < _channels; i++) {
+    _delays[i] = DELAY_OFF;
+    gpio_ll_set_level(&GPIO, _pins[i], 0);
+  }
+}
+
+void ARDUINO_ISR_ATTR Mycila::PulseDimmer::onZeroCross(int16_t delay, void* arg) {
+  PulseDimmer* instance = reinterpret_cast<PulseDimmer*>(arg);
+  ISRScope scope(&instance->_zcISRRunning);
+  const int8_t slot = instance->_slot;
+  if (slot < 0)
+    return;
+  PulseTimebase* timebase = instance->_timebase;
+
+  // the firing ISR does not walk the firings while they are rebuilt
+  portENTER_CRITICAL_SAFE(&instance->_lock);
+
+  // the real zero-crossing happens delay us from now
+  const uint64_t zc = timebase->now() + delay;
+
+  const uint64_t diff = zc - instance->_lastZeroCross;
+  instance->_lastZeroCross = zc;
+  if (diff >= MYCILA_SEMI_PERIOD_62_US && diff <= MYCILA_SEMI_PERIOD_48_US)
+    instance->_semiPeriod = diff;
+
+  timebase->cancel(slot);
+  instance->_firingCount = 0;
+  instance->_nextFiring = 0;
+
+  const uint16_t semiPeriod = instance->_semiPeriod;
+
+  // the next ZC event turns off the outputs: later firings are skipped, as well as all the firings until the semi-period is known
+  const uint16_t limit = delay > 0 && delay < semiPeriod ? semiPeriod - delay : semiPeriod;
+
+  for (size_t i = 0; i < instance->_channels; i++) {
+    const uint32_t command = instance->_commands[i].load(std::memory_order_relaxed);
+
+    uint16_t firing = command;
+    if (command & COMMAND_DUTY) {
+      // conduction angle to firing delay
+      const uint32_t duty = command & DUTY_MAX;
+      if (duty == DUTY_MAX)
+        firing = 0;
+      else if (duty == 0)
+        firing = DELAY_OFF;
+      else
+        firing = semiPeriod - ((semiPeriod * duty) >> 16);
+    }
+
+    if (firing && firing < MYCILA_PULSE_DIMMER_MIN_DELAY_US)
+      firing = MYCILA_PULSE_DIMMER_MIN_DELAY_US;
+    if (firing >= limit)
+      firing = DELAY_OFF;
+    instance->_delays[i] = firing;
+
+    if (firing == 0) {
+      // full conduction
+      gpio_ll_set_level(&GPIO, instance->_pins[i], 1);
+      continue;
+    }
+
+    gpio_ll_set_level(&GPIO, instance->_pins[i], 0);
+
+    if (firing == DELAY_OFF)
+      continue;
+
+    // insertion in the sorted list of firings
+    const uint64_t at = zc + firing;
+    size_t j = instance->_firingCount++;
+    for (; j > 0 && instance->_firings[j - 1].at > at; j--)
+      instance->_firings[j] = instance->_firings[j - 1];
+    instance->_firings[j].at = at;
+    instance->_firings[j].channel = i;
+  }
+
+  if (instance->_firingCount)
+    timebase->schedule(slot, instance->_firings[0].at);
+  else if (semiPeriod)
+    // watchdog: turns off the outputs in full conduction if the ZC events stop
+    timebase->schedule(slot, zc + (semiPeriod << 1));
+
+  portEXIT_CRITICAL_SAFE(&instance->_lock);
+}
+
+void ARDUINO_ISR_ATTR Mycila::PulseDimmer::_fireISR(void* arg) {
+  PulseDimmer* instance = reinterpret_cast<PulseDimmer*>(arg);
+  // called until detach() returns: the timebase is still set
+  PulseTimebase* timebase = instance->_timebase;
+  const int8_t slot = instance->_slot;
+
+  portENTER_CRITICAL_SAFE(&instance->_lock);
+  const uint64_t now = timebase->now();
+
+  // fire all the outputs due
+  while (instance->_nextFiring < instance->_firingCount && instance->_firings[instance->_nextFiring].at <= now) {
+    gpio_ll_set_level(&GPIO, instance->_pins[instance->_firings[instance->_nextFiring].channel], 1);
+    instance->_nextFiring++;
+  }
+
+  if (instance->_nextFiring < instance->_firingCount) {
+    timebase->schedule(slot, instance->_firings[instance->_nextFiring].at);
+
+  } else if (now >= instance->_lastZeroCross + (instance->_semiPeriod << 1)) {
+    // no ZC event for 2 semi-periods
+    instance->_semiPeriod = 0;
+    instance->_off();
+
+  } else {
+    // watchdog: turns off the outputs if the ZC events stop
+    timebase->schedule(slot, instance->_lastZeroCross + (instance->_semiPeriod << 1));
+  }
+  portEXIT_CRITICAL_SAFE(&instance->_lock);
+}
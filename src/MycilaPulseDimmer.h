@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ */
+#pragma once
+
+#include "MycilaPulseTimebase.h"
+
+#ifndef MYCILA_PULSE_SIMULATION
+  #include <hal/gpio_types.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#ifndef MYCILA_PULSE_DIMMER_CHANNELS
+  // Maximum number of output channels of a dimmer
+  #define MYCILA_PULSE_DIMMER_CHANNELS 4
+#endif
+
+#ifndef MYCILA_PULSE_DIMMER_MIN_DELAY_US
+  // Minimum delay after the zero-crossing to reach the voltage required for the gate current.
+  // delay_us = asin((gate_resistor * gate_current) / grid_volt_max) / pi * semi_period_us
+  // delay_us = asin((330 * 0.03) / 325) / pi * 10000 = 97 us
+  #define MYCILA_PULSE_DIMMER_MIN_DELAY_US 100
+#endif
+
+namespace Mycila {
+  // Phase control of several outputs (thyristors, triacs) from the ZC events of a PulseAnalyzer, with a single timer.
+  //
+  // At each ZC event, the outputs are turned off and their firings are sorted by time.
+  // A single slot of a PulseTimebase is then scheduled for the next firing only, which turns the output on
+  // until the next ZC event. If the ZC events stop, the outputs are turned off after 2 semi-periods.
+  // The ZC event and the firings can run on different cores: the firings are protected by a spinlock.
+  class PulseDimmer {
+    public:
+      // Duty cycle of a full conduction
+      static constexpr uint16_t DUTY_MAX = UINT16_MAX;
+
+      // Firing delay keeping the output off
+      static constexpr uint16_t DELAY_OFF = UINT16_MAX;
+
+      ~PulseDimmer() { end(); }
+
+      // Add an output channel: returns its index, or -1 if all the channels are taken.
+      // The output starts off.
+      // Call before begin(), cannot be changed after.
+      int8_t attach(int8_t pin);
+
+      // Number of output channels
+      size_t getChannelCount() const { return _channels; }
+
+      /**
+       * @brief Start the dimmer
+       * @param timebase Timebase used to fire the outputs, started if needed. It can be shared with the analyzers.
+       *
+       * Then register the ZC event of the analyzer:
+       * pulseAnalyzer.onZeroCross(Mycila::PulseDimmer::onZeroCross, &dimmer);
+       *
+       * @return true if the dimmer was started, false if the timebase has no free slot
+       */
+      bool begin(PulseTimebase* timebase);
+
+      /**
+       * @brief Stop the dimmer and turn off all the outputs, once the ZC event and the firings still running on the other core are done
+       */
+      void end();
+
+      // true if the dimmer is running
+      bool isEnabled() const { return _slot >= 0; }
+
+      // Semi-period measured between the last ZC events, in us (0 if unknown)
+      uint16_t getSemiPeriod() const { return _semiPeriod; }
+
+      // Set the firing delay of an output after the zero-crossing, in us.
+      // 0 is a full conduction, a delay longer than the semi-period (DELAY_OFF) keeps the output off.
+      // Delays ending after the next ZC event (see MYCILA_PULSE_ZC_SHIFT_US) also keep the output off.
+      // Delays shorter than MYCILA_PULSE_DIMMER_MIN_DELAY_US are postponed to MYCILA_PULSE_DIMMER_MIN_DELAY_US.
+      // Can be called from any task or ISR: the new value is used from the next ZC event.
+      void setFiringDelay(uint8_t channel, uint16_t delay) { _commands[channel].store(delay, std::memory_order_relaxed); }
+
+      // Set the conduction angle of an output, as a fraction of the semi-period (0 = off, DUTY_MAX = full conduction).
+      // The firing delay is computed at each ZC event from the measured semi-period.
+      // Can be called from any task or ISR: the new value is used from the next ZC event.
+      void setDutyCycle(uint8_t channel, uint16_t duty) { _commands[channel].store(COMMAND_DUTY | duty, std::memory_order_relaxed); }
+
+      // Firing delay of an output at the last ZC event in us, DELAY_OFF if the output was kept off
+      uint16_t getFiringDelay(uint8_t channel) const { return _delays[channel]; }
+
+      // ZC event callback of a PulseAnalyzer (ISR), with the dimmer as argument
+      static void onZeroCross(int16_t delay, void* arg);
+
+    private:
+      // command flag: the value is a duty cycle, not a firing delay
+      static constexpr uint32_t COMMAND_DUTY = 0x10000;
+
+      typedef struct {
+          // timebase time of the firing
+          uint64_t at;
+          uint8_t channel;
+      } Firing;
+
+      // timebase slot callback (ISR): fire the outputs due, then schedule the next firing
+      static void _fireISR(void* arg);
+
+      // turn off all the outputs (ISR)
+      void _off();
+
+      PulseTimebase* _timebase = nullptr;
+      // set last by begin() and first by end(): the ZC event does nothing when -1
+      volatile int8_t _slot = -1;
+      // ZC event running, for end()
+      std::atomic<bool> _zcISRRunning{false};
+      // firings, semi-period and outputs, shared by the ZC event and the firing ISR
+      portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+      gpio_num_t _pins[MYCILA_PULSE_DIMMER_CHANNELS];
+      size_t _channels = 0;
+
+      // firing delay or duty cycle (COMMAND_DUTY) requested by the application
+      std::atomic<uint32_t> _commands[MYCILA_PULSE_DIMMER_CHANNELS];
+      // firing delays applied at the last ZC event
+      uint16_t _delays[MYCILA_PULSE_DIMMER_CHANNELS];
+
+      // firings of the current semi-period, sorted by time
+      Firing _firings[MYCILA_PULSE_DIMMER_CHANNELS];
+      size_t _firingCount = 0;
+      size_t _nextFiring = 0;
+
+      uint64_t _lastZeroCross = 0;
+      uint16_t _semiPeriod = 0;
+  };
+} // namespace Mycila
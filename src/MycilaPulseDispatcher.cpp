@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ */
+#include "MycilaPulseDispatcher.h"
+
+#ifdef MYCILA_PULSE_SIMULATION
+  // simulated clock and logging
+  #include "priv/simulated_hal.h"
+#else
+  // memory
+  #include <esp_attr.h>
+
+  // logging
+  #include <esp32-hal-log.h>
+
+  // time
+  #include <esp_timer.h>
+#endif
+
+#ifdef MYCILA_LOGGER_SUPPORT
+  #include <MycilaLogger.h>
+extern Mycila::Logger logger;
+  #define LOGD(tag, format, ...) logger.debug(tag, format, ##__VA_ARGS__)
+  #define LOGI(tag, format, ...) logger.info(tag, format, ##__VA_ARGS__)
+  #define LOGW(tag, format, ...) logger.warn(tag, format, ##__VA_ARGS__)
+  #define LOGE(tag, format, ...) logger.error(tag, format, ##__VA_ARGS__)
+#else
+  #define LOGD(tag, format, ...) ESP_LOGD(tag, format, ##__VA_ARGS__)
+  #define LOGI(tag, format, ...) ESP_LOGI(tag, format, ##__VA_ARGS__)
+  #define LOGW(tag, format, ...) ESP_LOGW(tag, format, ##__VA_ARGS__)
+  #define LOGE(tag, format, ...) ESP_LOGE(tag, format, ##__VA_ARGS__)
+#endif
+
+#define TAG "PULSE"
+
+bool Mycila::PulseDispatcher::begin(Handler handler, void* arg, uint32_t stackSize, uint8_t priority, int8_t core) {
+  if (isEnabled())
+    return true;
+
+  if (!handler)
+    return false;
+
+  LOGI(TAG, "Enable dispatcher with %d slots", MYCILA_PULSE_DISPATCHER_SLOTS);
+
+  _head.store(0, std::memory_order_relaxed);
+  _tail.store(0, std::memory_order_relaxed);
+  _sequence.store(0, std::memory_order_relaxed);
+  _dropped.store(0, std::memory_order_relaxed);
+  _batches.store(0, std::memory_order_relaxed);
+  _reportedDropped = 0;
+
+#ifndef MYCILA_PULSE_SIMULATION
+  TaskHandle_t task = nullptr;
+  if (xTaskCreatePinnedToCore(_run, "pulse_dispatch", stackSize, this, priority, &task, core < 0 ? tskNO_AFFINITY : core) != pdPASS) {
+    LOGE(TAG, "Failed to create the dispatcher task");
+    return false;
+  }
+  _task = task;
+#endif
+
+  // the task exists: the ISR callbacks can post and wake it
+  _handlerArg = arg;
+  _handler = handler;
+
+#ifdef MYCILA_PULSE_SIMULATION
+  (void)stackSize;
+  (void)priority;
+  (void)core;
+#endif
+
+  return true;
+}
+
+void Mycila::PulseDispatcher::end() {
+  if (!isEnabled())
+    return;
+
+  LOGI(TAG, "Disable dispatcher");
+
+  // the ISR callbacks stop posting, and the task exits once woken
+  _handler = nullptr;
+
+  // the posts which saw the handler can still notify the task: wait for them on the other core before it exits
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  while (_posting.load(std::memory_order_acquire))
+    continue;
+
+#ifndef MYCILA_PULSE_SIMULATION
+  TaskHandle_t task = _task;
+  if (task) {
+    xTaskNotifyGive(task);
+    while (_task)
+      vTaskDelay(1);
+  }
+#endif
+}
+
+size_t Mycila::PulseDispatcher::dispatch() {
+  const Handler handler = _handler;
+  if (!handler)
+    return 0;
+
+  size_t total = 0;
+  uint32_t tail = _tail.load(std::memory_order_relaxed);
+  uint32_t head;
+
+  // the handler reads the events in place: the slots are released after it returns
+  while ((head = _head.load(std::memory_order_seq_cst)) != tail) {
+    const uint32_t index = tail & (MYCILA_PULSE_DISPATCHER_SLOTS - 1);
+    uint32_t count = head - tail;
+    if (count > MYCILA_PULSE_DISPATCHER_SLOTS - index)
+      count = MYCILA_PULSE_DISPATCHER_SLOTS - index;
+
+    const uint32_t dropped = _dropped.load(std::memory_order_relaxed) - _reportedDropped;
+    _reportedDropped += dropped;
+
+    handler(&_slots[index], count, dropped, _handlerArg);
+
+    tail += count;
+    _tail.store(tail, std::memory_order_seq_cst);
+    _batches.store(_batches.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    total += count;
+  }
+
+  return total;
+}
+
+#ifndef MYCILA_PULSE_SIMULATION
+void Mycila::PulseDispatcher::_run(void* arg) {
+  PulseDispatcher* instance = reinterpret_cast<PulseDispatcher*>(arg);
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    // end()
+    if (!instance->_handler)
+      break;
+    instance->dispatch();
+  }
+  instance->_task = nullptr;
+  vTaskDelete(NULL);
+}
+#endif
+
+void ARDUINO_ISR_ATTR Mycila::PulseDispatcher::onEdge(PulseAnalyzer::Event event, void* arg) {
+  reinterpret_cast<PulseDispatcher*>(arg)->_post(Kind::EVENT_EDGE, event, 0);
+}
+
+void ARDUINO_ISR_ATTR Mycila::PulseDispatcher::onZeroCross(int16_t delay, void* arg) {
+  reinterpret_cast<PulseDispatcher*>(arg)->_post(Kind::EVENT_ZERO_CROSS, PulseAnalyzer::Event::SIGNAL_NONE, delay);
+}
+
+void ARDUINO_ISR_ATTR Mycila::PulseDispatcher::_post(Kind kind, PulseAnalyzer::Event edge, int16_t delay) {
+  // counted before checking the handler, so that end() sees this post or this post sees end()
+  _posting.fetch_add(1, std::memory_order_seq_cst);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (_handler)
+    _enqueue(kind, edge, delay);
+  _posting.fetch_sub(1, std::memory_order_release);
+}
+
+void ARDUINO_ISR_ATTR Mycila::PulseDispatcher::_enqueue(Kind kind, PulseAnalyzer::Event edge, int16_t delay) {
+  const uint32_t timestamp = esp_timer_get_time();
+  bool wake = false;
+
+  // the edge and ZC ISRs of several analyzers can post to the same dispatcher, at different interrupt levels
+  portENTER_CRITICAL_SAFE(&_lock);
+  const uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+  _sequence.store(sequence + 1, std::memory_order_relaxed);
+  const uint32_t head = _head.load(std::memory_order_relaxed);
+  if (head - _tail.load(std::memory_order_acquire) >= MYCILA_PULSE_DISPATCHER_SLOTS) {
+    _dropped.store(_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  } else {
+    Event* slot = &_slots[head & (MYCILA_PULSE_DISPATCHER_SLOTS - 1)];
+    slot->sequence = sequence;
+    slot->timestamp = timestamp;
+    slot->kind = kind;
+    slot->edge = edge;
+    slot->delay = delay;
+    _head.store(head + 1, std::memory_order_seq_cst);
+    // the task had released all the slots before this event: it is idle, or about to be
+    wake = _tail.load(std::memory_order_seq_cst) == head;
+  }
+  portEXIT_CRITICAL_SAFE(&_lock);
+
+#ifndef MYCILA_PULSE_SIMULATION
+  TaskHandle_t task = _task;
+  if (wake && task) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(task, &woken);
+    portYIELD_FROM_ISR(woken);
+  }
+#else
+  (void)wake;
+#endif
+}
@@ -0,0 +1,133 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ */
+#pragma once
+
+#include "MycilaPulseAnalyzer.h"
+
+#ifndef MYCILA_PULSE_SIMULATION
+  #include <freertos/FreeRTOS.h>
+  #include <freertos/task.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#ifndef MYCILA_PULSE_DISPATCHER_SLOTS
+  // Number of event slots of a dispatcher (power of 2).
+  // Events posted while all the slots wait for the handler task are dropped and counted.
+  // Default to 32: about 100 ms of edges and ZC events of a short pulse signal at 50 Hz.
+  #define MYCILA_PULSE_DISPATCHER_SLOTS 32
+#endif
+
+#if (MYCILA_PULSE_DISPATCHER_SLOTS & (MYCILA_PULSE_DISPATCHER_SLOTS - 1)) != 0
+  #error "MYCILA_PULSE_DISPATCHER_SLOTS must be a power of 2"
+#endif
+
+namespace Mycila {
+  // Deferred delivery of the edge and ZC events of one or several analyzers to a handler task.
+  //
+  // The ISR callbacks of the dispatcher only copy the event to a preallocated slot, and wake the handler task
+  // with a direct-to-task notification when it was idle. The task then calls the handler with all the pending events
+  // at once, so the handler is regular code (not in IRAM) which can block, log, publish...
+  // Events keep their order and are numbered: a gap in the sequence numbers is the number of events dropped there.
+  class PulseDispatcher {
+    public:
+      typedef enum {
+        EVENT_EDGE = 0,
+        EVENT_ZERO_CROSS = 1,
+      } Kind;
+
+      typedef struct {
+          // sequence number of the event, counting the dropped ones
+          uint32_t sequence;
+          // time of the event (lower 32 bits of esp_timer_get_time(), us)
+          uint32_t timestamp;
+          Kind kind;
+          // EVENT_EDGE: SIGNAL_RISING or SIGNAL_FALLING
+          PulseAnalyzer::Event edge;
+          // EVENT_ZERO_CROSS: delay of the real zero-crossing from the timestamp, in us (see PulseAnalyzer::Callback)
+          int16_t delay;
+      } Event;
+
+      // Called from the handler task with count events (count > 0), in order.
+      // dropped: events dropped since the previous call, because all the slots were taken.
+      typedef void (*Handler)(const Event* events, size_t count, uint32_t dropped, void* arg);
+
+      ~PulseDispatcher() { end(); }
+
+      /**
+       * @brief Start the handler task
+       * @param handler Handler of the events
+       * @param arg Argument of the handler
+       * @param stackSize Stack size of the handler task in bytes
+       * @param priority Priority of the handler task
+       * @param core Core of the handler task, -1 for any
+       *
+       * Then register the ISR callbacks of the dispatcher in the analyzers, before starting them:
+       * pulseAnalyzer.onEdge(Mycila::PulseDispatcher::onEdge, &dispatcher);
+       * pulseAnalyzer.onZeroCross(Mycila::PulseDispatcher::onZeroCross, &dispatcher);
+       *
+       * In the host simulation, there is no task: call dispatch() instead.
+       *
+       * @return true if the dispatcher was started, false if the task could not be created
+       */
+      bool begin(Handler handler, void* arg = nullptr, uint32_t stackSize = 4096, uint8_t priority = 1, int8_t core = -1);
+
+      /**
+       * @brief Stop the handler task once its current call of the handler returns. Pending events are discarded.
+       * Must not be called from the handler.
+       */
+      void end();
+
+      // true if the dispatcher is running
+      bool isEnabled() const { return _handler != nullptr; }
+
+      // Call the handler with the pending events: returns the number of events handled.
+      // Called by the handler task, or by the application in the host simulation.
+      size_t dispatch();
+
+      // Events posted (including the dropped ones), dropped, and calls of the handler
+      uint32_t getPostedCount() const { return _sequence.load(std::memory_order_relaxed); }
+      uint32_t getDroppedCount() const { return _dropped.load(std::memory_order_relaxed); }
+      uint32_t getBatchCount() const { return _batches.load(std::memory_order_relaxed); }
+
+      // Edge event callback of a PulseAnalyzer (ISR), with the dispatcher as argument
+      static void onEdge(PulseAnalyzer::Event event, void* arg);
+
+      // ZC event callback of a PulseAnalyzer (ISR), with the dispatcher as argument
+      static void onZeroCross(int16_t delay, void* arg);
+
+    private:
+      // post the event while the dispatcher is running (ISR)
+      void _post(Kind kind, PulseAnalyzer::Event edge, int16_t delay);
+      // copy the event to the next slot and wake the task if it was idle (ISR)
+      void _enqueue(Kind kind, PulseAnalyzer::Event edge, int16_t delay);
+
+#ifndef MYCILA_PULSE_SIMULATION
+      static void _run(void* arg);
+
+      TaskHandle_t volatile _task = nullptr;
+#endif
+
+      Handler volatile _handler = nullptr;
+      void* _handlerArg = nullptr;
+      // posts in progress (ISRs of several analyzers, maybe nested): end() waits for them before the task exits
+      std::atomic<uint32_t> _posting{0};
+
+      // slots: written by the ISRs (head, under the lock), released by the handler task (tail)
+      Event _slots[MYCILA_PULSE_DISPATCHER_SLOTS];
+      std::atomic<uint32_t> _head{0};
+      std::atomic<uint32_t> _tail{0};
+      portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+      std::atomic<uint32_t> _sequence{0};
+      std::atomic<uint32_t> _dropped{0};
+      std::atomic<uint32_t> _batches{0};
+      // dropped count at the previous call of the handler
+      uint32_t _reportedDropped = 0;
+  };
+} // namespace Mycila
@@ -0,0 +1,232 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ */
+#include "MycilaPulseGridAnalytics.h"
+
+#include <string.h>
+
+// deviation covered by the buckets below the nominal frequency, in mHz
+#define HISTOGRAM_HALF ((MYCILA_PULSE_ANALYTICS_HISTOGRAM_BUCKETS >> 1) * MYCILA_PULSE_ANALYTICS_HISTOGRAM_STEP_MHZ)
+
+// fractional bits of the asymmetry average: the truncation of each step stays below 16 ns
+#define ASYMMETRY_FRAC_BITS 12
+
+Mycila::PulseGridAnalytics::PulseGridAnalytics() {
+  // 500 ms, 1 s, 2 s... up to 64 s
+  for (size_t i = 0; i < MYCILA_PULSE_ANALYTICS_WINDOWS; i++)
+    _windows[i].window.length = 500 << (i < 7 ? i : 7);
+  reset();
+}
+
+void Mycila::PulseGridAnalytics::setWindow(size_t index, uint16_t length) {
+  if (index >= MYCILA_PULSE_ANALYTICS_WINDOWS || !length)
+    return;
+  State* state = &_windows[index];
+  state->window = {length, 0, 0, 0};
+  state->start = 0;
+  state->cycles = 0;
+  // the window starts again from the next falling edge, the other ones keep running
+  if (_started)
+    state->cycles = UINT32_MAX;
+}
+
+int32_t Mycila::PulseGridAnalytics::getAsymmetry() const {
+  const int32_t asymmetry = static_cast<int64_t>(_asymmetry) * 1000 / (1 << ASYMMETRY_FRAC_BITS);
+  return _type == PulseAnalyzer::Type::TYPE_SHORT && asymmetry < 0 ? -asymmetry : asymmetry;
+}
+
+int32_t Mycila::PulseGridAnalytics::getDCOffset() const {
+  // asymmetry = 2 asin(offset / peak) / pi of the period: offset / peak ~= pi / 2 * asymmetry / period
+  const int64_t frequency = getFrequency();
+  return static_cast<int64_t>(getAsymmetry()) * frequency * 15708 / 10000000000LL;
+}
+
+void Mycila::PulseGridAnalytics::reset() {
+  for (size_t i = 0; i < MYCILA_PULSE_ANALYTICS_WINDOWS; i++)
+    _windows[i].window = {_windows[i].window.length, 0, 0, 0};
+  memset(_histogram, 0, sizeof(_histogram));
+  _nominal = 0;
+  _asymmetry = 0;
+  _restarts = 0;
+  _restart(PulseAnalyzer::Type::TYPE_UNKNOWN);
+}
+
+void Mycila::PulseGridAnalytics::_restart(PulseAnalyzer::Type type) {
+  // the frequency of a window cut by a gap is unknown, and so is the RoCoF with the next one
+  for (size_t i = 0; i < MYCILA_PULSE_ANALYTICS_WINDOWS; i++) {
+    _windows[i].window.frequency = 0;
+    _windows[i].window.rocof = 0;
+  }
+  _type = type;
+  _lastEvent = PulseAnalyzer::Event::SIGNAL_NONE;
+  _started = false;
+  _low = 0;
+  _high = 0;
+  _lastCenter = 0;
+  _lastInterval = 0;
+  _odd = false;
+  _aligned = false;
+}
+
+void Mycila::PulseGridAnalytics::add(const PulseAnalyzer::Edge& edge, PulseAnalyzer::Type type) {
+  // a level half longer than the last one of the same kind: whole signal cycles were lost, but the edges still alternate
+  const uint16_t last = edge.event == PulseAnalyzer::Event::SIGNAL_RISING ? _low : _high;
+  const bool lost = edge.diff == UINT16_MAX || (last && edge.diff > last + (last >> 1));
+
+  // pulse type changed, gap, lost cycles or missed edge: the cycles are restarted from this edge
+  if (type != _type || lost || edge.event == _lastEvent) {
+    if (_lastEvent != PulseAnalyzer::Event::SIGNAL_NONE)
+      _restarts++;
+    _restart(type);
+  }
+  if (type == PulseAnalyzer::Type::TYPE_UNKNOWN || lost)
+    return;
+  _lastEvent = edge.event;
+
+  // a signal cycle is a low level followed by a high level, complete at the falling edge
+  if (edge.event == PulseAnalyzer::Event::SIGNAL_RISING) {
+    _low = edge.diff;
+    return;
+  }
+
+  const uint32_t now = edge.timestamp;
+  const uint16_t high = edge.diff;
+  const uint16_t low = _low;
+  _high = high;
+
+  // middle of the pulse, in 2x us: the zero-crossing for TYPE_SHORT pulses
+  const uint32_t center = (now << 1) - high;
+
+  if (!_started) {
+    for (size_t i = 0; i < MYCILA_PULSE_ANALYTICS_WINDOWS; i++) {
+      _windows[i].start = now;
+      _windows[i].cycles = 0;
+    }
+    _started = true;
+    _lastCenter = center;
+    return;
+  }
+
+  // mHz x us of a signal cycle: a semi-period for short pulses, 1 period, or 2 periods for full period pulses
+  const uint64_t cycle = _type == PulseAnalyzer::Type::TYPE_SHORT ? 500000000ULL : (_type == PulseAnalyzer::Type::TYPE_FULL_PERIOD ? 2000000000ULL : 1000000000ULL);
+
+  for (size_t i = 0; i < MYCILA_PULSE_ANALYTICS_WINDOWS; i++) {
+    State* state = &_windows[i];
+
+    // window length changed: restart it from this edge
+    if (state->cycles == UINT32_MAX) {
+      state->start = now;
+      state->cycles = 0;
+      continue;
+    }
+
+    state->cycles++;
+    const uint32_t duration = now - state->start;
+    if (duration < static_cast<uint32_t>(state->window.length) * 1000)
+      continue;
+
+    const uint32_t frequency = state->cycles * cycle / duration;
+    if (state->window.frequency) {
+      const int64_t rocof = static_cast<int64_t>(static_cast<int32_t>(frequency - state->window.frequency)) * 1000000 / duration;
+      state->window.rocof = rocof;
+      const uint32_t magnitude = rocof < 0 ? -rocof : rocof;
+      if (magnitude > state->window.rocofMax)
+        state->window.rocofMax = magnitude;
+    }
+    state->window.frequency = frequency;
+    state->start = now;
+    state->cycles = 0;
+
+    // deviation histogram, fed by the first window
+    if (i == 0) {
+      _nominal = frequency < 55000 ? 50000 : 60000;
+      const int32_t offset = static_cast<int32_t>(frequency - _nominal) + HISTOGRAM_HALF;
+      size_t bucket = offset < 0 ? 0 : offset / MYCILA_PULSE_ANALYTICS_HISTOGRAM_STEP_MHZ;
+      if (bucket >= MYCILA_PULSE_ANALYTICS_HISTOGRAM_BUCKETS)
+        bucket = MYCILA_PULSE_ANALYTICS_HISTOGRAM_BUCKETS - 1;
+      _histogram[bucket]++;
+    }
+  }
+
+  // half-cycle asymmetry sample in us, with ASYMMETRY_FRAC_BITS fractional bits
+  int32_t sample = 0;
+  bool sampled = false;
+  switch (_type) {
+    case PulseAnalyzer::Type::TYPE_SEMI_PERIOD:
+      // the high and low levels are the 2 half-cycles
+      if (low) {
+        sample = (static_cast<int32_t>(high) - low) * (1 << ASYMMETRY_FRAC_BITS);
+        sampled = true;
+      }
+      break;
+    case PulseAnalyzer::Type::TYPE_SHORT: {
+      // consecutive semi-periods between the middles of the pulses: every other one is positive
+      const uint32_t interval = center - _lastCenter;
+      if (_lastInterval) {
+        // 2x us to us
+        sample = static_cast<int32_t>(interval - _lastInterval) * (1 << (ASYMMETRY_FRAC_BITS - 1));
+        if (!_odd)
+          sample = -sample;
+        // the polarity is unknown after a restart: keep the one of the average
+        if (!_aligned) {
+          if ((sample < 0) != (_asymmetry < 0)) {
+            sample = -sample;
+            _odd = !_odd;
+          }
+          _aligned = true;
+        }
+        sampled = true;
+      }
+      _lastInterval = interval;
+      _odd = !_odd;
+      break;
+    }
+    default:
+      break;
+  }
+  _lastCenter = center;
+
+  if (sampled)
+    _asymmetry += (sample - _asymmetry) / (1 << MYCILA_PULSE_ANALYTICS_ASYMMETRY_SHIFT);
+}
+
+#if MYCILA_PULSE_EDGE_BUFFER_SIZE > 0
+size_t Mycila::PulseGridAnalytics::update(PulseAnalyzer& analyzer) {
+  const PulseAnalyzer::Type type = analyzer.getType();
+  const PulseAnalyzer::Edge* edges;
+  size_t total = 0;
+  size_t count;
+  while ((count = analyzer.peekEdges(&edges)) > 0) {
+    for (size_t i = 0; i < count; i++)
+      add(edges[i], type);
+    analyzer.consumeEdges(count);
+    total += count;
+  }
+  return total;
+}
+#endif
+
+#ifdef MYCILA_JSON_SUPPORT
+void Mycila::PulseGridAnalytics::toJson(const JsonObject& root) const {
+  root["frequency"] = getFrequency();
+  root["rocof"] = getRoCoF();
+  JsonArray windows = root["windows"].to<JsonArray>();
+  for (size_t i = 0; i < MYCILA_PULSE_ANALYTICS_WINDOWS; i++) {
+    const Window& window = _windows[i].window;
+    JsonObject json = windows.add<JsonObject>();
+    json["length"] = window.length;
+    json["frequency"] = window.frequency;
+    json["rocof"] = window.rocof;
+    json["rocof_max"] = window.rocofMax;
+  }
+  root["histogram"]["nominal"] = _nominal;
+  root["histogram"]["step"] = MYCILA_PULSE_ANALYTICS_HISTOGRAM_STEP_MHZ;
+  JsonArray buckets = root["histogram"]["buckets"].to<JsonArray>();
+  for (size_t i = 0; i < MYCILA_PULSE_ANALYTICS_HISTOGRAM_BUCKETS; i++)
+    buckets.add(_histogram[i]);
+  root["asymmetry"] = getAsymmetry();
+  root["dc_offset"] = getDCOffset();
+  root["restarts"] = _restarts;
+}
+#endif
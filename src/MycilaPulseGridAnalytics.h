@@ -0,0 +1,148 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ */
+#pragma once
+
+#ifdef MYCILA_JSON_SUPPORT
+  #include <ArduinoJson.h>
+#endif
+
+#include "MycilaPulseAnalyzer.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef MYCILA_PULSE_ANALYTICS_WINDOWS
+  // Number of windows over which the frequency and its rate of change (RoCoF) are computed.
+  // Default to 3: 500 ms, 1 s and 2 s (see setWindow()).
+  #define MYCILA_PULSE_ANALYTICS_WINDOWS 3
+#endif
+
+#ifndef MYCILA_PULSE_ANALYTICS_HISTOGRAM_BUCKETS
+  // Number of buckets of the frequency deviation histogram (even), centered on the nominal frequency.
+  // The first and the last buckets also count the deviations beyond them.
+  #define MYCILA_PULSE_ANALYTICS_HISTOGRAM_BUCKETS 16
+#endif
+
+#ifndef MYCILA_PULSE_ANALYTICS_HISTOGRAM_STEP_MHZ
+  // Width of a bucket of the frequency deviation histogram, in mHz.
+  // Default to 25 mHz: from -200 mHz to +200 mHz with 16 buckets.
+  #define MYCILA_PULSE_ANALYTICS_HISTOGRAM_STEP_MHZ 25
+#endif
+
+#ifndef MYCILA_PULSE_ANALYTICS_ASYMMETRY_SHIFT
+  // Smoothing of the half-cycle asymmetry: each new cycle is weighted 1 / 2^x in the moving average.
+  // The asymmetry is much smaller than the jitter of the edges, so it needs a long average.
+  // Default to 8 (1/256): about 5 s at 50 Hz.
+  #define MYCILA_PULSE_ANALYTICS_ASYMMETRY_SHIFT 8
+#endif
+
+#if MYCILA_PULSE_ANALYTICS_WINDOWS < 1 || MYCILA_PULSE_ANALYTICS_HISTOGRAM_BUCKETS < 2 || (MYCILA_PULSE_ANALYTICS_HISTOGRAM_BUCKETS & 1)
+  #error "MYCILA_PULSE_ANALYTICS_WINDOWS must be at least 1 and MYCILA_PULSE_ANALYTICS_HISTOGRAM_BUCKETS must be even"
+#endif
+
+namespace Mycila {
+  // Grid quality analytics computed in a task from the edges recorded by a PulseAnalyzer (see MYCILA_PULSE_EDGE_BUFFER_SIZE):
+  // - the mean grid frequency and its rate of change (RoCoF) over several windows,
+  // - a histogram of the deviation of the frequency from the nominal one,
+  // - the asymmetry between the positive and the negative half-cycles, which hints at a DC offset on the grid.
+  //
+  // The cost per edge is bounded (a few operations per window) and the memory is fixed.
+  // Not thread safe: add(), update() and the getters must be called from the same task.
+  class PulseGridAnalytics {
+    public:
+      typedef struct {
+          // window length in ms
+          uint16_t length;
+          // mean grid frequency over the last complete window in mHz (0 if unknown)
+          uint32_t frequency;
+          // rate of change of the frequency between the last 2 complete windows in mHz/s
+          int32_t rocof;
+          // largest absolute RoCoF seen in mHz/s
+          uint32_t rocofMax;
+      } Window;
+
+      PulseGridAnalytics();
+
+      // Set the length of a window in ms (i.e. 500 ms for the RoCoF of ENTSO-E), which restarts its measurement.
+      // The histogram is fed by the frequencies of the first window.
+      void setWindow(size_t index, uint16_t length);
+      const Window& getWindow(size_t index) const { return _windows[index].window; }
+
+      // Mean grid frequency over the last complete first window in mHz (0 if unknown)
+      uint32_t getFrequency() const { return _windows[0].window.frequency; }
+      // RoCoF over the first window in mHz/s
+      int32_t getRoCoF() const { return _windows[0].window.rocof; }
+
+      // Frequency deviation histogram: number of first windows per bucket.
+      // Bucket i counts the deviations from (i - MYCILA_PULSE_ANALYTICS_HISTOGRAM_BUCKETS / 2) * MYCILA_PULSE_ANALYTICS_HISTOGRAM_STEP_MHZ
+      // included to the next bucket excluded, relative to the nominal frequency (50 or 60 Hz).
+      const uint32_t* getHistogram() const { return _histogram; }
+      // Nominal frequency of the histogram in mHz (0 if unknown)
+      uint32_t getNominalFrequency() const { return _nominal; }
+
+      // Difference between the positive and the negative half-cycles in ns (moving average).
+      // Positive when the high level of a TYPE_SEMI_PERIOD signal is longer.
+      // TYPE_SHORT pulses do not tell the polarity: the difference between 2 consecutive semi-periods is then always positive.
+      // TYPE_FULL_PERIOD pulses last a whole period: always 0.
+      int32_t getAsymmetry() const;
+      // DC offset of the grid voltage estimated from the asymmetry, in ppm of the peak voltage (i.e. 1000 for 0.325 V on a 230 V grid).
+      // The zero-crossing detection threshold of the ZC module also adds some asymmetry: this is a hint, to compare over time.
+      int32_t getDCOffset() const;
+
+      // Analysis restarts after a gap, a missed edge or lost signal cycles (a level half longer than the previous one) in the signal
+      uint32_t getRestartCount() const { return _restarts; }
+
+      // Feed an edge of a PulseAnalyzer, with the pulse type detected by the analyzer
+      void add(const PulseAnalyzer::Edge& edge, PulseAnalyzer::Type type);
+
+#if MYCILA_PULSE_EDGE_BUFFER_SIZE > 0
+      // Drain the edge buffer of the analyzer and feed all its edges. Returns the number of edges processed.
+      // The analyzer edge buffer must not be consumed by another task.
+      size_t update(PulseAnalyzer& analyzer);
+#endif
+
+      // Clear all the results, the histogram and the maximums
+      void reset();
+
+#ifdef MYCILA_JSON_SUPPORT
+      void toJson(const JsonObject& root) const;
+#endif
+
+    private:
+      typedef struct {
+          Window window;
+          // timestamp of the falling edge starting the window, and full signal cycles since then
+          uint32_t start;
+          uint32_t cycles;
+      } State;
+
+      // restart the windows and the half-cycle tracking from the next edge
+      void _restart(PulseAnalyzer::Type type);
+
+      State _windows[MYCILA_PULSE_ANALYTICS_WINDOWS];
+
+      uint32_t _histogram[MYCILA_PULSE_ANALYTICS_HISTOGRAM_BUCKETS];
+      uint32_t _nominal = 0;
+
+      // moving average of the half-cycle asymmetry in us (fixed point, 12 fractional bits)
+      int32_t _asymmetry = 0;
+
+      PulseAnalyzer::Type _type = PulseAnalyzer::Type::TYPE_UNKNOWN;
+      PulseAnalyzer::Event _lastEvent = PulseAnalyzer::Event::SIGNAL_NONE;
+      // windows started from a falling edge
+      bool _started = false;
+      // duration of the last low and high levels in us (0 if unknown)
+      uint16_t _low = 0;
+      uint16_t _high = 0;
+      // TYPE_SHORT: middle of the last pulse (2x us), last semi-period (2x us) and parity of the semi-periods
+      uint32_t _lastCenter = 0;
+      uint32_t _lastInterval = 0;
+      bool _odd = false;
+      // TYPE_SHORT: parity of the semi-periods aligned on the average after a restart
+      bool _aligned = false;
+
+      uint32_t _restarts = 0;
+  };
+} // namespace Mycila
@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ */
+#include "MycilaPulsePower.h"
+
+// minimum firing delay
+#include "MycilaPulseDimmer.h"
+
+#include <stddef.h>
+
+#define LUT_SIZE  ((1 << MYCILA_PULSE_POWER_LUT_BITS) + 1)
+#define LUT_SHIFT (16 - MYCILA_PULSE_POWER_LUT_BITS)
+
+namespace {
+  constexpr double PI = 3.14159265358979323846;
+
+  // sine, from its Taylor series: x in [0, 2 pi]
+  constexpr double sine(double x) {
+    if (x > PI)
+      x -= 2 * PI;
+    double term = x;
+    double sum = x;
+    for (int n = 1; n < 12; n++) {
+      term *= -x * x / ((2 * n) * (2 * n + 1));
+      sum += term;
+    }
+    return sum;
+  }
+
+  // fraction of the full power delivered to a resistive load with a firing angle a (0 to pi)
+  constexpr double power(double a) { return 1 - a / PI + sine(2 * a) / (2 * PI); }
+
+  // firing angle delivering the fraction p of the full power, by bisection (the power decreases with the angle)
+  constexpr double angle(double p) {
+    double lo = 0;
+    double hi = PI;
+    for (int i = 0; i < 40; i++) {
+      const double mid = (lo + hi) / 2;
+      if (power(mid) > p)
+        lo = mid;
+      else
+        hi = mid;
+    }
+    return (lo + hi) / 2;
+  }
+
+  // firing delays as a fraction of the semi-period (UINT16_MAX: whole semi-period), from no power (entry 0) to full power
+  typedef struct {
+      uint16_t delays[LUT_SIZE];
+  } Table;
+
+  constexpr Table table() {
+    Table t = {};
+    for (size_t i = 0; i < LUT_SIZE; i++)
+      t.delays[i] = static_cast<uint16_t>(angle(static_cast<double>(i) / (LUT_SIZE - 1)) / PI * UINT16_MAX + 0.5);
+    return t;
+  }
+
+  constexpr Table TABLE = table();
+
+  static_assert(TABLE.delays[0] == UINT16_MAX, "no power at the end of the semi-period");
+  static_assert(TABLE.delays[LUT_SIZE - 1] == 0, "full power at the zero-crossing");
+  static_assert(TABLE.delays[(LUT_SIZE - 1) / 2] >= UINT16_MAX >> 1 && TABLE.delays[(LUT_SIZE - 1) / 2] <= (UINT16_MAX >> 1) + 1, "half power at the middle of the semi-period");
+} // namespace
+
+uint16_t Mycila::PulsePower::getFiringDelay(uint16_t semiPeriod, uint16_t power, bool compensate) {
+  if (power == 0)
+    return semiPeriod;
+  if (power == POWER_MAX)
+    return 0;
+
+  // linear interpolation between 2 entries, the delays decrease with the power
+  const uint32_t i = power >> LUT_SHIFT;
+  const uint32_t frac = power & ((1 << LUT_SHIFT) - 1);
+  const uint32_t delay = TABLE.delays[i] - (((TABLE.delays[i] - TABLE.delays[i + 1]) * frac + (1 << (LUT_SHIFT - 1))) >> LUT_SHIFT);
+
+  const uint16_t firing = (delay * semiPeriod + (UINT16_MAX >> 1)) / UINT16_MAX;
+
+  // less than 0.002% of the full power is delivered within MYCILA_PULSE_DIMMER_MIN_DELAY_US of a zero-crossing at 50 Hz:
+  // the firing delays can be moved out without noticeable power change
+  if (compensate) {
+    if (firing < MYCILA_PULSE_DIMMER_MIN_DELAY_US)
+      return MYCILA_PULSE_DIMMER_MIN_DELAY_US;
+    if (firing > semiPeriod - MYCILA_PULSE_DIMMER_MIN_DELAY_US)
+      return semiPeriod - MYCILA_PULSE_DIMMER_MIN_DELAY_US;
+  }
+
+  return firing;
+}
@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ */
+#pragma once
+
+#include <stdint.h>
+
+#ifndef MYCILA_PULSE_POWER_LUT_BITS
+  // Resolution of the power table: 2^bits + 1 entries (2 bytes each), linearly interpolated in between.
+  // Default to 10: 1025 entries, the delivered power is within 0.1% of the requested one.
+  #define MYCILA_PULSE_POWER_LUT_BITS 10
+#endif
+
+namespace Mycila {
+  // Firing delays delivering a fraction of the full power to a resistive load in phase control.
+  //
+  // With a firing angle a (0 to pi), the power is: P(a) = 1 - a / pi + sin(2a) / (2 pi), which is not linear in a.
+  // The inverse of P is tabulated at compile time (constexpr) as a fraction of the semi-period, which fits all the grid frequencies,
+  // and looked up with integer math only, so that a control loop does not have to run asin / acos inversions in float.
+  class PulsePower {
+    public:
+      // Full power
+      static constexpr uint16_t POWER_MAX = UINT16_MAX;
+
+      /**
+       * @brief Get the firing delay delivering a fraction of the full power
+       * @param semiPeriod Semi-period of the grid in us (see PulseAnalyzer::getNominalGridSemiPeriod())
+       * @param power Fraction of the full power, from 0 (off) to POWER_MAX (full conduction)
+       * @param compensate Keep the firing delays between MYCILA_PULSE_DIMMER_MIN_DELAY_US after the zero-crossing and MYCILA_PULSE_DIMMER_MIN_DELAY_US
+       * before the next one, where the voltage is too low to fire (the power delivered there is negligible)
+       * @return The firing delay after the zero-crossing in us: 0 for a full conduction, the semi-period for no conduction
+       */
+      static uint16_t getFiringDelay(uint16_t semiPeriod, uint16_t power, bool compensate = false);
+  };
+} // namespace Mycila
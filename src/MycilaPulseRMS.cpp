@@ -0,0 +1,438 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ */
+#include "MycilaPulseRMS.h"
+
+#ifdef MYCILA_PULSE_SIMULATION
+  // simulated clock and logging
+  #include "priv/simulated_hal.h"
+#else
+  // memory
+  #include <esp_attr.h>
+
+  // logging
+  #include <esp32-hal-log.h>
+
+  // time
+  #include <esp_timer.h>
+#endif
+
+#include <inttypes.h>
+#include <math.h>
+
+// running ISRs
+#include "priv/isr_scope.h"
+
+#ifdef MYCILA_LOGGER_SUPPORT
+  #include <MycilaLogger.h>
+extern Mycila::Logger logger;
+  #define LOGD(tag, format, ...) logger.debug(tag, format, ##__VA_ARGS__)
+  #define LOGI(tag, format, ...) logger.info(tag, format, ##__VA_ARGS__)
+  #define LOGW(tag, format, ...) logger.warn(tag, format, ##__VA_ARGS__)
+  #define LOGE(tag, format, ...) logger.error(tag, format, ##__VA_ARGS__)
+#else
+  #define LOGD(tag, format, ...) ESP_LOGD(tag, format, ##__VA_ARGS__)
+  #define LOGI(tag, format, ...) ESP_LOGI(tag, format, ##__VA_ARGS__)
+  #define LOGW(tag, format, ...) ESP_LOGW(tag, format, ##__VA_ARGS__)
+  #define LOGE(tag, format, ...) ESP_LOGE(tag, format, ##__VA_ARGS__)
+#endif
+
+#define TAG "PULSE"
+
+// the task of the pipeline checks the grid at least this often without ZC events, to stop the source (ms)
+#define MYCILA_PULSE_RMS_IDLE_MS 100
+
+#if defined(CONFIG_IDF_TARGET_ESP32) || defined(CONFIG_IDF_TARGET_ESP32S2)
+  #define MYCILA_PULSE_RMS_ADC_FORMAT ADC_DIGI_OUTPUT_FORMAT_TYPE1
+  #define MYCILA_PULSE_RMS_ADC_DATA(p) ((p)->type1.data)
+#else
+  #define MYCILA_PULSE_RMS_ADC_FORMAT ADC_DIGI_OUTPUT_FORMAT_TYPE2
+  #define MYCILA_PULSE_RMS_ADC_DATA(p) ((p)->type2.data)
+#endif
+
+// clock of the synthetic source in ns
+static inline uint64_t now() {
+#ifdef MYCILA_PULSE_SIMULATION
+  return Mycila::PulseSimulator::now();
+#else
+  return static_cast<uint64_t>(esp_timer_get_time()) * 1000ULL;
+#endif
+}
+
+// floor(sqrt(value))
+static uint32_t isqrt(uint64_t value) {
+  uint64_t root = 0;
+  uint64_t bit = 1ULL << 62;
+  while (bit > value)
+    bit >>= 2;
+  while (bit) {
+    if (value >= root + bit) {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return static_cast<uint32_t>(root);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// PulseADCSource
+///////////////////////////////////////////////////////////////////////////
+
+#if !defined(MYCILA_PULSE_SIMULATION) && SOC_ADC_DMA_SUPPORTED
+Mycila::PulseADCSource::~PulseADCSource() { stop(); }
+
+bool Mycila::PulseADCSource::start(uint32_t rate) {
+  // new driver: the conversions of the previous rate are discarded with it
+  stop();
+
+  if (rate < SOC_ADC_SAMPLE_FREQ_THRES_LOW || rate > SOC_ADC_SAMPLE_FREQ_THRES_HIGH)
+    return false;
+
+  adc_unit_t unit;
+  adc_channel_t channel;
+  if (adc_continuous_io_to_channel(_pin, &unit, &channel) != ESP_OK || unit != ADC_UNIT_1) {
+    LOGE(TAG, "Invalid ADC1 pin: %d", _pin);
+    return false;
+  }
+
+  adc_continuous_handle_cfg_t handleConfig = {};
+  handleConfig.max_store_buf_size = MYCILA_PULSE_RMS_ADC_BUFFER;
+  handleConfig.conv_frame_size = MYCILA_PULSE_RMS_CHUNK * SOC_ADC_DIGI_RESULT_BYTES;
+  esp_err_t err = adc_continuous_new_handle(&handleConfig, &_handle);
+  if (err != ESP_OK) {
+    LOGE(TAG, "Failed to create the continuous ADC driver: %s", esp_err_to_name(err));
+    _handle = nullptr;
+    return false;
+  }
+
+  adc_digi_pattern_config_t pattern = {};
+  pattern.atten = _attenuation;
+  pattern.channel = channel;
+  pattern.unit = unit;
+  pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+
+  adc_continuous_config_t config = {};
+  config.pattern_num = 1;
+  config.adc_pattern = &pattern;
+  config.sample_freq_hz = rate;
+  config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  config.format = MYCILA_PULSE_RMS_ADC_FORMAT;
+
+  err = adc_continuous_config(_handle, &config);
+  if (err == ESP_OK)
+    err = adc_continuous_start(_handle);
+  if (err != ESP_OK) {
+    LOGE(TAG, "Failed to start the continuous ADC driver: %s", esp_err_to_name(err));
+    adc_continuous_deinit(_handle);
+    _handle = nullptr;
+    return false;
+  }
+
+  return true;
+}
+
+void Mycila::PulseADCSource::stop() {
+  if (!_handle)
+    return;
+  adc_continuous_stop(_handle);
+  adc_continuous_deinit(_handle);
+  _handle = nullptr;
+}
+
+size_t Mycila::PulseADCSource::read(uint16_t* samples, size_t count) {
+  if (!_handle)
+    return 0;
+
+  if (count > MYCILA_PULSE_RMS_CHUNK)
+    count = MYCILA_PULSE_RMS_CHUNK;
+
+  uint8_t buffer[MYCILA_PULSE_RMS_CHUNK * SOC_ADC_DIGI_RESULT_BYTES];
+  uint32_t length = 0;
+  if (adc_continuous_read(_handle, buffer, count * SOC_ADC_DIGI_RESULT_BYTES, &length, 0) != ESP_OK)
+    return 0;
+
+  size_t n = 0;
+  for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES)
+    samples[n++] = MYCILA_PULSE_RMS_ADC_DATA(reinterpret_cast<const adc_digi_output_data_t*>(&buffer[i]));
+  return n;
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////
+// PulseSyntheticSource
+///////////////////////////////////////////////////////////////////////////
+
+void Mycila::PulseSyntheticSource::setSignal(uint16_t offset, uint16_t amplitude, uint32_t frequency, uint64_t zero, int8_t harmonic) {
+  _offset = offset;
+  _amplitude = amplitude;
+  _frequency = frequency;
+  _zero = zero;
+  _harmonic = harmonic;
+}
+
+bool Mycila::PulseSyntheticSource::start(uint32_t rate) {
+  if (!rate)
+    return false;
+  _rate = rate;
+  _start = now();
+  _read = 0;
+  return true;
+}
+
+size_t Mycila::PulseSyntheticSource::read(uint16_t* samples, size_t count) {
+  if (!_rate)
+    return 0;
+
+  // samples converted since start(): sample i is taken at _start + i / rate
+  const uint64_t converted = (now() - _start) * _rate / 1000000000ULL;
+  const double omega = 2 * M_PI * _frequency / 1000.0;
+  const double harmonic = _harmonic / 100.0;
+
+  size_t n = 0;
+  for (; n < count && _read < converted; n++, _read++) {
+    const double t = (static_cast<double>(static_cast<int64_t>(_start - _zero)) + _read * 1e9 / _rate) * 1e-9;
+    const double value = round(_offset + _amplitude * (sin(omega * t) + harmonic * sin(3 * omega * t)));
+    samples[n] = value < 0 ? 0 : (value > 4095 ? 4095 : static_cast<uint16_t>(value));
+  }
+  return n;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// PulseRMS
+///////////////////////////////////////////////////////////////////////////
+
+bool Mycila::PulseRMS::begin(PulseAnalyzer* analyzer, PulseSampleSource* source, uint32_t stackSize, uint8_t priority, int8_t core) {
+  if (isEnabled())
+    return true;
+
+  if (!analyzer || !source)
+    return false;
+
+  LOGI(TAG, "Enable RMS pipeline with %" PRIu16 " samples per cycle", _samplesPerCycle);
+
+  _analyzer = analyzer;
+  _zeroCrosses.store(0, std::memory_order_relaxed);
+  _cycleStart = 0;
+  _rate = 0;
+  _restarts = 0;
+  _unsupported = 0;
+  _accumulator = {0, 0, 0, UINT16_MAX, 0};
+  _published.store(0, std::memory_order_relaxed);
+
+  // the task exits as soon as there is no source
+  _source = source;
+
+#ifndef MYCILA_PULSE_SIMULATION
+  TaskHandle_t task = nullptr;
+  if (xTaskCreatePinnedToCore(_run, "pulse_rms", stackSize, this, priority, &task, core < 0 ? tskNO_AFFINITY : core) != pdPASS) {
+    LOGE(TAG, "Failed to create the RMS pipeline task");
+    _source = nullptr;
+    return false;
+  }
+  _task = task;
+#else
+  (void)stackSize;
+  (void)priority;
+  (void)core;
+#endif
+
+  return true;
+}
+
+void Mycila::PulseRMS::end() {
+  if (!isEnabled())
+    return;
+
+  LOGI(TAG, "Disable RMS pipeline");
+
+  PulseSampleSource* source = _source;
+  _source = nullptr;
+
+  // a ZC event which saw the source can still notify the task: wait for it on the other core before the task exits
+  waitISR(&_zcISRRunning);
+
+#ifndef MYCILA_PULSE_SIMULATION
+  TaskHandle_t task = _task;
+  if (task) {
+    xTaskNotifyGive(task);
+    while (_task)
+      vTaskDelay(1);
+  }
+#endif
+
+  // the task is gone: nothing reads the source anymore
+  source->stop();
+  _rate = 0;
+}
+
+size_t Mycila::PulseRMS::process() {
+  PulseSampleSource* source = _source;
+  if (!source)
+    return 0;
+
+  const uint32_t cycles = _zeroCrosses.load(std::memory_order_relaxed) >> 1;
+  const bool cycleStart = cycles != _cycleStart;
+  _cycleStart = cycles;
+
+  const PulseAnalyzer::Snapshot snapshot = _analyzer->getSnapshot();
+  const uint32_t frequency = snapshot.isOnline() ? PulseAnalyzer::getGridFrequencyMilliHz(snapshot.type, snapshot.periodNs) : 0;
+
+  // no grid
+  if (!frequency) {
+    if (_rate) {
+      LOGD(TAG, "RMS pipeline: grid lost, stop sampling");
+      source->stop();
+      _rate = 0;
+    }
+    return 0;
+  }
+
+  // (re)start at the beginning of a cycle, when the cycles would drift by more than a quarter of a sample
+  const uint32_t rate = (static_cast<uint64_t>(frequency) * _samplesPerCycle + 500) / 1000;
+  const uint32_t drift = rate > _rate ? rate - _rate : _rate - rate;
+  if (cycleStart && (!_rate || static_cast<uint64_t>(drift) * _samplesPerCycle * 4 > rate)) {
+    if (!source->start(rate)) {
+      if (rate != _unsupported)
+        LOGE(TAG, "RMS pipeline: sample rate %" PRIu32 " Hz not supported by the source", rate);
+      _unsupported = rate;
+      _rate = 0;
+      return 0;
+    }
+    LOGD(TAG, "RMS pipeline: sampling at %" PRIu32 " Hz", rate);
+    _rate = rate;
+    _restarts++;
+    // the partial cycle was sampled at the previous rate
+    _accumulator = {0, 0, 0, UINT16_MAX, 0};
+  }
+
+  if (!_rate)
+    return 0;
+
+  uint16_t samples[MYCILA_PULSE_RMS_CHUNK];
+  size_t total = 0;
+  size_t n;
+  while ((n = source->read(samples, MYCILA_PULSE_RMS_CHUNK)) > 0) {
+    total += n;
+    for (size_t i = 0; i < n;) {
+      size_t count = _samplesPerCycle - _accumulator.count;
+      if (count > n - i)
+        count = n - i;
+      _accumulate(&samples[i], count, &_accumulator);
+      i += count;
+      if (_accumulator.count == _samplesPerCycle)
+        _publish();
+    }
+  }
+
+  return total;
+}
+
+bool Mycila::PulseRMS::getResult(Result* result) const {
+  uint32_t cycle = _published.load(std::memory_order_acquire);
+  while (cycle) {
+    *result = _results[cycle & 1];
+    // the writer only writes to this buffer after publishing the next cycle
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint32_t published = _published.load(std::memory_order_relaxed);
+    if (published == cycle)
+      return true;
+    cycle = published;
+  }
+  return false;
+}
+
+void ARDUINO_ISR_ATTR Mycila::PulseRMS::onZeroCross(int16_t, void* arg) {
+  PulseRMS* instance = reinterpret_cast<PulseRMS*>(arg);
+  ISRScope scope(&instance->_zcISRRunning);
+  if (!instance->_source)
+    return;
+
+  const uint32_t zeroCrosses = instance->_zeroCrosses.load(std::memory_order_relaxed) + 1;
+  instance->_zeroCrosses.store(zeroCrosses, std::memory_order_relaxed);
+
+#ifndef MYCILA_PULSE_SIMULATION
+  // a grid cycle starts every 2 ZC events
+  TaskHandle_t task = instance->_task;
+  if (!(zeroCrosses & 1) && task) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(task, &woken);
+    portYIELD_FROM_ISR(woken);
+  }
+#endif
+}
+
+// Samples of 13 bits at most: the squares of 16 samples fit in 32 bits, which are added at once to the 64 bits sum
+void Mycila::PulseRMS::_accumulate(const uint16_t* samples, size_t count, Accumulator* accumulator) {
+  uint32_t sum = accumulator->sum;
+  uint64_t squares = accumulator->squares;
+  uint16_t min = accumulator->min;
+  uint16_t max = accumulator->max;
+
+  size_t i = 0;
+  while (i < count) {
+    const size_t end = count - i > 16 ? i + 16 : count;
+    uint32_t block = 0;
+    for (; i < end; i++) {
+      const uint32_t sample = samples[i];
+      sum += sample;
+      block += sample * sample;
+      if (sample < min)
+        min = sample;
+      if (sample > max)
+        max = sample;
+    }
+    squares += block;
+  }
+
+  accumulator->count += count;
+  accumulator->sum = sum;
+  accumulator->squares = squares;
+  accumulator->min = min;
+  accumulator->max = max;
+}
+
+void Mycila::PulseRMS::_publish() {
+  const Accumulator& a = _accumulator;
+  const uint64_t n = a.count;
+
+  // n^2 x variance = n x sum(x^2) - sum(x)^2, and n x peak = max(n x max - sum(x), sum(x) - n x min)
+  const uint64_t variance = n * a.squares - static_cast<uint64_t>(a.sum) * a.sum;
+  const uint64_t high = n * a.max - a.sum;
+  const uint64_t low = a.sum - n * a.min;
+  const uint64_t divisor = n * 1000;
+
+  const uint32_t cycle = _published.load(std::memory_order_relaxed) + 1;
+  Result* result = &_results[cycle & 1];
+  result->cycle = cycle;
+  result->rate = _rate;
+  result->samples = a.count;
+  result->offset = (a.sum + (a.count >> 1)) / a.count;
+  result->rms = (static_cast<uint64_t>(isqrt(variance)) * _scale + (divisor >> 1)) / divisor;
+  result->peak = ((high > low ? high : low) * _scale + (divisor >> 1)) / divisor;
+  _published.store(cycle, std::memory_order_release);
+
+  _accumulator = {0, 0, 0, UINT16_MAX, 0};
+
+  if (_callback)
+    _callback(*result, _callbackArg);
+}
+
+#ifndef MYCILA_PULSE_SIMULATION
+void Mycila::PulseRMS::_run(void* arg) {
+  PulseRMS* instance = reinterpret_cast<PulseRMS*>(arg);
+  while (true) {
+    // woken at each grid cycle
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MYCILA_PULSE_RMS_IDLE_MS));
+    // end()
+    if (!instance->_source)
+      break;
+    instance->process();
+  }
+  instance->_task = nullptr;
+  vTaskDelete(NULL);
+}
+#endif
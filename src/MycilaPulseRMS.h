@@ -0,0 +1,234 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ */
+#pragma once
+
+#include "MycilaPulseAnalyzer.h"
+
+#ifndef MYCILA_PULSE_SIMULATION
+  #include <soc/soc_caps.h>
+  #if SOC_ADC_DMA_SUPPORTED
+    #include <esp_adc/adc_continuous.h>
+  #endif
+  #include <freertos/FreeRTOS.h>
+  #include <freertos/task.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#ifndef MYCILA_PULSE_RMS_CHUNK
+  // Number of samples read from the source at once by the pipeline (2 bytes each, on the stack of its task)
+  #define MYCILA_PULSE_RMS_CHUNK 64
+#endif
+
+#ifndef MYCILA_PULSE_RMS_ADC_BUFFER
+  // Size in bytes of the conversions kept by the continuous ADC driver until the pipeline reads them.
+  // Default to 8192: 4 grid cycles of 512 samples at 4 bytes each (2 on the ESP32 and ESP32-S2).
+  #define MYCILA_PULSE_RMS_ADC_BUFFER 8192
+#endif
+
+namespace Mycila {
+  // Samples of the RMS pipeline: the continuous ADC driver (PulseADCSource), or a synthetic signal (PulseSyntheticSource)
+  // to run the pipeline without an ADC, i.e. on a host.
+  class PulseSampleSource {
+    public:
+      virtual ~PulseSampleSource() {}
+
+      // Start the conversions at rate samples per second from now, restarting them if running.
+      // Returns false if the rate is not supported.
+      virtual bool start(uint32_t rate) = 0;
+
+      virtual void stop() = 0;
+
+      // Read up to count samples (ADC units) converted since start(), in order, without waiting: returns the number read
+      virtual size_t read(uint16_t* samples, size_t count) = 0;
+  };
+
+#if !defined(MYCILA_PULSE_SIMULATION) && SOC_ADC_DMA_SUPPORTED
+  // Continuous (DMA) conversions of an ADC1 pin
+  class PulseADCSource : public PulseSampleSource {
+    public:
+      // pin: ADC1 pin, attenuation: ADC_ATTEN_DB_12 for the full range (about 3.1 V)
+      explicit PulseADCSource(int8_t pin, adc_atten_t attenuation = ADC_ATTEN_DB_12) : _pin(pin), _attenuation(attenuation) {}
+      ~PulseADCSource() override;
+
+      bool start(uint32_t rate) override;
+      void stop() override;
+      size_t read(uint16_t* samples, size_t count) override;
+
+    private:
+      int8_t _pin;
+      adc_atten_t _attenuation;
+      adc_continuous_handle_t _handle = nullptr;
+  };
+#endif
+
+  // Sine wave with a DC offset (i.e. a voltage divider biased at mid-scale) sampled on the clock of the library:
+  // esp_timer on a board, the simulated clock with -D MYCILA_PULSE_SIMULATION
+  class PulseSyntheticSource : public PulseSampleSource {
+    public:
+      /**
+       * @brief Set the signal, which can be changed while sampling
+       * @param offset DC offset in ADC units
+       * @param amplitude Amplitude of the fundamental in ADC units (RMS: amplitude / sqrt(2))
+       * @param frequency Frequency in mHz
+       * @param zero Time in ns of a rising zero-crossing of the fundamental, to put it in phase with the ZC pin
+       * @param harmonic Amplitude of the 3rd harmonic in % of the fundamental, in phase with it (flattened or peaked sine)
+       *
+       * The samples are rounded and clipped to 0 - 4095 (12 bits).
+       */
+      void setSignal(uint16_t offset, uint16_t amplitude, uint32_t frequency, uint64_t zero = 0, int8_t harmonic = 0);
+
+      bool start(uint32_t rate) override;
+      void stop() override { _rate = 0; }
+      size_t read(uint16_t* samples, size_t count) override;
+
+      // Samples read since start()
+      uint64_t getSampleCount() const { return _read; }
+
+    private:
+      uint16_t _offset = 2048;
+      uint16_t _amplitude = 0;
+      uint32_t _frequency = 50000;
+      uint64_t _zero = 0;
+      int8_t _harmonic = 0;
+
+      uint32_t _rate = 0;
+      uint64_t _start = 0;
+      uint64_t _read = 0;
+  };
+
+  // RMS and peak voltage of each grid cycle, sampled in phase with the grid.
+  //
+  // The samples are converted at a rate which is an integer multiple of the grid frequency measured by the analyzer,
+  // so that each grid cycle is exactly N samples (coherent sampling): the RMS of a cycle has no leakage from
+  // the cycle before or after it. The conversions are started right after a ZC event starting a grid cycle, and are
+  // restarted there when the grid frequency moves by more than a quarter of a sample per cycle.
+  //
+  // Each cycle is computed with integer math only (sums of the samples and of their squares) by the task of the pipeline,
+  // woken by the ZC events, and published in a double buffer read without lock by any task.
+  class PulseRMS {
+    public:
+      typedef struct {
+          // cycle number since begin(), from 1
+          uint32_t cycle;
+          // sample rate in Hz, and samples of the cycle
+          uint32_t rate;
+          uint16_t samples;
+          // DC offset of the samples in ADC units
+          uint16_t offset;
+          // RMS and peak voltage of the AC part (without the offset) in mV, see setScale()
+          uint32_t rms;
+          uint32_t peak;
+      } Result;
+
+      // Called from the task of the pipeline after each cycle
+      typedef void (*Callback)(const Result& result, void* arg);
+
+      ~PulseRMS() { end(); }
+
+      // Samples per grid cycle (8 or more, 512 by default). Call before begin().
+      // The ESP32 converts at least 20000 samples per second (more than 400 per cycle at 50 Hz), the other chips 611.
+      void setSamplesPerCycle(uint16_t samples) { _samplesPerCycle = samples < 8 ? 8 : samples; }
+      uint16_t getSamplesPerCycle() const { return _samplesPerCycle; }
+
+      // Voltage at the divider input of one ADC unit, in uV: i.e. ADC LSB (3.1 V / 4095 = 757 uV) times the divider ratio.
+      // 1000 by default: the results are then in ADC units.
+      void setScale(uint32_t microVoltsPerUnit) { _scale = microVoltsPerUnit; }
+      uint32_t getScale() const { return _scale; }
+
+      // Callback called after each cycle, from the task of the pipeline. Set it before begin().
+      void onCycle(Callback callback, void* arg = nullptr) {
+        _callback = callback;
+        _callbackArg = arg;
+      }
+
+      /**
+       * @brief Start the pipeline
+       * @param analyzer Analyzer measuring the grid: register the ZC callback of the pipeline in it:
+       * pulseAnalyzer.onZeroCross(Mycila::PulseRMS::onZeroCross, &rms);
+       * @param source Source of the samples, owned by the caller
+       * @param stackSize Stack size of the task of the pipeline in bytes
+       * @param priority Priority of the task of the pipeline
+       * @param core Core of the task of the pipeline, -1 for any
+       *
+       * In the host simulation, there is no task: call process() instead.
+       *
+       * @return true if the pipeline was started, false if the task could not be created
+       */
+      bool begin(PulseAnalyzer* analyzer, PulseSampleSource* source, uint32_t stackSize = 4096, uint8_t priority = 1, int8_t core = -1);
+
+      /**
+       * @brief Stop the task of the pipeline and the source. Must not be called from the callback.
+       */
+      void end();
+
+      // true if the pipeline is running
+      bool isEnabled() const { return _source != nullptr; }
+
+      // true while the source is converting at the rate of the grid
+      bool isSampling() const { return _rate != 0; }
+
+      // Read the samples converted so far and compute the complete cycles: returns the number of samples read.
+      // Starts, restarts or stops the source with the grid. Called by the task of the pipeline, or by the application in the host simulation.
+      size_t process();
+
+      // Copy the last cycle: false if there is none yet
+      bool getResult(Result* result) const;
+
+      // Cycles computed, and starts of the source (grid found, frequency change)
+      uint32_t getCycleCount() const { return _published.load(std::memory_order_acquire); }
+      uint32_t getRestartCount() const { return _restarts; }
+
+      // ZC event callback of a PulseAnalyzer (ISR), with the pipeline as argument
+      static void onZeroCross(int16_t delay, void* arg);
+
+    private:
+      typedef struct {
+          uint32_t count;
+          uint32_t sum;
+          uint64_t squares;
+          uint16_t min;
+          uint16_t max;
+      } Accumulator;
+
+      // sums of the samples of a cycle
+      static void _accumulate(const uint16_t* samples, size_t count, Accumulator* accumulator);
+      // compute the cycle and publish it in the other buffer
+      void _publish();
+
+#ifndef MYCILA_PULSE_SIMULATION
+      static void _run(void* arg);
+
+      TaskHandle_t volatile _task = nullptr;
+#endif
+
+      PulseAnalyzer* _analyzer = nullptr;
+      PulseSampleSource* volatile _source = nullptr;
+      Callback _callback = nullptr;
+      void* _callbackArg = nullptr;
+      uint16_t _samplesPerCycle = 512;
+      uint32_t _scale = 1000;
+
+      // ZC events: grid cycles started (ISR), and the last one seen by process()
+      std::atomic<uint32_t> _zeroCrosses{0};
+      // ZC event running, for end(): it notifies the task
+      std::atomic<bool> _zcISRRunning{false};
+      uint32_t _cycleStart = 0;
+
+      // sample rate of the source, 0 when stopped
+      uint32_t _rate = 0;
+      uint32_t _restarts = 0;
+      // last rate refused by the source, logged once
+      uint32_t _unsupported = 0;
+      Accumulator _accumulator = {};
+
+      // double buffer: cycle n is in _results[n & 1]
+      Result _results[2] = {};
+      std::atomic<uint32_t> _published{0};
+  };
+} // namespace Mycila
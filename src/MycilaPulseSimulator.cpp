@@ -0,0 +1,567 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ */
+#ifdef MYCILA_PULSE_SIMULATION
+
+  #include "MycilaPulseSimulator.h"
+
+  #include "priv/simulated_hal.h"
+
+  #include <chrono>
+
+  #define MYCILA_SIM_MAX_TIMERS        8
+  #define MYCILA_SIM_MAX_ETM_CHANNELS  4
+  #define MYCILA_SIM_MAX_CAP_CHANNELS  4
+  #define MYCILA_SIM_CAP_RESOLUTION_HZ 80000000
+
+struct gptimer_t {
+    bool allocated;
+    bool enabled;
+    bool running;
+    uint32_t resolution_hz;
+    // count value at the time of the last update
+    uint64_t count;
+    // simulated time of the last update
+    uint64_t updated;
+    uint64_t alarm_count;
+    uint64_t reload_count;
+    bool auto_reload;
+    bool alarm_en;
+    gptimer_alarm_cb_t on_alarm;
+    void* user_ctx;
+    // count latched by the ETM capture task or by the last gptimer_get_raw_count()
+    uint64_t captured;
+};
+
+struct esp_etm_event_t {
+    int gpio_num;
+};
+
+struct esp_etm_task_t {
+    gptimer_handle_t timer;
+};
+
+struct esp_etm_channel_t {
+    bool allocated;
+    bool enabled;
+    esp_etm_event_handle_t event;
+    esp_etm_task_handle_t task;
+};
+
+struct mcpwm_cap_timer_t {
+    bool allocated;
+    bool enabled;
+    bool running;
+    // simulated time at which the timer was started
+    uint64_t started;
+};
+
+struct mcpwm_cap_channel_t {
+    bool allocated;
+    bool enabled;
+    mcpwm_cap_timer_handle_t timer;
+    int gpio_num;
+    bool pos_edge;
+    bool neg_edge;
+    mcpwm_capture_event_cb_t on_cap;
+    void* user_ctx;
+    // event latched at the last edge, reported to the callback after the interrupt latency
+    mcpwm_capture_event_data_t event;
+    bool pending;
+};
+
+typedef struct {
+    bool level;
+    // time of the last level change
+    uint64_t changed;
+    void (*handler)(void*);
+    void* arg;
+} sim_pin_t;
+
+gpio_dev_t GPIO;
+
+static uint64_t _now = 0;
+static gptimer_t _timers[MYCILA_SIM_MAX_TIMERS];
+static sim_pin_t _pins[GPIO_NUM_MAX];
+static uint64_t _latency = 0;
+static uint64_t _timerLatency = 0;
+static uint8_t _logLevel = 4;
+static esp_etm_channel_t _etmChannels[MYCILA_SIM_MAX_ETM_CHANNELS];
+static mcpwm_cap_timer_t _capTimer;
+static mcpwm_cap_channel_t _capChannels[MYCILA_SIM_MAX_CAP_CHANNELS];
+
+///////////////////////////////////////////////////////////////////////////
+// timer helpers
+///////////////////////////////////////////////////////////////////////////
+
+static uint64_t _count(const gptimer_t* timer) {
+  if (!timer->running)
+    return timer->count;
+  return timer->count + (_now - timer->updated) * timer->resolution_hz / 1000000000ULL;
+}
+
+static void _sync(gptimer_t* timer) {
+  timer->count = _count(timer);
+  timer->updated = _now;
+}
+
+// simulated time at which the timer alarm will fire, or UINT64_MAX
+static uint64_t _alarmTime(const gptimer_t* timer) {
+  if (!timer->allocated || !timer->running || !timer->alarm_en || !timer->on_alarm)
+    return UINT64_MAX;
+  if (timer->count >= timer->alarm_count)
+    return timer->updated;
+  const uint64_t ticks = timer->alarm_count - timer->count;
+  return timer->updated + (ticks * 1000000000ULL + timer->resolution_hz - 1) / timer->resolution_hz;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// gptimer
+///////////////////////////////////////////////////////////////////////////
+
+esp_err_t gptimer_new_timer(const gptimer_config_t* config, gptimer_handle_t* ret_timer) {
+  if (!config || !ret_timer || !config->resolution_hz)
+    return ESP_ERR_INVALID_ARG;
+  for (size_t i = 0; i < MYCILA_SIM_MAX_TIMERS; i++) {
+    if (!_timers[i].allocated) {
+      _timers[i] = {};
+      _timers[i].allocated = true;
+      _timers[i].resolution_hz = config->resolution_hz;
+      _timers[i].updated = _now;
+      *ret_timer = &_timers[i];
+      return ESP_OK;
+    }
+  }
+  return ESP_ERR_NO_MEM;
+}
+
+esp_err_t gptimer_del_timer(gptimer_handle_t timer) {
+  if (!timer || timer->enabled)
+    return ESP_ERR_INVALID_ARG;
+  timer->allocated = false;
+  return ESP_OK;
+}
+
+esp_err_t gptimer_register_event_callbacks(gptimer_handle_t timer, const gptimer_event_callbacks_t* cbs, void* user_data) {
+  if (!timer || !cbs)
+    return ESP_ERR_INVALID_ARG;
+  timer->on_alarm = cbs->on_alarm;
+  timer->user_ctx = user_data;
+  return ESP_OK;
+}
+
+esp_err_t gptimer_enable(gptimer_handle_t timer) {
+  if (!timer || timer->enabled)
+    return ESP_ERR_INVALID_ARG;
+  timer->enabled = true;
+  return ESP_OK;
+}
+
+esp_err_t gptimer_disable(gptimer_handle_t timer) {
+  if (!timer || !timer->enabled || timer->running)
+    return ESP_ERR_INVALID_ARG;
+  timer->enabled = false;
+  return ESP_OK;
+}
+
+esp_err_t gptimer_start(gptimer_handle_t timer) {
+  if (!timer || !timer->enabled || timer->running)
+    return ESP_ERR_INVALID_ARG;
+  _sync(timer);
+  timer->running = true;
+  return ESP_OK;
+}
+
+esp_err_t gptimer_stop(gptimer_handle_t timer) {
+  if (!timer || !timer->running)
+    return ESP_ERR_INVALID_ARG;
+  _sync(timer);
+  timer->running = false;
+  return ESP_OK;
+}
+
+esp_err_t gptimer_set_raw_count(gptimer_handle_t timer, uint64_t value) {
+  if (!timer)
+    return ESP_ERR_INVALID_ARG;
+  timer->count = value;
+  timer->updated = _now;
+  return ESP_OK;
+}
+
+esp_err_t gptimer_get_raw_count(gptimer_handle_t timer, uint64_t* value) {
+  if (!timer || !value)
+    return ESP_ERR_INVALID_ARG;
+  *value = _count(timer);
+  timer->captured = *value;
+  return ESP_OK;
+}
+
+esp_err_t inlined_gptimer_get_captured_count(gptimer_handle_t timer, uint64_t* value) {
+  if (!timer || !value)
+    return ESP_ERR_INVALID_ARG;
+  *value = timer->captured;
+  return ESP_OK;
+}
+
+esp_err_t gptimer_set_alarm_action(gptimer_handle_t timer, const gptimer_alarm_config_t* config) {
+  if (!timer)
+    return ESP_ERR_INVALID_ARG;
+  if (config) {
+    if (config->flags.auto_reload_on_alarm && config->alarm_count == config->reload_count)
+      return ESP_ERR_INVALID_ARG;
+    _sync(timer);
+    timer->alarm_count = config->alarm_count;
+    timer->reload_count = config->reload_count;
+    timer->auto_reload = config->flags.auto_reload_on_alarm;
+    timer->alarm_en = true;
+  } else {
+    timer->auto_reload = false;
+    timer->alarm_en = false;
+  }
+  return ESP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// ETM
+///////////////////////////////////////////////////////////////////////////
+
+esp_err_t gpio_new_etm_event(const gpio_etm_event_config_t* config, esp_etm_event_handle_t* ret_event) {
+  if (!config || !ret_event || config->edge != GPIO_ETM_EVENT_EDGE_ANY)
+    return ESP_ERR_NOT_SUPPORTED;
+  *ret_event = new esp_etm_event_t{-1};
+  return ESP_OK;
+}
+
+esp_err_t gpio_etm_event_bind_gpio(esp_etm_event_handle_t event, int gpio_num) {
+  if (!event || gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+    return ESP_ERR_INVALID_ARG;
+  event->gpio_num = gpio_num;
+  return ESP_OK;
+}
+
+esp_err_t gptimer_new_etm_task(gptimer_handle_t timer, const gptimer_etm_task_config_t* config, esp_etm_task_handle_t* out_task) {
+  if (!timer || !config || !out_task)
+    return ESP_ERR_INVALID_ARG;
+  if (config->task_type != GPTIMER_ETM_TASK_CAPTURE)
+    return ESP_ERR_NOT_SUPPORTED;
+  *out_task = new esp_etm_task_t{timer};
+  return ESP_OK;
+}
+
+esp_err_t esp_etm_new_channel(const esp_etm_channel_config_t* config, esp_etm_channel_handle_t* ret_chan) {
+  if (!config || !ret_chan)
+    return ESP_ERR_INVALID_ARG;
+  for (size_t i = 0; i < MYCILA_SIM_MAX_ETM_CHANNELS; i++) {
+    if (!_etmChannels[i].allocated) {
+      _etmChannels[i] = {};
+      _etmChannels[i].allocated = true;
+      *ret_chan = &_etmChannels[i];
+      return ESP_OK;
+    }
+  }
+  return ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_etm_channel_connect(esp_etm_channel_handle_t chan, esp_etm_event_handle_t event, esp_etm_task_handle_t task) {
+  if (!chan)
+    return ESP_ERR_INVALID_ARG;
+  chan->event = event;
+  chan->task = task;
+  return ESP_OK;
+}
+
+esp_err_t esp_etm_channel_enable(esp_etm_channel_handle_t chan) {
+  if (!chan || chan->enabled)
+    return ESP_ERR_INVALID_STATE;
+  chan->enabled = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_etm_channel_disable(esp_etm_channel_handle_t chan) {
+  if (!chan || !chan->enabled)
+    return ESP_ERR_INVALID_STATE;
+  chan->enabled = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_etm_del_channel(esp_etm_channel_handle_t chan) {
+  if (!chan || chan->enabled)
+    return ESP_ERR_INVALID_STATE;
+  chan->allocated = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_etm_del_event(esp_etm_event_handle_t event) {
+  if (!event)
+    return ESP_ERR_INVALID_ARG;
+  delete event;
+  return ESP_OK;
+}
+
+esp_err_t esp_etm_del_task(esp_etm_task_handle_t task) {
+  if (!task)
+    return ESP_ERR_INVALID_ARG;
+  delete task;
+  return ESP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// MCPWM capture
+///////////////////////////////////////////////////////////////////////////
+
+esp_err_t mcpwm_new_capture_timer(const mcpwm_capture_timer_config_t* config, mcpwm_cap_timer_handle_t* ret_cap_timer) {
+  if (!config || !ret_cap_timer)
+    return ESP_ERR_INVALID_ARG;
+  if (_capTimer.allocated)
+    return ESP_ERR_NOT_FOUND;
+  _capTimer = {};
+  _capTimer.allocated = true;
+  *ret_cap_timer = &_capTimer;
+  return ESP_OK;
+}
+
+esp_err_t mcpwm_del_capture_timer(mcpwm_cap_timer_handle_t cap_timer) {
+  if (!cap_timer || cap_timer->enabled)
+    return ESP_ERR_INVALID_STATE;
+  cap_timer->allocated = false;
+  return ESP_OK;
+}
+
+esp_err_t mcpwm_capture_timer_enable(mcpwm_cap_timer_handle_t cap_timer) {
+  if (!cap_timer || cap_timer->enabled)
+    return ESP_ERR_INVALID_STATE;
+  cap_timer->enabled = true;
+  return ESP_OK;
+}
+
+esp_err_t mcpwm_capture_timer_disable(mcpwm_cap_timer_handle_t cap_timer) {
+  if (!cap_timer || !cap_timer->enabled || cap_timer->running)
+    return ESP_ERR_INVALID_STATE;
+  cap_timer->enabled = false;
+  return ESP_OK;
+}
+
+esp_err_t mcpwm_capture_timer_start(mcpwm_cap_timer_handle_t cap_timer) {
+  if (!cap_timer || !cap_timer->enabled)
+    return ESP_ERR_INVALID_STATE;
+  cap_timer->running = true;
+  cap_timer->started = _now;
+  return ESP_OK;
+}
+
+esp_err_t mcpwm_capture_timer_stop(mcpwm_cap_timer_handle_t cap_timer) {
+  if (!cap_timer || !cap_timer->running)
+    return ESP_ERR_INVALID_STATE;
+  cap_timer->running = false;
+  return ESP_OK;
+}
+
+esp_err_t mcpwm_capture_timer_get_resolution(mcpwm_cap_timer_handle_t cap_timer, uint32_t* out_resolution) {
+  if (!cap_timer || !out_resolution)
+    return ESP_ERR_INVALID_ARG;
+  *out_resolution = MYCILA_SIM_CAP_RESOLUTION_HZ;
+  return ESP_OK;
+}
+
+esp_err_t mcpwm_new_capture_channel(mcpwm_cap_timer_handle_t cap_timer, const mcpwm_capture_channel_config_t* config, mcpwm_cap_channel_handle_t* ret_cap_channel) {
+  if (!cap_timer || !config || !ret_cap_channel || config->gpio_num < 0 || config->gpio_num >= GPIO_NUM_MAX)
+    return ESP_ERR_INVALID_ARG;
+  for (size_t i = 0; i < MYCILA_SIM_MAX_CAP_CHANNELS; i++) {
+    if (!_capChannels[i].allocated) {
+      _capChannels[i] = {};
+      _capChannels[i].allocated = true;
+      _capChannels[i].timer = cap_timer;
+      _capChannels[i].gpio_num = config->gpio_num;
+      _capChannels[i].pos_edge = config->flags.pos_edge;
+      _capChannels[i].neg_edge = config->flags.neg_edge;
+      *ret_cap_channel = &_capChannels[i];
+      return ESP_OK;
+    }
+  }
+  return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t mcpwm_del_capture_channel(mcpwm_cap_channel_handle_t cap_channel) {
+  if (!cap_channel || cap_channel->enabled)
+    return ESP_ERR_INVALID_STATE;
+  cap_channel->allocated = false;
+  return ESP_OK;
+}
+
+esp_err_t mcpwm_capture_channel_enable(mcpwm_cap_channel_handle_t cap_channel) {
+  if (!cap_channel || cap_channel->enabled)
+    return ESP_ERR_INVALID_STATE;
+  cap_channel->enabled = true;
+  return ESP_OK;
+}
+
+esp_err_t mcpwm_capture_channel_disable(mcpwm_cap_channel_handle_t cap_channel) {
+  if (!cap_channel || !cap_channel->enabled)
+    return ESP_ERR_INVALID_STATE;
+  cap_channel->enabled = false;
+  cap_channel->pending = false;
+  return ESP_OK;
+}
+
+esp_err_t mcpwm_capture_channel_register_event_callbacks(mcpwm_cap_channel_handle_t cap_channel, const mcpwm_capture_event_callbacks_t* cbs, void* user_data) {
+  if (!cap_channel || !cbs || cap_channel->enabled)
+    return ESP_ERR_INVALID_STATE;
+  cap_channel->on_cap = cbs->on_cap;
+  cap_channel->user_ctx = user_data;
+  return ESP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// GPIO
+///////////////////////////////////////////////////////////////////////////
+
+uint32_t esp_cpu_get_cycle_count() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void pinMode(uint8_t, uint8_t) {}
+
+void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int) {
+  if (pin < GPIO_NUM_MAX) {
+    _pins[pin].handler = handler;
+    _pins[pin].arg = arg;
+  }
+}
+
+void detachInterrupt(uint8_t pin) {
+  if (pin < GPIO_NUM_MAX) {
+    _pins[pin].handler = nullptr;
+    _pins[pin].arg = nullptr;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Simulator API
+///////////////////////////////////////////////////////////////////////////
+
+uint64_t Mycila::PulseSimulator::now() { return _now; }
+
+void Mycila::PulseSimulator::advance(uint64_t ns) { advanceTo(_now + ns); }
+
+void Mycila::PulseSimulator::advanceTo(uint64_t ns) {
+  while (true) {
+    // find the next alarm to fire before the target time
+    gptimer_t* next = nullptr;
+    uint64_t at = UINT64_MAX;
+    for (size_t i = 0; i < MYCILA_SIM_MAX_TIMERS; i++) {
+      const uint64_t t = _alarmTime(&_timers[i]);
+      if (t < at) {
+        at = t;
+        next = &_timers[i];
+      }
+    }
+
+    if (!next || at > ns)
+      break;
+
+    if (at > _now)
+      _now = at;
+
+    gptimer_alarm_event_data_t event;
+    event.count_value = _count(next);
+    event.alarm_value = next->alarm_count;
+
+    // the hardware reloads the counter on alarm, or disables the alarm in one-shot mode
+    if (next->auto_reload) {
+      next->count = next->reload_count;
+      next->updated = _now;
+    } else {
+      _sync(next);
+      next->alarm_en = false;
+    }
+
+    // the ISR starts later
+    _now += _timerLatency;
+
+    next->on_alarm(next, &event, next->user_ctx);
+  }
+
+  if (ns > _now)
+    _now = ns;
+}
+
+void Mycila::PulseSimulator::setLevel(int8_t pin, bool level) {
+  if (pin < 0 || pin >= GPIO_NUM_MAX || _pins[pin].level == level)
+    return;
+  _pins[pin].level = level;
+  _pins[pin].changed = _now;
+
+  // the hardware latches the captures at the edge time
+  for (size_t i = 0; i < MYCILA_SIM_MAX_ETM_CHANNELS; i++) {
+    esp_etm_channel_t* chan = &_etmChannels[i];
+    if (chan->allocated && chan->enabled && chan->event && chan->task && chan->event->gpio_num == pin)
+      chan->task->timer->captured = _count(chan->task->timer);
+  }
+  for (size_t i = 0; i < MYCILA_SIM_MAX_CAP_CHANNELS; i++) {
+    mcpwm_cap_channel_t* chan = &_capChannels[i];
+    if (chan->allocated && chan->enabled && chan->timer->running && chan->gpio_num == pin && (level ? chan->pos_edge : chan->neg_edge)) {
+      chan->event.cap_value = static_cast<uint32_t>((_now - chan->timer->started) * (MYCILA_SIM_CAP_RESOLUTION_HZ / 1000000) / 1000);
+      chan->event.cap_edge = level ? MCPWM_CAP_EDGE_POS : MCPWM_CAP_EDGE_NEG;
+      chan->pending = true;
+    }
+  }
+
+  // the interrupts are serviced later
+  if (_latency)
+    advanceTo(_now + _latency);
+
+  if (_pins[pin].handler)
+    _pins[pin].handler(_pins[pin].arg);
+
+  for (size_t i = 0; i < MYCILA_SIM_MAX_CAP_CHANNELS; i++) {
+    mcpwm_cap_channel_t* chan = &_capChannels[i];
+    if (chan->pending) {
+      chan->pending = false;
+      if (chan->on_cap)
+        chan->on_cap(chan, &chan->event, chan->user_ctx);
+    }
+  }
+}
+
+void Mycila::PulseSimulator::setInterruptLatency(uint64_t ns) { _latency = ns; }
+
+void Mycila::PulseSimulator::setTimerLatency(uint64_t ns) { _timerLatency = ns; }
+
+void Mycila::PulseSimulator::setLogLevel(uint8_t level) { _logLevel = level; }
+
+uint8_t Mycila::PulseSimulator::getLogLevel() { return _logLevel; }
+
+bool Mycila::PulseSimulator::getLevel(int8_t pin) {
+  return pin >= 0 && pin < GPIO_NUM_MAX && _pins[pin].level;
+}
+
+void Mycila::PulseSimulator::driveLevel(int8_t pin, bool level) {
+  if (pin < 0 || pin >= GPIO_NUM_MAX || _pins[pin].level == level)
+    return;
+  _pins[pin].level = level;
+  _pins[pin].changed = _now;
+}
+
+uint64_t Mycila::PulseSimulator::getLastChange(int8_t pin) {
+  return pin >= 0 && pin < GPIO_NUM_MAX ? _pins[pin].changed : 0;
+}
+
+size_t Mycila::PulseSimulator::getTimerCount() {
+  size_t count = 0;
+  for (size_t i = 0; i < MYCILA_SIM_MAX_TIMERS; i++)
+    if (_timers[i].allocated)
+      count++;
+  return count;
+}
+
+void Mycila::PulseSimulator::reset() {
+  assert(getTimerCount() == 0);
+  _now = 0;
+  _latency = 0;
+  _timerLatency = 0;
+  for (size_t i = 0; i < GPIO_NUM_MAX; i++)
+    _pins[i] = {};
+}
+
+#endif
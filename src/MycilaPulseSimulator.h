@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Simulated hardware backend, enabled with -D MYCILA_PULSE_SIMULATION.
+ *
+ * It replaces the GPIO interrupt and the gptimer driver with a simulated clock and edge source,
+ * so that the analyzer ISRs can be driven and measured on a host (Linux, macOS) without a board.
+ */
+#pragma once
+
+#ifdef MYCILA_PULSE_SIMULATION
+
+  #include <stddef.h>
+  #include <stdint.h>
+
+///////////////////////////////////////////////////////////////////////////
+// Minimal replacements of the ESP-IDF types used in the public API
+///////////////////////////////////////////////////////////////////////////
+
+typedef enum {
+  GPIO_NUM_NC = -1,
+  GPIO_NUM_MAX = 64,
+} gpio_num_t;
+
+// all the capture backends are simulated
+  #define SOC_GPIO_SUPPORT_ETM  1
+  #define SOC_TIMER_SUPPORT_ETM 1
+  #define SOC_MCPWM_SUPPORTED   1
+
+typedef struct gptimer_t* gptimer_handle_t;
+
+// no concurrency in the simulator: critical sections are no-ops
+typedef int portMUX_TYPE;
+  #define portMUX_INITIALIZER_UNLOCKED 0
+
+typedef struct esp_etm_event_t* esp_etm_event_handle_t;
+typedef struct esp_etm_task_t* esp_etm_task_handle_t;
+typedef struct esp_etm_channel_t* esp_etm_channel_handle_t;
+
+typedef struct mcpwm_cap_timer_t* mcpwm_cap_timer_handle_t;
+typedef struct mcpwm_cap_channel_t* mcpwm_cap_channel_handle_t;
+
+typedef enum {
+  MCPWM_CAP_EDGE_POS = 0,
+  MCPWM_CAP_EDGE_NEG = 1,
+} mcpwm_capture_edge_t;
+
+typedef struct {
+    uint32_t cap_value;
+    mcpwm_capture_edge_t cap_edge;
+} mcpwm_capture_event_data_t;
+
+typedef struct {
+    uint64_t count_value;
+    uint64_t alarm_value;
+} gptimer_alarm_event_data_t;
+
+namespace Mycila {
+  namespace PulseSimulator {
+    // Simulated clock in nanoseconds
+    uint64_t now();
+
+    // Move the simulated clock forward, firing all timer alarms on the way
+    void advance(uint64_t ns);
+    void advanceTo(uint64_t ns);
+
+    // Set the level of a simulated pin.
+    // If the level changes, the hardware captures (ETM, MCPWM) are latched at the current time,
+    // then the interrupt handlers attached to the pin are called after the interrupt latency.
+    void setLevel(int8_t pin, bool level);
+    bool getLevel(int8_t pin);
+
+    // Set the level of a simulated output pin, as written by the library: no capture, no interrupt
+    void driveLevel(int8_t pin, bool level);
+
+    // Time of the last level change of a simulated pin, in ns
+    uint64_t getLastChange(int8_t pin);
+
+    // Delay between an edge and the call of its interrupt handlers, in ns (0 by default).
+    // The timer alarms due during this delay are fired before the handlers.
+    void setInterruptLatency(uint64_t ns);
+
+    // Delay between a timer alarm and the call of its callback, in ns (0 by default).
+    // The counter is reloaded at the alarm and keeps counting in between, like the hardware.
+    void setTimerLatency(uint64_t ns);
+
+    // Level of the logs printed by the library, like esp_log_level_t: 0 (none) to 4 (debug, default).
+    // Not changed by reset().
+    void setLogLevel(uint8_t level);
+    uint8_t getLogLevel();
+
+    // Number of timers currently allocated
+    size_t getTimerCount();
+
+    // Reset the simulated clock and pin levels. Must be called when no timer is allocated.
+    void reset();
+  } // namespace PulseSimulator
+} // namespace Mycila
+
+#endif
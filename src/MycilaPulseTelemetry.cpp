@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ */
+#include "MycilaPulseTelemetry.h"
+
+#include "MycilaPulseAnalyzer.h"
+
+#include <string.h>
+
+size_t Mycila::PulseTelemetry::decode(const uint8_t* data, size_t size, Frame* frame) {
+  if (size < sizeof(Frame) || data[0] != MYCILA_PULSE_TELEMETRY_VERSION || data[1] != sizeof(Frame))
+    return 0;
+  memcpy(frame, data, sizeof(Frame));
+  return sizeof(Frame);
+}
+
+#ifdef MYCILA_JSON_SUPPORT
+void Mycila::PulseTelemetry::toJson(const Frame& frame, const JsonObject& root) {
+  const PulseAnalyzer::Type type = static_cast<PulseAnalyzer::Type>(frame.type);
+  root["enabled"] = (frame.flags & FLAG_ENABLED) != 0;
+  root["online"] = (frame.flags & FLAG_ONLINE) != 0;
+  root["generation"] = frame.generation;
+  root["type"] = frame.type;
+  root["frequency"] = frame.period ? 1000000 / frame.period : 0;
+  root["frequency_mhz"] = frame.periodNs ? static_cast<uint32_t>((1000000000000ULL + (frame.periodNs >> 1)) / frame.periodNs) : 0;
+  root["period"] = frame.period;
+  root["period_ns"] = frame.periodNs;
+  root["period_min"] = frame.periodMin;
+  root["period_max"] = frame.periodMax;
+  root["period_variance"] = frame.periodVariance;
+  root["shift"] = frame.shift;
+  root["width"] = frame.width;
+  root["width_min"] = frame.widthMin;
+  root["width_max"] = frame.widthMax;
+  root["width_variance"] = frame.widthVariance;
+  root["adaptive_filter"] = (frame.flags & FLAG_ADAPTIVE_FILTER) != 0;
+  root["latency_compensation"]["enabled"] = (frame.flags & FLAG_LATENCY_COMPENSATION) != 0;
+  root["latency_compensation"]["latency_ns"] = frame.latencyCompensation;
+  root["pll"]["enabled"] = (frame.flags & FLAG_PLL) != 0;
+  root["pll"]["locked"] = (frame.flags & FLAG_PLL_LOCKED) != 0;
+  root["pll"]["frequency"] = frame.pllFrequency;
+  root["pll"]["phase_error"] = frame.pllPhaseError;
+  root["grid"]["frequency"] = frame.nominalSemiPeriod ? 1000000 / (frame.nominalSemiPeriod << 1) : 0;
+  root["grid"]["frequency_mhz"] = PulseAnalyzer::getGridFrequencyMilliHz(type, frame.periodNs);
+  root["grid"]["period"] = frame.nominalSemiPeriod << 1;
+  root["grid"]["semi-period"] = frame.nominalSemiPeriod;
+  root["diagnostics"]["glitches"] = frame.glitches;
+  root["diagnostics"]["gaps"] = frame.gaps;
+  root["diagnostics"]["noise"] = frame.noise;
+  root["diagnostics"]["classification_failures"] = frame.classificationFailures;
+  root["diagnostics"]["offline"] = frame.offline;
+  root["diagnostics"]["zero_crosses"] = frame.zeroCrosses;
+}
+#endif
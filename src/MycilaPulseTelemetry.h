@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ */
+#pragma once
+
+#ifdef MYCILA_JSON_SUPPORT
+  #include <ArduinoJson.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+  #error "The telemetry frames are little endian"
+#endif
+
+// Telemetry frame version, incremented at each incompatible change of the layout
+#define MYCILA_PULSE_TELEMETRY_VERSION 1
+
+namespace Mycila {
+  // Compact binary telemetry of an analyzer: the state and the counters of toJson() in a fixed layout frame of 72 bytes,
+  // written by PulseAnalyzer::toTelemetry() in a buffer of the caller, without any allocation.
+  //
+  // The frame starts with its version and its size, so that a stream of frames can be split and the frames of another
+  // version skipped. All the values are little endian. The values derived from the measurements in toJson()
+  // (frequencies in Hz and mHz, grid period) are not in the frame: the decoder computes them.
+  namespace PulseTelemetry {
+    enum Flag : uint16_t {
+      FLAG_ENABLED = 1 << 0,
+      FLAG_ONLINE = 1 << 1,
+      FLAG_ADAPTIVE_FILTER = 1 << 2,
+      FLAG_LATENCY_COMPENSATION = 1 << 3,
+      FLAG_PLL = 1 << 4,
+      FLAG_PLL_LOCKED = 1 << 5,
+    };
+
+    typedef struct __attribute__((packed)) {
+        // MYCILA_PULSE_TELEMETRY_VERSION
+        uint8_t version;
+        // size of the frame in bytes
+        uint8_t size;
+        // Flag bits
+        uint16_t flags;
+        // snapshot of the measurements (see PulseAnalyzer::Snapshot)
+        uint32_t generation;
+        uint8_t type;
+        uint8_t reserved;
+        int16_t shift;
+        uint16_t nominalSemiPeriod;
+        uint16_t period;
+        uint16_t periodMin;
+        uint16_t periodMax;
+        uint32_t periodVariance;
+        uint32_t periodNs;
+        uint16_t width;
+        uint16_t widthMin;
+        uint16_t widthMax;
+        // PLL mode: phase error in us and followed frequency in mHz
+        int16_t pllPhaseError;
+        uint32_t widthVariance;
+        // latency compensation in ns
+        uint32_t latencyCompensation;
+        uint32_t pllFrequency;
+        // diagnostic counters
+        uint32_t glitches;
+        uint32_t gaps;
+        uint32_t noise;
+        uint32_t classificationFailures;
+        uint32_t offline;
+        uint32_t zeroCrosses;
+    } Frame;
+
+    static_assert(sizeof(Frame) == 72, "Telemetry frame layout changed: increment MYCILA_PULSE_TELEMETRY_VERSION");
+
+    // Decode a frame: returns its size, or 0 if data does not start with a complete frame of this version.
+    // When the frame is of another version, its size is in data[1]: the next frame starts there.
+    size_t decode(const uint8_t* data, size_t size, Frame* frame);
+
+#ifdef MYCILA_JSON_SUPPORT
+    // Same JSON as PulseAnalyzer::toJson(), without the ISR cycles (i.e. on a host receiving the frames)
+    void toJson(const Frame& frame, const JsonObject& root);
+#endif
+  } // namespace PulseTelemetry
+} // namespace Mycila
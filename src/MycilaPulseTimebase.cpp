@@ -0,0 +1,244 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ */
+#include "MycilaPulseTimebase.h"
+
+#ifdef MYCILA_PULSE_SIMULATION
+  // simulated gpio, timers and logging
+  #include "priv/simulated_hal.h"
+#else
+  // memory
+  #include <esp_attr.h>
+
+  // logging
+  #include <esp32-hal-log.h>
+
+  // timers
+  #include "priv/inlined_gptimer.h"
+#endif
+
+// running ISRs
+#include "priv/isr_scope.h"
+
+#ifdef MYCILA_LOGGER_SUPPORT
+  #include <MycilaLogger.h>
+extern Mycila::Logger logger;
+  #define LOGD(tag, format, ...) logger.debug(tag, format, ##__VA_ARGS__)
+  #define LOGI(tag, format, ...) logger.info(tag, format, ##__VA_ARGS__)
+  #define LOGW(tag, format, ...) logger.warn(tag, format, ##__VA_ARGS__)
+  #define LOGE(tag, format, ...) logger.error(tag, format, ##__VA_ARGS__)
+#else
+  #define LOGD(tag, format, ...) ESP_LOGD(tag, format, ##__VA_ARGS__)
+  #define LOGI(tag, format, ...) ESP_LOGI(tag, format, ##__VA_ARGS__)
+  #define LOGW(tag, format, ...) ESP_LOGW(tag, format, ##__VA_ARGS__)
+  #define LOGE(tag, format, ...) ESP_LOGE(tag, format, ##__VA_ARGS__)
+#endif
+
+#define TAG "PULSE"
+
+bool Mycila::PulseTimebase::begin(uint8_t priority, bool shared) {
+  if (isEnabled())
+    return true;
+
+  LOGI(TAG, "Enable shared timebase with %d slots", MYCILA_PULSE_TIMEBASE_SLOTS);
+
+  gptimer_config_t timer_config;
+  timer_config.clk_src = GPTIMER_CLK_SRC_DEFAULT;
+  timer_config.direction = GPTIMER_COUNT_UP;
+  timer_config.resolution_hz = 1000000; // 1MHz resolution
+  timer_config.flags.intr_shared = shared;
+  timer_config.intr_priority = priority;
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+  timer_config.flags.backup_before_sleep = false;
+#endif
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 4, 0)
+  timer_config.flags.allow_pd = false;
+#endif
+
+  if (gptimer_new_timer(&timer_config, &_timer) != ESP_OK) {
+    LOGE(TAG, "No timer available for the shared timebase");
+    _timer = nullptr;
+    return false;
+  }
+
+  gptimer_event_callbacks_t callbacks;
+  callbacks.on_alarm = _alarmISR;
+  ESP_ERROR_CHECK(gptimer_register_event_callbacks(_timer, &callbacks, this));
+  ESP_ERROR_CHECK(gptimer_enable(_timer));
+  ESP_ERROR_CHECK(gptimer_set_raw_count(_timer, 0));
+  ESP_ERROR_CHECK(gptimer_start(_timer));
+
+  _armed = UINT64_MAX;
+
+  return true;
+}
+
+void Mycila::PulseTimebase::end() {
+  if (!isEnabled())
+    return;
+
+  if (getSlotCount()) {
+    LOGE(TAG, "Shared timebase still in use by %d slots", static_cast<int>(getSlotCount()));
+    return;
+  }
+
+  LOGI(TAG, "Disable shared timebase");
+
+  ESP_ERROR_CHECK(gptimer_stop(_timer));
+  ESP_ERROR_CHECK(gptimer_disable(_timer));
+  ESP_ERROR_CHECK(gptimer_del_timer(_timer));
+  _timer = nullptr;
+}
+
+uint64_t ARDUINO_ISR_ATTR Mycila::PulseTimebase::now() const {
+  uint64_t count = 0;
+  inlined_gptimer_get_raw_count(_timer, &count);
+  return count;
+}
+
+int8_t Mycila::PulseTimebase::attach(Callback callback, void* arg) {
+  if (!callback)
+    return -1;
+  int8_t slot = -1;
+  portENTER_CRITICAL_SAFE(&_lock);
+  for (int8_t i = 0; i < MYCILA_PULSE_TIMEBASE_SLOTS; i++) {
+    if (!_slots[i].callback) {
+      _slots[i].callback = callback;
+      _slots[i].arg = arg;
+      _slots[i].deadline = UINT64_MAX;
+      _slots[i].period = 0;
+      slot = i;
+      break;
+    }
+  }
+  portEXIT_CRITICAL_SAFE(&_lock);
+  return slot;
+}
+
+void Mycila::PulseTimebase::detach(int8_t slot) {
+  if (slot < 0 || slot >= MYCILA_PULSE_TIMEBASE_SLOTS)
+    return;
+  portENTER_CRITICAL_SAFE(&_lock);
+  _slots[slot].callback = nullptr;
+  _slots[slot].arg = nullptr;
+  _slots[slot].deadline = UINT64_MAX;
+  _slots[slot].period = 0;
+  // the alarm will fire for nothing if it was armed for this slot, and be re-armed to the next deadline
+  portEXIT_CRITICAL_SAFE(&_lock);
+  // the callbacks collected by the alarm ISR before are called outside of the lock
+  waitISR(&_dispatching);
+}
+
+size_t Mycila::PulseTimebase::getSlotCount() const {
+  size_t count = 0;
+  for (size_t i = 0; i < MYCILA_PULSE_TIMEBASE_SLOTS; i++)
+    if (_slots[i].callback)
+      count++;
+  return count;
+}
+
+void ARDUINO_ISR_ATTR Mycila::PulseTimebase::schedule(int8_t slot, uint64_t at, uint32_t period) {
+  if (slot < 0 || slot >= MYCILA_PULSE_TIMEBASE_SLOTS)
+    return;
+  portENTER_CRITICAL_SAFE(&_lock);
+  const uint64_t previous = _slots[slot].deadline;
+  _slots[slot].deadline = at;
+  _slots[slot].period = period;
+  // the alarm only needs to be re-programmed if the earliest deadline changed
+  if (at < _armed || previous == _armed)
+    _arm(now());
+  portEXIT_CRITICAL_SAFE(&_lock);
+}
+
+void ARDUINO_ISR_ATTR Mycila::PulseTimebase::cancel(int8_t slot) {
+  if (slot < 0 || slot >= MYCILA_PULSE_TIMEBASE_SLOTS)
+    return;
+  portENTER_CRITICAL_SAFE(&_lock);
+  const uint64_t previous = _slots[slot].deadline;
+  _slots[slot].deadline = UINT64_MAX;
+  if (previous == _armed)
+    _arm(now());
+  portEXIT_CRITICAL_SAFE(&_lock);
+}
+
+uint64_t ARDUINO_ISR_ATTR Mycila::PulseTimebase::getDeadline(int8_t slot) const {
+  if (slot < 0 || slot >= MYCILA_PULSE_TIMEBASE_SLOTS)
+    return UINT64_MAX;
+  // rewritten by the alarm ISR on the other core: a 64-bit read is not atomic on a 32-bit CPU
+  portENTER_CRITICAL_SAFE(&_lock);
+  const uint64_t deadline = _slots[slot].deadline;
+  portEXIT_CRITICAL_SAFE(&_lock);
+  return deadline;
+}
+
+uint32_t ARDUINO_ISR_ATTR Mycila::PulseTimebase::getPeriod(int8_t slot) const {
+  if (slot < 0 || slot >= MYCILA_PULSE_TIMEBASE_SLOTS)
+    return 0;
+  portENTER_CRITICAL_SAFE(&_lock);
+  const uint32_t period = _slots[slot].period;
+  portEXIT_CRITICAL_SAFE(&_lock);
+  return period;
+}
+
+void ARDUINO_ISR_ATTR Mycila::PulseTimebase::_arm(uint64_t now) {
+  uint64_t next = UINT64_MAX;
+  for (size_t i = 0; i < MYCILA_PULSE_TIMEBASE_SLOTS; i++)
+    if (_slots[i].callback && _slots[i].deadline < next)
+      next = _slots[i].deadline;
+
+  if (next == _armed)
+    return;
+
+  _armed = next;
+
+  if (next == UINT64_MAX) {
+    inlined_gptimer_set_alarm_action(_timer, nullptr);
+    return;
+  }
+
+  // some timers only fire when the count equals the alarm: never program an alarm in the past
+  gptimer_alarm_config_t alarm_cfg;
+  alarm_cfg.alarm_count = next > now + 1 ? next : now + 2;
+  alarm_cfg.reload_count = 0;
+  alarm_cfg.flags.auto_reload_on_alarm = false;
+  inlined_gptimer_set_alarm_action(_timer, &alarm_cfg);
+}
+
+bool ARDUINO_ISR_ATTR Mycila::PulseTimebase::_alarmISR(gptimer_handle_t, const gptimer_alarm_event_data_t*, void* arg) {
+  Mycila::PulseTimebase* instance = (Mycila::PulseTimebase*)arg;
+  // set before collecting the callbacks under the lock: detach() waits for the ones collected before it took the lock
+  ISRScope scope(&instance->_dispatching);
+  Callback callbacks[MYCILA_PULSE_TIMEBASE_SLOTS];
+  void* args[MYCILA_PULSE_TIMEBASE_SLOTS];
+  size_t count = 0;
+
+  // collect the slots due and move their deadline, then call them outside of the lock so that they can re-schedule
+  portENTER_CRITICAL_SAFE(&instance->_lock);
+  const uint64_t now = instance->now();
+  for (size_t i = 0; i < MYCILA_PULSE_TIMEBASE_SLOTS; i++) {
+    Slot* slot = &instance->_slots[i];
+    if (slot->callback && slot->deadline <= now) {
+      if (slot->period) {
+        // periodic slots stay aligned on their first deadline
+        do {
+          slot->deadline += slot->period;
+        } while (slot->deadline <= now);
+      } else {
+        slot->deadline = UINT64_MAX;
+      }
+      callbacks[count] = slot->callback;
+      args[count] = slot->arg;
+      count++;
+    }
+  }
+  // the one-shot alarm is disabled by the hardware once fired
+  instance->_armed = UINT64_MAX;
+  instance->_arm(now);
+  portEXIT_CRITICAL_SAFE(&instance->_lock);
+
+  for (size_t i = 0; i < count; i++)
+    callbacks[i](args[i]);
+
+  return false;
+}
@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ */
+#pragma once
+
+#ifdef MYCILA_PULSE_SIMULATION
+  #include "MycilaPulseSimulator.h"
+#else
+  #include <driver/gptimer_types.h>
+  #include <freertos/FreeRTOS.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#ifndef MYCILA_PULSE_TIMEBASE_SLOTS
+  // Number of compare slots of a shared timebase.
+  // Each analyzer using the timebase takes 2 slots (ZC event and offline detection).
+  // Default to 8: 3 phases and 2 free slots for other uses.
+  #define MYCILA_PULSE_TIMEBASE_SLOTS 8
+#endif
+
+namespace Mycila {
+  // A free running 1 MHz gptimer shared by several users through compare slots.
+  // Each slot has its own deadline (one-shot or periodic) and callback.
+  // The hardware alarm is always programmed to the earliest deadline, so a single timer serves all the slots.
+  class PulseTimebase {
+    public:
+      // Called from the timer ISR when the slot deadline is reached.
+      // Callback should be in IRAM (ARDUINO_ISR_ATTR) and do minimal work.
+      typedef void (*Callback)(void* arg);
+
+      ~PulseTimebase() { end(); }
+
+      // Allocate and start the timer. Does nothing if already started.
+      // priority: interrupt priority level (0: default, 1 to 3), shared: interrupt shared with other peripherals or dedicated.
+      // The interrupt is allocated on the core calling begin().
+      // Returns false if no timer could be allocated.
+      bool begin(uint8_t priority = 0, bool shared = true);
+
+      // Stop and release the timer. All the slots must be detached first.
+      void end();
+
+      // true if the timer is running
+      bool isEnabled() const { return _timer != nullptr; }
+
+      // Current time in microseconds since begin() (ISR safe)
+      uint64_t now() const;
+
+      // Reserve a slot: returns its index, or -1 if all the slots are taken.
+      // Call before using the slot from an ISR.
+      int8_t attach(Callback callback, void* arg = nullptr);
+
+      // Release a slot, cancelling its deadline, and wait for the slot callbacks still running on the other core:
+      // the argument of the slot can be released once it returns. Must not be called from a slot callback.
+      void detach(int8_t slot);
+
+      // Number of slots in use
+      size_t getSlotCount() const;
+
+      // Fire the slot callback at time at (in us, see now()), then every period us if period > 0 (ISR safe).
+      // A deadline in the past fires as soon as possible.
+      void schedule(int8_t slot, uint64_t at, uint32_t period = 0);
+
+      // Cancel the slot deadline (ISR safe)
+      void cancel(int8_t slot);
+
+      // Next deadline of the slot, or UINT64_MAX if not scheduled (or not a valid slot) (ISR safe)
+      uint64_t getDeadline(int8_t slot) const;
+
+      // Period of the slot in us, 0 for a one-shot slot (or not a valid slot) (ISR safe)
+      uint32_t getPeriod(int8_t slot) const;
+
+    private:
+      typedef struct {
+          Callback callback;
+          void* arg;
+          // UINT64_MAX when not scheduled
+          uint64_t deadline;
+          uint32_t period;
+      } Slot;
+
+      static bool _alarmISR(gptimer_handle_t timer, const gptimer_alarm_event_data_t* event, void* arg);
+
+      // program the timer alarm to the earliest deadline (ISR, called with the lock held)
+      void _arm(uint64_t now);
+
+      gptimer_handle_t _timer = nullptr;
+      Slot _slots[MYCILA_PULSE_TIMEBASE_SLOTS] = {};
+      // deadline currently programmed in the timer alarm, UINT64_MAX if none
+      uint64_t _armed = UINT64_MAX;
+      // mutable: the 64-bit deadlines are also read under the lock by the const getters
+      mutable portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+      // the alarm ISR is calling the slot callbacks, for detach()
+      std::atomic<bool> _dispatching{false};
+  };
+} // namespace Mycila
@@ -0,0 +1,250 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ */
+#include "MycilaPulseTrace.h"
+
+#ifdef MYCILA_PULSE_SIMULATION
+  // simulated clock and logging
+  #include "priv/simulated_hal.h"
+#else
+  // memory
+  #include <esp_attr.h>
+
+  // logging
+  #include <esp32-hal-log.h>
+
+  // timers
+  #include <esp_timer.h>
+#endif
+
+// running ISRs
+#include "priv/isr_scope.h"
+
+#ifdef MYCILA_LOGGER_SUPPORT
+  #include <MycilaLogger.h>
+extern Mycila::Logger logger;
+  #define LOGD(tag, format, ...) logger.debug(tag, format, ##__VA_ARGS__)
+  #define LOGI(tag, format, ...) logger.info(tag, format, ##__VA_ARGS__)
+  #define LOGW(tag, format, ...) logger.warn(tag, format, ##__VA_ARGS__)
+  #define LOGE(tag, format, ...) logger.error(tag, format, ##__VA_ARGS__)
+#else
+  #define LOGD(tag, format, ...) ESP_LOGD(tag, format, ##__VA_ARGS__)
+  #define LOGI(tag, format, ...) ESP_LOGI(tag, format, ##__VA_ARGS__)
+  #define LOGW(tag, format, ...) ESP_LOGW(tag, format, ##__VA_ARGS__)
+  #define LOGE(tag, format, ...) ESP_LOGE(tag, format, ##__VA_ARGS__)
+#endif
+
+#include <inttypes.h>
+#include <string.h>
+
+#define TAG "PULSE"
+
+static const char MAGIC[4] = {'Z', 'C', 'T', 'R'};
+
+///////////////////////////////////////////////////////////////////////////
+// Format
+///////////////////////////////////////////////////////////////////////////
+
+size_t ARDUINO_ISR_ATTR Mycila::PulseTrace::encode(uint8_t* buffer, uint32_t delta, uint32_t reference, bool level, bool resync) {
+  uint64_t value;
+  if (resync) {
+    value = static_cast<uint64_t>(delta) << 2 | 2 | level;
+  } else {
+    const int64_t change = static_cast<int64_t>(delta) - reference;
+    value = static_cast<uint64_t>(change < 0 ? ((-change) << 1) - 1 : change << 1) << 2 | level;
+  }
+  size_t length = 0;
+  while (value >= 0x80) {
+    buffer[length++] = static_cast<uint8_t>(value) | 0x80;
+    value >>= 7;
+  }
+  buffer[length++] = static_cast<uint8_t>(value);
+  return length;
+}
+
+bool Mycila::PulseTrace::Reader::begin(const uint8_t* data, size_t size) {
+  _data = nullptr;
+  if (!data || size < sizeof(Header))
+    return false;
+  memcpy(&_header, data, sizeof(Header));
+  if (memcmp(_header.magic, MAGIC, sizeof(MAGIC)) != 0 || _header.version != MYCILA_PULSE_TRACE_VERSION || !_header.resolution)
+    return false;
+  _data = data;
+  _size = size;
+  _position = sizeof(Header);
+  _time = 0;
+  _count = 0;
+  _deltas[0] = 0;
+  _deltas[1] = 0;
+  return true;
+}
+
+bool Mycila::PulseTrace::Reader::next(Record* record) {
+  if (!_data)
+    return false;
+
+  // varint, invalid if longer than a 64 bits value or truncated
+  uint64_t value = 0;
+  size_t position = _position;
+  for (size_t shift = 0;; shift += 7) {
+    if (position >= _size || shift >= RECORD_MAX_SIZE * 7)
+      return false;
+    const uint8_t byte = _data[position++];
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      break;
+  }
+
+  const uint64_t payload = value >> 2;
+  record->level = value & 1;
+  record->resync = value & 2;
+  uint32_t delta;
+  if (record->resync) {
+    delta = payload;
+  } else {
+    const int64_t change = payload & 1 ? -static_cast<int64_t>((payload + 1) >> 1) : static_cast<int64_t>(payload >> 1);
+    delta = _deltas[0] + change;
+  }
+  _deltas[0] = _deltas[1];
+  _deltas[1] = delta;
+
+  _time += delta;
+  record->time = _time;
+  _position = position;
+  _count++;
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Recorder
+///////////////////////////////////////////////////////////////////////////
+
+void Mycila::PulseTraceRecorder::begin() {
+  // the edge ISR is done with the previous recording and its partition, if any, before the encoder state is reset
+  end();
+
+  memcpy(_header.magic, MAGIC, sizeof(MAGIC));
+  _header.version = MYCILA_PULSE_TRACE_VERSION;
+  memset(_header.reserved, 0, sizeof(_header.reserved));
+  _header.resolution = 1000000;
+  _header.start = esp_timer_get_time();
+
+  _last = _header.start;
+  _deltas[0] = 0;
+  _deltas[1] = 0;
+  _resync = true;
+  _head.store(0, std::memory_order_relaxed);
+  _tail.store(0, std::memory_order_relaxed);
+  _count.store(0, std::memory_order_relaxed);
+  _dropped.store(0, std::memory_order_relaxed);
+
+  _recording = true;
+}
+
+#ifndef MYCILA_PULSE_SIMULATION
+bool Mycila::PulseTraceRecorder::begin(const char* partition) {
+  end();
+
+  const esp_partition_t* p = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partition);
+  if (!p) {
+    LOGE(TAG, "Trace partition %s not found", partition);
+    return false;
+  }
+
+  LOGI(TAG, "Erase trace partition %s (%" PRIu32 " bytes)", partition, p->size);
+  if (esp_partition_erase_range(p, 0, p->size) != ESP_OK) {
+    LOGE(TAG, "Failed to erase trace partition %s", partition);
+    return false;
+  }
+
+  begin();
+
+  if (esp_partition_write(p, 0, &_header, sizeof(_header)) != ESP_OK) {
+    LOGE(TAG, "Failed to write trace partition %s", partition);
+    _recording = false;
+    return false;
+  }
+
+  _offset = sizeof(_header);
+  _partition = p;
+  return true;
+}
+
+size_t Mycila::PulseTraceRecorder::flush() {
+  if (!_partition)
+    return 0;
+
+  uint8_t chunk[256];
+  size_t total = 0;
+  size_t count;
+  while ((count = read(chunk, sizeof(chunk))) > 0) {
+    // partition full: keep what fits and stop
+    const size_t room = _partition->size - _offset;
+    if (count > room) {
+      count = room;
+      _recording = false;
+      LOGW(TAG, "Trace partition full: recording stopped");
+    }
+    if (esp_partition_write(_partition, _offset, chunk, count) != ESP_OK) {
+      LOGE(TAG, "Failed to write trace partition");
+      _recording = false;
+      break;
+    }
+    _offset += count;
+    total += count;
+    if (!_recording)
+      break;
+  }
+  return total;
+}
+#endif
+
+void Mycila::PulseTraceRecorder::end() {
+  _recording = false;
+  waitISR(&_recordingISR);
+#ifndef MYCILA_PULSE_SIMULATION
+  if (_partition) {
+    flush();
+    _partition = nullptr;
+  }
+#endif
+}
+
+void ARDUINO_ISR_ATTR Mycila::PulseTraceRecorder::record(uint32_t timestamp, bool level) {
+  ISRScope scope(&_recordingISR);
+  if (!_recording)
+    return;
+
+  uint8_t bytes[PulseTrace::RECORD_MAX_SIZE];
+  const uint32_t delta = timestamp - _last;
+  const size_t length = PulseTrace::encode(bytes, delta, _deltas[0], level, _resync);
+
+  // ring full: drop the edge, the next record carries the time since the last recorded one
+  const uint32_t head = _head.load(std::memory_order_relaxed);
+  if (MYCILA_PULSE_TRACE_BUFFER_SIZE - (head - _tail.load(std::memory_order_acquire)) < length) {
+    _resync = true;
+    _dropped.store(_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return;
+  }
+
+  for (size_t i = 0; i < length; i++)
+    _buffer[(head + i) & (MYCILA_PULSE_TRACE_BUFFER_SIZE - 1)] = bytes[i];
+  _head.store(head + length, std::memory_order_release);
+
+  _last = timestamp;
+  _deltas[0] = _deltas[1];
+  _deltas[1] = delta;
+  _resync = false;
+  _count.store(_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+size_t Mycila::PulseTraceRecorder::read(uint8_t* buffer, size_t size) {
+  const uint32_t tail = _tail.load(std::memory_order_relaxed);
+  const uint32_t available = _head.load(std::memory_order_acquire) - tail;
+  const size_t count = available < size ? available : size;
+  for (size_t i = 0; i < count; i++)
+    buffer[i] = _buffer[(tail + i) & (MYCILA_PULSE_TRACE_BUFFER_SIZE - 1)];
+  _tail.store(tail + count, std::memory_order_release);
+  return count;
+}
@@ -0,0 +1,170 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ */
+#pragma once
+
+#ifdef MYCILA_PULSE_SIMULATION
+  #include "MycilaPulseSimulator.h"
+#else
+  #include <esp_partition.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#ifndef MYCILA_PULSE_TRACE_BUFFER_SIZE
+  // Size in bytes of the RAM ring of a trace recorder (power of 2).
+  // An edge takes 1 to 3 bytes: default to 4096, about 10 s of a short pulse signal.
+  #define MYCILA_PULSE_TRACE_BUFFER_SIZE 4096
+#endif
+
+#if (MYCILA_PULSE_TRACE_BUFFER_SIZE & (MYCILA_PULSE_TRACE_BUFFER_SIZE - 1)) != 0
+  #error "MYCILA_PULSE_TRACE_BUFFER_SIZE must be a power of 2"
+#endif
+
+// Trace format version, incremented at each incompatible change
+#define MYCILA_PULSE_TRACE_VERSION 1
+
+namespace Mycila {
+  // Binary trace of the raw edges of a ZC signal, as seen by the edge ISR of an analyzer (before any filtering).
+  //
+  // A trace is a Header followed by one record per edge. A record is an unsigned LEB128 varint (7 bits per byte, least
+  // significant first, high bit set on all the bytes but the last one) holding:
+  // - bit 0: level of the signal after the edge (1: rising edge),
+  // - bit 1: resync: edges were lost before this one (or first record),
+  // - bits 2+: resync: time since the previous record (or since the start of the trace for the first one),
+  //            otherwise: that time minus the one 2 records before, zigzag encoded (0, -1, 1, -2... as 0, 1, 2, 3...).
+  // The high and low levels of a signal cycle are steady: a record takes 1 byte on a clean signal, 2 with a usual jitter.
+  // All the multi-byte values are little endian. The end of the trace is the end of the data, or an invalid record
+  // (i.e. the erased bytes at the end of a flash partition).
+  namespace PulseTrace {
+    typedef struct __attribute__((packed)) {
+        // "ZCTR"
+        char magic[4];
+        // MYCILA_PULSE_TRACE_VERSION
+        uint8_t version;
+        uint8_t reserved[3];
+        // resolution of the times in Hz (1000000: us)
+        uint32_t resolution;
+        // timestamp of the start of the trace (lower 32 bits of esp_timer_get_time())
+        uint32_t start;
+    } Header;
+
+    typedef struct {
+        // time since the start of the trace, in 1 / resolution s
+        uint64_t time;
+        // level of the signal after the edge
+        bool level;
+        // edges were lost just before this one
+        bool resync;
+    } Record;
+
+    // maximum length of a record in bytes (64 bits varint)
+    constexpr size_t RECORD_MAX_SIZE = 10;
+
+    // Encode a record in buffer (at least RECORD_MAX_SIZE bytes): returns its length.
+    // delta: time since the previous record, reference: the one of 2 records before.
+    size_t encode(uint8_t* buffer, uint32_t delta, uint32_t reference, bool level, bool resync);
+
+    // Trace decoder, reading a trace in memory (i.e. a mmapped file or a memory mapped flash partition)
+    class Reader {
+      public:
+        // Returns false if the data does not start with a valid header
+        bool begin(const uint8_t* data, size_t size);
+
+        const Header& getHeader() const { return _header; }
+
+        // Decode the next record: returns false at the end of the trace
+        bool next(Record* record);
+
+        // Records decoded and bytes consumed so far (header included)
+        uint64_t getCount() const { return _count; }
+        size_t getPosition() const { return _position; }
+
+      private:
+        const uint8_t* _data = nullptr;
+        size_t _size = 0;
+        size_t _position = 0;
+        Header _header = {};
+        uint64_t _time = 0;
+        uint64_t _count = 0;
+        uint32_t _deltas[2] = {0, 0};
+    };
+  } // namespace PulseTrace
+
+  // Records the edges of an analyzer in a binary trace (see PulseTrace), to replay them on a host with the TraceReplay tool.
+  //
+  // The edge ISR of the analyzer encodes each edge in a RAM ring (see MYCILA_PULSE_TRACE_BUFFER_SIZE, a few instructions per edge),
+  // which is drained by a task: read() to send the trace elsewhere (i.e. over HTTP), or flush() to a flash partition.
+  // When the ring is full the edges are dropped and counted, and the next recorded edge is marked.
+  // Times are in us (esp_timer_get_time(), minus the interrupt latency when it is measured). With the MCPWM capture backend,
+  // the times between the edges come from the capture counts, as for the analysis: the interrupt latency is not recorded.
+  class PulseTraceRecorder {
+    public:
+      ~PulseTraceRecorder() { end(); }
+
+      // Start a recording from now, in the RAM ring. The header of the trace is given by getHeader().
+      // A recording in progress is stopped first (see end()).
+      void begin();
+
+#ifndef MYCILA_PULSE_SIMULATION
+      // Start a recording to a data partition (i.e. "trace"), from now: the partition is erased (slow) and the header written.
+      // Call flush() regularly from a task. Returns false if the partition was not found or could not be written.
+      bool begin(const char* partition);
+#endif
+
+      // Stop the recording, waiting for an edge being recorded on the other core. Pending data is written to the partition, if any.
+      void end();
+
+      bool isRecording() const { return _recording; }
+
+      const PulseTrace::Header& getHeader() const { return _header; }
+
+      // Record an edge (ISR safe, single producer): called by the edge ISR of the analyzer.
+      void record(uint32_t timestamp, bool level);
+
+      // Move up to size bytes of the RAM ring to buffer: returns the number of bytes copied.
+      // Must be called from a single consumer task, and not with a partition.
+      size_t read(uint8_t* buffer, size_t size);
+
+#ifndef MYCILA_PULSE_SIMULATION
+      // Write the RAM ring to the partition: returns the number of bytes written.
+      // When the partition is full, the recording stops.
+      size_t flush();
+
+      // Bytes written to the partition, header included
+      size_t getPartitionSize() const { return _offset; }
+#endif
+
+      // Edges recorded and edges dropped because the ring was full
+      uint32_t getCount() const { return _count.load(std::memory_order_relaxed); }
+      uint32_t getDroppedCount() const { return _dropped.load(std::memory_order_relaxed); }
+
+    private:
+      volatile bool _recording = false;
+      // record() running, for begin() and end()
+      std::atomic<bool> _recordingISR{false};
+      PulseTrace::Header _header = {};
+
+      // encoder state (ISR): timestamp of the last record, last 2 deltas, edges lost since the last record
+      uint32_t _last = 0;
+      uint32_t _deltas[2] = {0, 0};
+      bool _resync = true;
+
+      // RAM ring: written by the ISR (head), read by a task (tail)
+      uint8_t _buffer[MYCILA_PULSE_TRACE_BUFFER_SIZE];
+      std::atomic<uint32_t> _head{0};
+      std::atomic<uint32_t> _tail{0};
+
+      std::atomic<uint32_t> _count{0};
+      std::atomic<uint32_t> _dropped{0};
+
+#ifndef MYCILA_PULSE_SIMULATION
+      const esp_partition_t* _partition = nullptr;
+      size_t _offset = 0;
+#endif
+  };
+} // namespace Mycila
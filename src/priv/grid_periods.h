@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Nominal grid periods and semi-periods (48-52 Hz and 58-62 Hz), shared by the analyzer, the dimmer and the power tables.
+ */
+#pragma once
+
+#include <stdint.h>
+
+// Periods
+
+#define MYCILA_PERIOD_48_US 20800 // for 48 Hz
+#define MYCILA_PERIOD_49_US 20408 // for 49 Hz
+#define MYCILA_PERIOD_50_US 20000 // for 50 Hz
+#define MYCILA_PERIOD_51_US 19608 // for 51 Hz
+#define MYCILA_PERIOD_52_US 19200 // for 52 Hz
+
+#define MYCILA_PERIOD_58_US 17240 // for 58 Hz
+#define MYCILA_PERIOD_59_US 16950 // for 59 Hz
+#define MYCILA_PERIOD_60_US 16666 // for 60 Hz
+#define MYCILA_PERIOD_61_US 16394 // for 61 Hz
+#define MYCILA_PERIOD_62_US 16130 // for 62 Hz
+
+// Semi-periods
+
+#define MYCILA_SEMI_PERIOD_48_US 10400 // for 48 Hz
+#define MYCILA_SEMI_PERIOD_49_US 10204 // for 49 Hz
+#define MYCILA_SEMI_PERIOD_50_US 10000 // for 50 Hz
+#define MYCILA_SEMI_PERIOD_51_US 9804  // for 51 Hz
+#define MYCILA_SEMI_PERIOD_52_US 9600  // for 52 Hz
+
+#define MYCILA_SEMI_PERIOD_58_US 8620 // for 58 Hz
+#define MYCILA_SEMI_PERIOD_59_US 8475 // for 59 Hz
+#define MYCILA_SEMI_PERIOD_60_US 8333 // for 60 Hz
+#define MYCILA_SEMI_PERIOD_61_US 8197 // for 61 Hz
+#define MYCILA_SEMI_PERIOD_62_US 8065 // for 62 Hz
+
+#define PERIODS_LEN 10 // array length of the PERIODS and SEMI_PERIODS arrays
+
+static constexpr uint16_t PERIODS[] = {
+  MYCILA_PERIOD_48_US,
+  MYCILA_PERIOD_49_US,
+  MYCILA_PERIOD_50_US,
+  MYCILA_PERIOD_51_US,
+  MYCILA_PERIOD_52_US,
+  MYCILA_PERIOD_58_US,
+  MYCILA_PERIOD_59_US,
+  MYCILA_PERIOD_60_US,
+  MYCILA_PERIOD_61_US,
+  MYCILA_PERIOD_62_US,
+};
+static constexpr uint16_t SEMI_PERIODS[] = {
+  MYCILA_SEMI_PERIOD_48_US,
+  MYCILA_SEMI_PERIOD_49_US,
+  MYCILA_SEMI_PERIOD_50_US,
+  MYCILA_SEMI_PERIOD_51_US,
+  MYCILA_SEMI_PERIOD_52_US,
+  MYCILA_SEMI_PERIOD_58_US,
+  MYCILA_SEMI_PERIOD_59_US,
+  MYCILA_SEMI_PERIOD_60_US,
+  MYCILA_SEMI_PERIOD_61_US,
+  MYCILA_SEMI_PERIOD_62_US,
+};
+
+// search the closest value in above arrays sorted in descending order
+__attribute__((always_inline)) inline static uint16_t closest(const uint16_t* array, uint16_t n) {
+  int32_t left = 0, right = PERIODS_LEN - 1, mid;
+
+  // binary search
+  while (left <= right) {
+    mid = left + ((right - left) >> 1);
+    // found!
+    if (array[mid] == n)
+      return n;
+    // if middle value is greater than n, search in the remaining right half
+    if (array[mid] > n)
+      left = mid + 1;
+    else
+      right = mid - 1; // right can become before left
+  }
+
+  // Safely handle bounds - ensure we don't access invalid array indices
+  if (right < 0)
+    return array[0]; // Use first element if right underflowed
+  if (left >= PERIODS_LEN)
+    return array[PERIODS_LEN - 1]; // Use last element if left overflowed
+
+  // Both indices are valid, return the closest value
+  uint16_t leftDiff = (array[left] > n) ? (array[left] - n) : (n - array[left]);
+  uint16_t rightDiff = (array[right] > n) ? (array[right] - n) : (n - array[right]);
+
+  return (leftDiff < rightDiff) ? array[left] : array[right];
+}
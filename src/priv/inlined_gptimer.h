@@ -135,3 +135,16 @@ __attribute__((always_inline)) inline esp_err_t inlined_gptimer_set_alarm_action
   portEXIT_CRITICAL_SAFE(&timer->spinlock);
   return ESP_OK;
 }
+
+#if SOC_TIMER_SUPPORT_ETM
+// count latched by the GPTIMER_ETM_TASK_CAPTURE task (gptimer_get_captured_count)
+__attribute__((always_inline)) inline esp_err_t inlined_gptimer_get_captured_count(gptimer_handle_t timer, uint64_t* value) {
+  if (timer == NULL || value == NULL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  portENTER_CRITICAL_SAFE(&timer->spinlock);
+  *value = timer_ll_get_counter_value((&timer->hal)->dev, (&timer->hal)->timer_id);
+  portEXIT_CRITICAL_SAFE(&timer->spinlock);
+  return ESP_OK;
+}
+#endif
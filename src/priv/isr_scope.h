@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Running flag of an ISR, so that end() can wait for the ISRs still running on the other core before releasing
+ * what they use. Shared by the analyzer, the timebase, the trace recorder and the users of the ZC events.
+ */
+#pragma once
+
+#include <atomic>
+
+// ISR running from the creation of the scope to its end, for end().
+// The flag is visible to end() before the ISR reads the state that end() changes (i.e. the slot or the task to notify).
+class ISRScope {
+  public:
+    __attribute__((always_inline)) inline explicit ISRScope(std::atomic<bool>* running) : _running(running) {
+      running->store(true, std::memory_order_seq_cst);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+    __attribute__((always_inline)) inline ~ISRScope() { _running->store(false, std::memory_order_release); }
+
+  private:
+    std::atomic<bool>* _running;
+};
+
+// wait for an ISR running on the other core
+static inline void waitISR(const std::atomic<bool>* running) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  while (running->load(std::memory_order_acquire))
+    continue;
+}
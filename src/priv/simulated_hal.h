@@ -0,0 +1,259 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) Mathieu Carbou
+ *
+ * Replacements of the ESP-IDF / Arduino functions used by the analyzer when built with -D MYCILA_PULSE_SIMULATION.
+ * Function names and signatures match the ones of the real drivers and of inlined_gptimer.h
+ * so that the analyzer code is the same for both backends.
+ */
+#pragma once
+
+// requires MycilaPulseSimulator.h to be included first
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+///////////////////////////////////////////////////////////////////////////
+// esp_err.h / esp_attr.h / esp_idf_version.h
+///////////////////////////////////////////////////////////////////////////
+
+typedef int esp_err_t;
+
+#define ESP_OK                0
+#define ESP_FAIL              -1
+#define ESP_ERR_NO_MEM        0x101
+#define ESP_ERR_INVALID_ARG   0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_NOT_FOUND     0x105
+#define ESP_ERR_NOT_SUPPORTED 0x106
+
+#define ESP_ERROR_CHECK(x)                                                               \
+  do {                                                                                   \
+    esp_err_t err_rc_ = (x);                                                             \
+    if (err_rc_ != ESP_OK) {                                                             \
+      fprintf(stderr, "ESP_ERROR_CHECK failed: 0x%x at %s:%d\n", err_rc_, __FILE__, __LINE__); \
+      abort();                                                                           \
+    }                                                                                    \
+  } while (0)
+
+#define IRAM_ATTR
+#define ARDUINO_ISR_ATTR
+
+#define ESP_IDF_VERSION_VAL(major, minor, patch) ((major << 16) | (minor << 8) | (patch))
+#define ESP_IDF_VERSION                          ESP_IDF_VERSION_VAL(5, 5, 0)
+
+#define SIM_LOG(level, letter, tag, format, ...)              \
+  do {                                                        \
+    if (Mycila::PulseSimulator::getLogLevel() >= level)       \
+      printf(letter " %s: " format "\n", tag, ##__VA_ARGS__); \
+  } while (0)
+
+#define ESP_LOGD(tag, format, ...) SIM_LOG(4, "D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) SIM_LOG(3, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) SIM_LOG(2, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGE(tag, format, ...) SIM_LOG(1, "E", tag, format, ##__VA_ARGS__)
+
+#define ets_printf printf
+
+#define portENTER_CRITICAL_SAFE(mux) (void)(mux)
+#define portEXIT_CRITICAL_SAFE(mux)  (void)(mux)
+
+typedef unsigned int UBaseType_t;
+#define portSET_INTERRUPT_MASK_FROM_ISR()      0
+#define portCLEAR_INTERRUPT_MASK_FROM_ISR(mask) (void)(mask)
+
+///////////////////////////////////////////////////////////////////////////
+// esp_timer.h
+///////////////////////////////////////////////////////////////////////////
+
+inline int64_t esp_timer_get_time() { return Mycila::PulseSimulator::now() / 1000; }
+
+///////////////////////////////////////////////////////////////////////////
+// esp_cpu.h
+///////////////////////////////////////////////////////////////////////////
+
+// host clock in ns: the simulated clock does not move while an ISR runs
+uint32_t esp_cpu_get_cycle_count();
+
+///////////////////////////////////////////////////////////////////////////
+// GPIO
+///////////////////////////////////////////////////////////////////////////
+
+#define GPIO_IS_VALID_GPIO(gpio_num) ((gpio_num) >= 0 && (gpio_num) < GPIO_NUM_MAX)
+
+#define INPUT  0x01
+#define OUTPUT 0x03
+#define CHANGE 0x03
+
+typedef struct {
+} gpio_dev_t;
+extern gpio_dev_t GPIO;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+inline uint32_t gpio_ll_get_level(gpio_dev_t*, uint32_t gpio_num) { return Mycila::PulseSimulator::getLevel(gpio_num); }
+inline void gpio_ll_set_level(gpio_dev_t*, uint32_t gpio_num, uint32_t level) { Mycila::PulseSimulator::driveLevel(gpio_num, level); }
+
+///////////////////////////////////////////////////////////////////////////
+// esp_intr_alloc.h / GPIO ISR service
+///////////////////////////////////////////////////////////////////////////
+
+#define ESP_INTR_FLAG_LEVEL1 (1 << 1)
+#define ESP_INTR_FLAG_SHARED (1 << 8)
+#define ESP_INTR_FLAG_IRAM   (1 << 10)
+#define ESP_INTR_FLAG_LOWMED 0x0E
+#define ARDUINO_ISR_FLAG     0
+
+// no interrupt controller: priorities and cores have no effect on the simulated interrupts
+inline esp_err_t gpio_install_isr_service(int) { return ESP_OK; }
+inline const char* esp_err_to_name(esp_err_t) { return "ESP_ERR"; }
+
+///////////////////////////////////////////////////////////////////////////
+// gptimer
+///////////////////////////////////////////////////////////////////////////
+
+typedef enum {
+  GPTIMER_CLK_SRC_DEFAULT = 0,
+} gptimer_clock_source_t;
+
+typedef enum {
+  GPTIMER_COUNT_DOWN = 0,
+  GPTIMER_COUNT_UP = 1,
+} gptimer_count_direction_t;
+
+typedef bool (*gptimer_alarm_cb_t)(gptimer_handle_t timer, const gptimer_alarm_event_data_t* edata, void* user_ctx);
+
+typedef struct {
+    gptimer_clock_source_t clk_src;
+    gptimer_count_direction_t direction;
+    uint32_t resolution_hz;
+    int intr_priority;
+    struct {
+        uint32_t intr_shared : 1;
+        uint32_t allow_pd : 1;
+        uint32_t backup_before_sleep : 1;
+    } flags;
+} gptimer_config_t;
+
+typedef struct {
+    gptimer_alarm_cb_t on_alarm;
+} gptimer_event_callbacks_t;
+
+typedef struct {
+    uint64_t alarm_count;
+    uint64_t reload_count;
+    struct {
+        uint32_t auto_reload_on_alarm : 1;
+    } flags;
+} gptimer_alarm_config_t;
+
+esp_err_t gptimer_new_timer(const gptimer_config_t* config, gptimer_handle_t* ret_timer);
+esp_err_t gptimer_del_timer(gptimer_handle_t timer);
+esp_err_t gptimer_register_event_callbacks(gptimer_handle_t timer, const gptimer_event_callbacks_t* cbs, void* user_data);
+esp_err_t gptimer_enable(gptimer_handle_t timer);
+esp_err_t gptimer_disable(gptimer_handle_t timer);
+esp_err_t gptimer_start(gptimer_handle_t timer);
+esp_err_t gptimer_stop(gptimer_handle_t timer);
+esp_err_t gptimer_set_raw_count(gptimer_handle_t timer, uint64_t value);
+esp_err_t gptimer_get_raw_count(gptimer_handle_t timer, uint64_t* value);
+esp_err_t gptimer_set_alarm_action(gptimer_handle_t timer, const gptimer_alarm_config_t* config);
+
+// same as inlined_gptimer.h
+inline esp_err_t inlined_gptimer_get_raw_count(gptimer_handle_t timer, uint64_t* value) { return gptimer_get_raw_count(timer, value); }
+inline esp_err_t inlined_gptimer_set_raw_count(gptimer_handle_t timer, uint64_t value) { return gptimer_set_raw_count(timer, value); }
+inline esp_err_t inlined_gptimer_set_alarm_action(gptimer_handle_t timer, const gptimer_alarm_config_t* config) { return gptimer_set_alarm_action(timer, config); }
+
+// count latched by the ETM capture task, or by the last gptimer_get_raw_count()
+esp_err_t inlined_gptimer_get_captured_count(gptimer_handle_t timer, uint64_t* value);
+
+///////////////////////////////////////////////////////////////////////////
+// ETM
+///////////////////////////////////////////////////////////////////////////
+
+typedef enum {
+  GPIO_ETM_EVENT_EDGE_POS,
+  GPIO_ETM_EVENT_EDGE_NEG,
+  GPIO_ETM_EVENT_EDGE_ANY,
+} gpio_etm_event_edge_t;
+
+typedef enum {
+  GPTIMER_ETM_TASK_START_COUNT,
+  GPTIMER_ETM_TASK_STOP_COUNT,
+  GPTIMER_ETM_TASK_EN_ALARM,
+  GPTIMER_ETM_TASK_RELOAD,
+  GPTIMER_ETM_TASK_CAPTURE,
+} gptimer_etm_task_type_t;
+
+typedef struct {
+    gpio_etm_event_edge_t edge;
+} gpio_etm_event_config_t;
+
+typedef struct {
+    gptimer_etm_task_type_t task_type;
+} gptimer_etm_task_config_t;
+
+typedef struct {
+    struct {
+        uint32_t allow_pd : 1;
+    } flags;
+} esp_etm_channel_config_t;
+
+esp_err_t gpio_new_etm_event(const gpio_etm_event_config_t* config, esp_etm_event_handle_t* ret_event);
+esp_err_t gpio_etm_event_bind_gpio(esp_etm_event_handle_t event, int gpio_num);
+esp_err_t gptimer_new_etm_task(gptimer_handle_t timer, const gptimer_etm_task_config_t* config, esp_etm_task_handle_t* out_task);
+esp_err_t esp_etm_new_channel(const esp_etm_channel_config_t* config, esp_etm_channel_handle_t* ret_chan);
+esp_err_t esp_etm_channel_connect(esp_etm_channel_handle_t chan, esp_etm_event_handle_t event, esp_etm_task_handle_t task);
+esp_err_t esp_etm_channel_enable(esp_etm_channel_handle_t chan);
+esp_err_t esp_etm_channel_disable(esp_etm_channel_handle_t chan);
+esp_err_t esp_etm_del_channel(esp_etm_channel_handle_t chan);
+esp_err_t esp_etm_del_event(esp_etm_event_handle_t event);
+esp_err_t esp_etm_del_task(esp_etm_task_handle_t task);
+
+///////////////////////////////////////////////////////////////////////////
+// MCPWM capture
+///////////////////////////////////////////////////////////////////////////
+
+typedef enum {
+  MCPWM_CAPTURE_CLK_SRC_DEFAULT = 0,
+} mcpwm_capture_clock_source_t;
+
+typedef bool (*mcpwm_capture_event_cb_t)(mcpwm_cap_channel_handle_t cap_channel, const mcpwm_capture_event_data_t* edata, void* user_ctx);
+
+typedef struct {
+    int group_id;
+    mcpwm_capture_clock_source_t clk_src;
+    uint32_t resolution_hz;
+} mcpwm_capture_timer_config_t;
+
+typedef struct {
+    int gpio_num;
+    int intr_priority;
+    uint32_t prescale;
+    struct {
+        uint32_t pos_edge : 1;
+        uint32_t neg_edge : 1;
+        uint32_t pull_up : 1;
+        uint32_t pull_down : 1;
+    } flags;
+} mcpwm_capture_channel_config_t;
+
+typedef struct {
+    mcpwm_capture_event_cb_t on_cap;
+} mcpwm_capture_event_callbacks_t;
+
+esp_err_t mcpwm_new_capture_timer(const mcpwm_capture_timer_config_t* config, mcpwm_cap_timer_handle_t* ret_cap_timer);
+esp_err_t mcpwm_del_capture_timer(mcpwm_cap_timer_handle_t cap_timer);
+esp_err_t mcpwm_capture_timer_enable(mcpwm_cap_timer_handle_t cap_timer);
+esp_err_t mcpwm_capture_timer_disable(mcpwm_cap_timer_handle_t cap_timer);
+esp_err_t mcpwm_capture_timer_start(mcpwm_cap_timer_handle_t cap_timer);
+esp_err_t mcpwm_capture_timer_stop(mcpwm_cap_timer_handle_t cap_timer);
+esp_err_t mcpwm_capture_timer_get_resolution(mcpwm_cap_timer_handle_t cap_timer, uint32_t* out_resolution);
+esp_err_t mcpwm_new_capture_channel(mcpwm_cap_timer_handle_t cap_timer, const mcpwm_capture_channel_config_t* config, mcpwm_cap_channel_handle_t* ret_cap_channel);
+esp_err_t mcpwm_del_capture_channel(mcpwm_cap_channel_handle_t cap_channel);
+esp_err_t mcpwm_capture_channel_enable(mcpwm_cap_channel_handle_t cap_channel);
+esp_err_t mcpwm_capture_channel_disable(mcpwm_cap_channel_handle_t cap_channel);
+esp_err_t mcpwm_capture_channel_register_event_callbacks(mcpwm_cap_channel_handle_t cap_channel, const mcpwm_capture_event_callbacks_t* cbs, void* user_data);